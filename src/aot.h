@@ -0,0 +1,52 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include <stdint.h>
+
+// Interface between the emulator and ROM libraries generated by `chip8-aot`.
+// This header is included by the generated sources, so it must stay free of
+// any dependency on the rest of the emulator.
+
+// Bump whenever Chip8AotContext changes layout, or generated code must change
+// to keep matching the interpreter
+#define CHIP8_AOT_ABI_VERSION 4
+
+#define CHIP8_AOT_RUN_SYMBOL "chip8_aot_run"
+#define CHIP8_AOT_HASH_SYMBOL "chip8_aot_rom_hash"
+#define CHIP8_AOT_ABI_SYMBOL "chip8_aot_abi_version"
+
+struct Chip8AotContext {
+    // Memory is 16 pages of 256 bytes, which may be shared with other
+    // machines. Read through the page table; write through writablePage(),
+    // which returns this machine's own copy of the page.
+    const uint8_t *const *pages;
+    uint8_t *(*writablePage)(void *chip8, unsigned page);
+    uint8_t *V;
+    uint16_t *I;
+    uint16_t *stack;
+    uint8_t *sp;
+    uint16_t *pc;
+    uint8_t *delayTimer;
+    uint8_t *soundTimer;
+    uint8_t *keypad;
+    bool legacyShift;
+
+    // One bit per 256-byte page, set for every page a store touches
+    uint16_t *dirtyPages;
+
+    // Set by the library when a store lands on compiled code; the emulator
+    // stops using the library from then on.
+    bool invalidated;
+
+    // Executes the instruction at *pc with Chip8::handleOpcode(). Returns
+    // false if the machine is now blocked waiting for a key press.
+    void *chip8;
+    bool (*interpret)(void *chip8);
+};
+
+// Runs up to `budget` instructions starting at *ctx->pc and returns how many
+// were executed. Running exactly `budget` instructions leaves the machine in
+// the same state as `budget` calls to Chip8::step().
+typedef int (*Chip8AotRunFn)(Chip8AotContext *ctx, int budget);
+
+#endif // AOT_H
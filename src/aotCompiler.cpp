@@ -0,0 +1,421 @@
+#include <cstdio>
+#include <cstring>
+
+#include "aot.h"
+#include "aotCompiler.h"
+#include "hash.h"
+
+using namespace std;
+
+
+namespace {
+
+enum InstructionKind {
+    Straight,       // emitted inline, falls through
+    Interpreted,    // handed to Chip8::handleOpcode(), falls through
+    Jump,           // 1nnn
+    Call,           // 2nnn
+    Return,         // 00EE
+    Skip,           // 3xkk, 4xkk, 5xy0, 9xy0, Ex9E, ExA1
+    ComputedJump,   // Bnnn
+    NotCompiled,    // Fx0A and unknown opcodes, always left to the interpreter
+};
+
+InstructionKind classify(uint16_t opcode) {
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if (opcode == 0x00E0) {
+                return Interpreted;
+            }
+            if (opcode == 0x00EE) {
+                return Return;
+            }
+            return NotCompiled;
+        case 0x1000:
+            return Jump;
+        case 0x2000:
+            return Call;
+        case 0x3000:
+        case 0x4000:
+        case 0x5000:
+        case 0x9000:
+            return Skip;
+        case 0x6000:
+        case 0x7000:
+        case 0xA000:
+            return Straight;
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0: case 0x1: case 0x2: case 0x3:
+                case 0x4: case 0x5: case 0x6: case 0x7: case 0xE:
+                    return Straight;
+            }
+            return NotCompiled;
+        case 0xB000:
+            return ComputedJump;
+        case 0xC000:
+            // Keeps using the instance's random number stream
+            return Interpreted;
+        case 0xD000:
+            return Interpreted;
+        case 0xE000:
+            if ((opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1) {
+                return Skip;
+            }
+            return NotCompiled;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x07: case 0x15: case 0x18: case 0x1E:
+                case 0x29: case 0x33: case 0x55: case 0x65:
+                    return Straight;
+            }
+            return NotCompiled;
+    }
+    return NotCompiled;
+}
+
+string hexLiteral(unsigned value, int width) {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "0x%0*X", width, value);
+    return string(buffer);
+}
+
+}
+
+
+AotCompiler::AotCompiler(const uint8_t *rom, int size) : codeBytes(MEMORY_SIZE, false) {
+    memset(memory, 0, sizeof(memory));
+    romSize = size;
+    memcpy(memory + INTERPRETER_SIZE, rom, size);
+    romHash = fnv1a64(rom, size);
+
+    this->discoverBlocks();
+}
+
+uint16_t AotCompiler::opcodeAt(uint16_t address) {
+    return memory[address] << 8 | memory[address + 1];
+}
+
+int AotCompiler::blockCount() {
+    return blocks.size();
+}
+
+vector<uint16_t> AotCompiler::successors(uint16_t address, uint16_t opcode, bool &endsBlock, bool &compiled) {
+    vector<uint16_t> next;
+    endsBlock = true;
+    compiled = true;
+    switch (classify(opcode)) {
+        case Straight:
+        case Interpreted:
+            endsBlock = false;
+            break;
+        case Jump:
+            if ((opcode & 0x0FFF) == address) {
+                // Jump to self, the interpreter reports the halt
+                compiled = false;
+                break;
+            }
+            next.push_back(opcode & 0x0FFF);
+            break;
+        case Call:
+            // The return lands on address + 2 through the dispatcher
+            next.push_back(opcode & 0x0FFF);
+            next.push_back(address + 2);
+            break;
+        case Skip:
+            next.push_back(address + 2);
+            next.push_back(address + 4);
+            break;
+        case Return:
+        case ComputedJump:
+            break;
+        case NotCompiled:
+            compiled = false;
+            // Fx0A resumes at address + 2 once a key is pressed
+            if ((opcode & 0xF0FF) == 0xF00A) {
+                next.push_back(address + 2);
+            }
+            break;
+    }
+    return next;
+}
+
+void AotCompiler::discoverBlocks() {
+    vector<uint16_t> worklist;
+    worklist.push_back(INTERPRETER_SIZE);
+
+    while (!worklist.empty()) {
+        uint16_t start = worklist.back();
+        worklist.pop_back();
+
+        // Only the loaded ROM is compiled, anything else is interpreted
+        if (blocks.count(start) || start < INTERPRETER_SIZE || start + 1 >= INTERPRETER_SIZE + romSize) {
+            continue;
+        }
+
+        vector<uint16_t> instructions;
+        uint16_t address = start;
+        while (address + 1 < INTERPRETER_SIZE + romSize) {
+            uint16_t opcode = this->opcodeAt(address);
+            bool endsBlock;
+            bool compiled;
+            vector<uint16_t> next = this->successors(address, opcode, endsBlock, compiled);
+            worklist.insert(worklist.end(), next.begin(), next.end());
+            if (!compiled) {
+                break;
+            }
+
+            instructions.push_back(address);
+            codeBytes[address] = true;
+            codeBytes[address + 1] = true;
+            if (endsBlock) {
+                break;
+            }
+            address += 2;
+        }
+
+        if (!instructions.empty()) {
+            blocks[start] = instructions;
+        }
+    }
+}
+
+string AotCompiler::emitInstruction(uint16_t address, uint16_t opcode, int count) {
+    string x = "0x" + string(1, "0123456789ABCDEF"[(opcode & 0x0F00) >> 8]);
+    string y = "0x" + string(1, "0123456789ABCDEF"[(opcode & 0x00F0) >> 4]);
+    string kk = hexLiteral(opcode & 0x00FF, 2);
+    string nnn = hexLiteral(opcode & 0x0FFF, 3);
+    string next = hexLiteral(address + 2, 3);
+    string skip = hexLiteral(address + 4, 3);
+    string n = to_string(count);
+
+    string out = "    // " + hexLiteral(address, 3) + ": " + hexLiteral(opcode, 4) + "\n";
+    switch (classify(opcode)) {
+        case Interpreted:
+            return out + "    *c->pc = " + hexLiteral(address, 3) + ";\n"
+                + "    c->interpret(c->chip8);\n";
+        case Jump:
+            return out + "    *c->pc = " + nnn + ";\n    return " + n + ";\n";
+        case Call:
+            // Faults are left to the interpreter, which records them
+            return out + "    if (*c->sp >= 16) {\n"
+                + "        *c->pc = " + hexLiteral(address, 3) + ";\n"
+                + "        return " + to_string(count - 1) + ";\n"
+                + "    }\n"
+                + "    c->stack[(*c->sp)++ & 0xF] = " + hexLiteral(address, 3) + ";\n"
+                + "    *c->pc = " + nnn + ";\n    return " + n + ";\n";
+        case Return:
+            return out + "    if (*c->sp == 0) {\n"
+                + "        *c->pc = " + hexLiteral(address, 3) + ";\n"
+                + "        return " + to_string(count - 1) + ";\n"
+                + "    }\n"
+                + "    *c->pc = c->stack[--(*c->sp) & 0xF];\n"
+                + "    *c->pc += 2;\n    return " + n + ";\n";
+        case ComputedJump:
+            return out + "    *c->pc = " + nnn + " + V[0];\n    return " + n + ";\n";
+        case Skip:
+        {
+            string condition;
+            switch (opcode & 0xF000) {
+                case 0x3000: condition = "V[" + x + "] == " + kk; break;
+                case 0x4000: condition = "V[" + x + "] != " + kk; break;
+                case 0x5000: condition = "V[" + x + "] == V[" + y + "]"; break;
+                case 0x9000: condition = "V[" + x + "] != V[" + y + "]"; break;
+                default:
+                    condition = (opcode & 0x00FF) == 0x9E
+                        ? "c->keypad[V[" + x + "] & 0xF] == 1"
+                        : "c->keypad[V[" + x + "] & 0xF] == 0";
+            }
+            return out + "    *c->pc = " + condition + " ? " + skip + " : " + next + ";\n"
+                + "    return " + n + ";\n";
+        }
+        case NotCompiled:
+            return out;
+        case Straight:
+            break;
+    }
+
+    switch (opcode & 0xF000) {
+        case 0x6000:
+            return out + "    V[" + x + "] = " + kk + ";\n";
+        case 0x7000:
+            return out + "    V[" + x + "] += " + kk + ";\n";
+        case 0xA000:
+            return out + "    *c->I = " + nnn + ";\n";
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0: return out + "    V[" + x + "] = V[" + y + "];\n";
+                case 0x1: return out + "    V[" + x + "] |= V[" + y + "];\n";
+                case 0x2: return out + "    V[" + x + "] &= V[" + y + "];\n";
+                case 0x3: return out + "    V[" + x + "] ^= V[" + y + "];\n";
+                case 0x4:
+                    return out + "    V[0xF] = (V[" + x + "] + V[" + y + "]) > 0xFF ? 1 : 0;\n"
+                        + "    V[" + x + "] += V[" + y + "];\n";
+                case 0x5:
+                    return out + "    V[0xF] = V[" + x + "] > V[" + y + "] ? 1 : 0;\n"
+                        + "    V[" + x + "] -= V[" + y + "];\n";
+                case 0x6:
+                    return out + "    if (c->legacyShift) {\n"
+                        + "        V[0xF] = V[" + y + "] & 0x1;\n"
+                        + "        V[" + x + "] = V[" + y + "] >> 1;\n"
+                        + "    } else {\n"
+                        + "        V[0xF] = V[" + x + "] & 0x1;\n"
+                        + "        V[" + x + "] >>= 1;\n"
+                        + "    }\n";
+                case 0x7:
+                    return out + "    V[0xF] = V[" + y + "] > V[" + x + "] ? 1 : 0;\n"
+                        + "    V[" + x + "] = V[" + y + "] - V[" + x + "];\n";
+                case 0xE:
+                    return out + "    if (c->legacyShift) {\n"
+                        + "        V[0xF] = V[" + y + "] >> 7;\n"
+                        + "        V[" + x + "] = V[" + y + "] << 1;\n"
+                        + "    } else {\n"
+                        + "        V[0xF] = V[" + x + "] >> 7;\n"
+                        + "        V[" + x + "] <<= 1;\n"
+                        + "    }\n";
+            }
+            break;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x07: return out + "    V[" + x + "] = *c->delayTimer;\n";
+                case 0x15: return out + "    *c->delayTimer = V[" + x + "];\n";
+                case 0x18: return out + "    *c->soundTimer = V[" + x + "];\n";
+                case 0x1E: return out + "    *c->I += V[" + x + "];\n";
+                case 0x29: return out + "    *c->I = V[" + x + "] * 0x5;\n";
+                case 0x33:
+                    return out + "    {\n"
+                        + "        unsigned short vx = V[" + x + "];\n"
+                        + "        uint16_t i = *c->I;\n"
+                        + "        store(c, i, vx / 100);\n"
+                        + "        store(c, i + 1, (vx / 10) % 10);\n"
+                        + "        store(c, i + 2, vx % 10);\n"
+                        + "        if (recordStore(c, i, 3)) {\n"
+                        + "            *c->pc = " + next + ";\n"
+                        + "            c->invalidated = true;\n"
+                        + "            return " + n + ";\n"
+                        + "        }\n"
+                        + "    }\n";
+                case 0x55:
+                    return out + "    for (int i = 0; i <= " + x + "; i++) {\n"
+                        + "        store(c, *c->I + i, V[i]);\n"
+                        + "    }\n"
+                        + "    if (recordStore(c, *c->I, " + x + " + 1)) {\n"
+                        + "        *c->pc = " + next + ";\n"
+                        + "        c->invalidated = true;\n"
+                        + "        return " + n + ";\n"
+                        + "    }\n";
+                case 0x65:
+                    return out + "    for (int i = 0; i <= " + x + "; i++) {\n"
+                        + "        V[i] = load(c, *c->I + i);\n"
+                        + "    }\n";
+            }
+            break;
+    }
+    return out;
+}
+
+string AotCompiler::emitBlock(uint16_t start, const vector<uint16_t> &instructions) {
+    string out = "static int block_" + hexLiteral(start, 3) + "(Chip8AotContext *c) {\n";
+    out += "    uint8_t *V = c->V;\n";
+    out += "    (void) V;\n\n";
+
+    int count = 0;
+    bool terminated = false;
+    for (uint16_t address : instructions) {
+        uint16_t opcode = this->opcodeAt(address);
+        count++;
+        out += this->emitInstruction(address, opcode, count);
+        InstructionKind kind = classify(opcode);
+        terminated = kind != Straight && kind != Interpreted;
+    }
+    if (!terminated) {
+        // Fell off the end of the block into something left to the interpreter
+        out += "    *c->pc = " + hexLiteral(instructions.back() + 2, 3) + ";\n";
+        out += "    return " + to_string(count) + ";\n";
+    }
+    out += "}\n\n";
+    return out;
+}
+
+string AotCompiler::generate() {
+    string out;
+    out += "// Generated by chip8-aot, do not edit.\n";
+    out += "#include <stdint.h>\n\n";
+    out += "#include \"aot.h\"\n\n";
+
+    out += "extern \"C\" const uint32_t " CHIP8_AOT_ABI_SYMBOL " = " + to_string(CHIP8_AOT_ABI_VERSION) + ";\n";
+    char hashLiteral[32];
+    snprintf(hashLiteral, sizeof(hashLiteral), "0x%016llXULL", (unsigned long long) romHash);
+    out += "extern \"C\" const uint64_t " CHIP8_AOT_HASH_SYMBOL " = " + string(hashLiteral) + ";\n\n";
+
+    // One bit per memory byte holding compiled code
+    out += "static const uint8_t codeMap[" + to_string(MEMORY_SIZE / 8) + "] = {";
+    for (int i = 0; i < MEMORY_SIZE / 8; i++) {
+        uint8_t bits = 0;
+        for (int bit = 0; bit < 8; bit++) {
+            bits |= codeBytes[i * 8 + bit] << bit;
+        }
+        out += (i % 16 == 0 ? "\n    " : " ") + hexLiteral(bits, 2) + ",";
+    }
+    out += "\n};\n\n";
+
+    out += "static inline uint8_t load(Chip8AotContext *c, unsigned address) {\n";
+    out += "    return c->pages[(address >> 8) & 0xF][address & 0xFF];\n";
+    out += "}\n\n";
+    out += "static inline void store(Chip8AotContext *c, unsigned address, uint8_t value) {\n";
+    out += "    c->writablePage(c->chip8, (address >> 8) & 0xF)[address & 0xFF] = value;\n";
+    out += "}\n\n";
+
+    // Marks the stored pages dirty and reports whether the store hit code
+    out += "static bool recordStore(Chip8AotContext *c, unsigned address, unsigned length) {\n";
+    out += "    for (unsigned page = address >> 8; page <= (address + length - 1) >> 8; page++) {\n";
+    out += "        *c->dirtyPages |= 1 << (page & 0xF);\n";
+    out += "    }\n";
+    out += "    for (unsigned a = address; a < address + length; a++) {\n";
+    out += "        if ((codeMap[(a & 0xFFF) >> 3] >> (a & 7)) & 1) {\n";
+    out += "            return true;\n";
+    out += "        }\n";
+    out += "    }\n";
+    out += "    return false;\n";
+    out += "}\n\n";
+
+    for (auto &block : blocks) {
+        out += this->emitBlock(block.first, block.second);
+    }
+
+    out += "extern \"C\" int " CHIP8_AOT_RUN_SYMBOL "(Chip8AotContext *c, int budget) {\n";
+    out += "    int executed = 0;\n";
+    out += "    while (executed < budget) {\n";
+    out += "        int remaining = budget - executed;\n";
+    out += "        int n = 0;\n";
+    out += "        switch (*c->pc) {\n";
+    for (auto &block : blocks) {
+        out += "            case " + hexLiteral(block.first, 3) + ": if (remaining >= " + to_string(block.second.size())
+            + ") n = block_" + hexLiteral(block.first, 3) + "(c); break;\n";
+    }
+    out += "        }\n";
+    out += "        if (n > 0) {\n";
+    out += "            executed += n;\n";
+    out += "            if (c->invalidated) {\n";
+    out += "                return executed;\n";
+    out += "            }\n";
+    out += "            continue;\n";
+    out += "        }\n\n";
+    out += "        // Not statically resolved, or the block would overrun the budget\n";
+    out += "        uint16_t pc = *c->pc;\n";
+    out += "        uint16_t opcode = load(c, pc) << 8 | load(c, pc + 1);\n";
+    out += "        uint16_t I = *c->I;\n";
+    out += "        executed++;\n";
+    out += "        if (!c->interpret(c->chip8)) {\n";
+    out += "            return executed;\n";
+    out += "        }\n";
+    out += "        if (((opcode & 0xF0FF) == 0xF033 && recordStore(c, I, 3))\n";
+    out += "                || ((opcode & 0xF0FF) == 0xF055 && recordStore(c, I, ((opcode & 0x0F00) >> 8) + 1))) {\n";
+    out += "            c->invalidated = true;\n";
+    out += "            return executed;\n";
+    out += "        }\n";
+    out += "    }\n";
+    out += "    return executed;\n";
+    out += "}\n";
+    return out;
+}
@@ -0,0 +1,42 @@
+#ifndef AOT_COMPILER_H
+#define AOT_COMPILER_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+
+using namespace std;
+
+// Translates a ROM into C++ source with one function per basic block and a
+// dispatcher keyed on pc. The source implements the interface in aot.h and is
+// compiled into a shared library that Chip8::loadAot() picks up.
+class AotCompiler {
+private:
+    uint8_t memory[MEMORY_SIZE];
+    int romSize;
+    uint64_t romHash;
+
+    // Block start address -> addresses of the instructions in the block
+    map<uint16_t, vector<uint16_t>> blocks;
+    // Addresses covered by compiled instructions, stores to these invalidate
+    // the library
+    vector<bool> codeBytes;
+
+    uint16_t opcodeAt(uint16_t address);
+    void discoverBlocks();
+    vector<uint16_t> successors(uint16_t address, uint16_t opcode, bool &endsBlock, bool &compiled);
+
+    string emitBlock(uint16_t start, const vector<uint16_t> &instructions);
+    string emitInstruction(uint16_t address, uint16_t opcode, int count);
+
+public:
+    AotCompiler(const uint8_t *rom, int size);
+
+    int blockCount();
+    string generate();
+};
+
+#endif // AOT_COMPILER_H
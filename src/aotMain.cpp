@@ -0,0 +1,137 @@
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <sys/stat.h>
+
+#include "aotCompiler.h"
+#include "chip8.h"
+#include "constants.h"
+#include "hash.h"
+
+using namespace std;
+
+#ifndef CHIP8_AOT_INCLUDE_DIR
+#define CHIP8_AOT_INCLUDE_DIR "src"
+#endif
+
+
+void usage() {
+    cout << "Usage: ./chip8-aot <path/to/rom> <path/to/output.so>" << endl;
+    cout << "       ./chip8-aot <path/to/rom> <directory>   (named for chip8 --aot-dir)" << endl;
+    cout << "       ./chip8-aot --emit <path/to/rom> <path/to/output.cpp>" << endl;
+    cout << "       ./chip8-aot --verify <path/to/rom> <path/to/compiled.so> [frames]" << endl;
+}
+
+bool readRom(const char *romPath, vector<uint8_t> &rom) {
+    ifstream romFile(romPath, ios::in | ios::binary);
+    if (!romFile) {
+        cout << "Error reading ROM" << endl;
+        return false;
+    }
+    rom.assign(istreambuf_iterator<char>(romFile), istreambuf_iterator<char>());
+    if (rom.size() > (size_t) (MEMORY_SIZE - INTERPRETER_SIZE)) {
+        cout << "ROM too big!" << endl;
+        return false;
+    }
+    return true;
+}
+
+bool writeSource(const char *romPath, const string &sourcePath) {
+    vector<uint8_t> rom;
+    if (!readRom(romPath, rom)) {
+        return false;
+    }
+
+    AotCompiler compiler(rom.data(), rom.size());
+    ofstream source(sourcePath.c_str());
+    source << compiler.generate();
+    if (!source) {
+        cout << "Error writing " << sourcePath << endl;
+        return false;
+    }
+    cout << "Compiled " << compiler.blockCount() << " blocks into " << sourcePath << endl;
+    return true;
+}
+
+bool compile(const char *romPath, const char *outputPath) {
+    // A directory gets the name chip8 --aot-dir looks for
+    string libraryPath = outputPath;
+    struct stat info;
+    if (stat(outputPath, &info) == 0 && S_ISDIR(info.st_mode)) {
+        vector<uint8_t> rom;
+        if (!readRom(romPath, rom)) {
+            return false;
+        }
+        libraryPath += "/" + Chip8::aotLibraryName(fnv1a64(rom.data(), rom.size()));
+    }
+    string sourcePath = libraryPath + ".cpp";
+    if (!writeSource(romPath, sourcePath)) {
+        return false;
+    }
+
+    const char *cxx = getenv("CXX");
+    string command = string(cxx != nullptr ? cxx : "c++")
+        + " -std=c++11 -O2 -shared -fPIC -I\"" CHIP8_AOT_INCLUDE_DIR "\""
+        + " \"" + sourcePath + "\" -o \"" + libraryPath + "\"";
+    cout << command << endl;
+    if (system(command.c_str()) != 0) {
+        cout << "Compiler failed" << endl;
+        return false;
+    }
+    return true;
+}
+
+// Runs the ROM with and without the compiled library and compares the whole
+// machine state after every frame.
+bool verify(const char *romPath, const char *libraryPath, int frames) {
+    vector<uint64_t> expected;
+    Chip8 interpreted = Chip8();
+    if (!interpreted.load(romPath)) {
+        return false;
+    }
+    interpreted.seed(1);
+    for (int frame = 0; frame < frames; frame++) {
+        interpreted.runFrame();
+        expected.push_back(interpreted.stateHash());
+        if (interpreted.isFaulted()) {
+            cout << "Interpreter stopped at frame " << dec << frame << ": "
+                << interpreted.statusToString() << endl;
+            break;
+        }
+    }
+
+    Chip8 compiled = Chip8();
+    if (!compiled.load(romPath) || !compiled.loadAot(libraryPath)) {
+        return false;
+    }
+    compiled.seed(1);
+    for (size_t frame = 0; frame < expected.size(); frame++) {
+        compiled.runFrame();
+        if (compiled.stateHash() != expected[frame]) {
+            cout << "Mismatch at frame " << dec << frame << endl;
+            return false;
+        }
+    }
+
+    cout << "Compiled ROM matches the interpreter for " << dec << expected.size() << " frames" << endl;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 4 && strcmp(argv[1], "--emit") == 0) {
+        return writeSource(argv[2], argv[3]) ? 0 : 1;
+    }
+    if (argc >= 4 && strcmp(argv[1], "--verify") == 0) {
+        int frames = argc >= 5 ? atoi(argv[4]) : 600;
+        return verify(argv[2], argv[3], frames) ? 0 : 1;
+    }
+    if (argc == 3 && argv[1][0] != '-') {
+        return compile(argv[1], argv[2]) ? 0 : 1;
+    }
+
+    usage();
+    return 1;
+}
@@ -0,0 +1,45 @@
+#include "beeper.h"
+#include "constants.h"
+
+
+Beeper::Beeper(int sampleRate, int frequency) {
+    lastQueuedTone = false;
+    toneOn = false;
+    phase = 0;
+    // Phase is a 32-bit fraction of one wave period
+    phaseStep = (uint32_t) (((uint64_t) frequency << 32) / sampleRate);
+}
+
+void Beeper::setTone(bool on) {
+    if (on == lastQueuedTone) {
+        return;
+    }
+    // The audio thread drains the ring every few milliseconds, if it is ever
+    // full the change is retried on the next call.
+    if (toneChanges.push(on)) {
+        lastQueuedTone = on;
+    }
+}
+
+void Beeper::fill(int16_t *samples, int count) {
+    bool on;
+    while (toneChanges.pop(on)) {
+        toneOn = on;
+    }
+    this->generate(samples, count, toneOn);
+}
+
+void Beeper::generate(int16_t *samples, int count, bool on) {
+    if (!on) {
+        for (int i = 0; i < count; i++) {
+            samples[i] = 0;
+        }
+        // Restart the wave on the next beep so every beep sounds the same
+        phase = 0;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        samples[i] = phase < 0x80000000u ? BEEP_VOLUME : -BEEP_VOLUME;
+        phase += phaseStep;
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef BEEPER_H
+#define BEEPER_H
+
+#include <stdint.h>
+
+#include "spscRing.h"
+
+// Square wave tone generator for the sound timer. The emulation thread calls
+// setTone() whenever the tone may have changed, the audio thread calls fill()
+// for every buffer it needs. Headless runs skip the ring and call generate()
+// directly with the tone of each emulated frame.
+class Beeper {
+private:
+    SpscRing<bool, 64> toneChanges;
+
+    // Producer side
+    bool lastQueuedTone;
+
+    // Consumer side
+    bool toneOn;
+    uint32_t phase;
+    uint32_t phaseStep;
+
+public:
+    Beeper(int sampleRate, int frequency);
+
+    void setTone(bool on);
+    void fill(int16_t *samples, int count);
+    void generate(int16_t *samples, int count, bool on);
+};
+
+#endif // BEEPER_H
@@ -1,17 +1,95 @@
 #include <iostream>
-#include <fstream>
-#include <sys/stat.h>
 #include <chrono>
+#include <cstring>
+#include <ctime>
+#include <dlfcn.h>
+#include <sys/stat.h>
 
 #include "logger.h"
 #include "chip8.h"
 #include "constants.h"
+#include "hash.h"
+#include "executionBackend.h"
+#include "romCache.h"
 
 using namespace std;
 
 
 Logger* logger = Logger::getLogger();
 
+static const uint8_t FONTSET[80] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+// Superinstructions, each an idiom ROMs use all the time
+enum FusedKind {
+    FUSED_NONE = 0,
+    // Annn, Dxyn: point I at a sprite and draw it
+    FUSED_LOAD_DRAW,
+    // Fx29, Dxyn: point I at a digit and draw it
+    FUSED_DIGIT_DRAW,
+    // 6xkk, 6ykk: set up two registers
+    FUSED_SET_SET,
+    // 7xkk, 3ykk or 4ykk, 1nnn: step a loop counter and go round again
+    FUSED_ADD_SKIP_JUMP,
+};
+
+// Instructions in each kind of group, the most it can execute
+static const int FUSED_LENGTH[] = { 1, 2, 2, 2, 3 };
+
+// The group starting at each address of a memory image. Built by a peephole
+// pass over the image, and only used on pages a machine still shares with
+// it, so stores into code can never make a group run stale instructions.
+// Any address can start a group, so jumping or skipping into the middle of
+// one simply runs whatever group (or single instruction) starts there.
+struct FusionTable {
+    uint8_t kinds[MEMORY_SIZE];
+};
+
+static void buildFusionTable(const uint8_t *memory, FusionTable &table) {
+    memset(table.kinds, FUSED_NONE, sizeof(table.kinds));
+    for (int address = 0; address + 4 <= MEMORY_SIZE; address++) {
+        uint16_t first = memory[address] << 8 | memory[address + 1];
+        uint16_t second = memory[address + 2] << 8 | memory[address + 3];
+        if ((first & 0xF000) == 0xA000 && (second & 0xF000) == 0xD000) {
+            table.kinds[address] = FUSED_LOAD_DRAW;
+        } else if ((first & 0xF0FF) == 0xF029 && (second & 0xF000) == 0xD000) {
+            table.kinds[address] = FUSED_DIGIT_DRAW;
+        } else if ((first & 0xF000) == 0x6000 && (second & 0xF000) == 0x6000) {
+            table.kinds[address] = FUSED_SET_SET;
+        } else if ((first & 0xF000) == 0x7000
+                && ((second & 0xF000) == 0x3000 || (second & 0xF000) == 0x4000)
+                && address + 6 <= MEMORY_SIZE) {
+            uint16_t third = memory[address + 4] << 8 | memory[address + 5];
+            // A jump to itself halts, step() handles that
+            if ((third & 0xF000) == 0x1000 && (third & 0x0FFF) != address + 4) {
+                table.kinds[address] = FUSED_ADD_SKIP_JUMP;
+            }
+        }
+    }
+}
+
+// Each byte's share of a content hash. Zero bytes have none, so only what was
+// written ever needs hashing.
+static inline uint64_t contentKey(uint32_t position, uint8_t value) {
+    return value ? mix64((uint64_t) position << 8 | value) : 0;
+}
+
 
 void Chip8::init() {
     opcode = 0;
@@ -22,8 +100,10 @@ void Chip8::init() {
     pc = INTERPRETER_SIZE;
 
     registerAwaitingKeyPress = -1;
-    lastProcessorCycleMS = -1;
-    lastTimerCycleMS = -1;
+    status = CHIP8_OK;
+    // Memory may just have been replaced
+    contentHashed = false;
+    this->startQuota();
 
     this->clearDisplay();
     this->clearStack();
@@ -32,12 +112,28 @@ void Chip8::init() {
 
     this->copyFontset();
 
-    srand(time(NULL));
+    this->seed((uint32_t) time(NULL));
 
     logger->info("Chip8 Initialized!\n");
 }
 
+void Chip8::seed(uint32_t value) {
+    // Spread the seed's bits, xorshift32 must never be zero
+    value = (value ^ (value >> 16)) * 0x45d9f3b;
+    value = (value ^ (value >> 16)) * 0x45d9f3b;
+    value ^= value >> 16;
+    rngState = value != 0 ? value : 0x9E3779B9;
+}
+
+uint8_t Chip8::randomByte() {
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    return rngState >> 24;
+}
+
 void Chip8::handleKeyDown(int key) {
+    key &= 0xF;
     this->keypad[key] = 1;
     if (registerAwaitingKeyPress > -1) {
         V[registerAwaitingKeyPress] = key;
@@ -49,16 +145,28 @@ void Chip8::handleKeyDown(int key) {
 }
 
 void Chip8::handleKeyUp(int key) {
+    key &= 0xF;
     this->keypad[key] = 0;
     logger->debug("handleKeyUp: " + to_string(key) + "\n");
 }
 
-void Chip8::clearDisplay() {
-    for (int i = 0; i < (DISPLAY_WIDTH * DISPLAY_HEIGHT); i++) {
-        displayBuffer[i] = 0;
+void Chip8::setKeys(uint16_t mask) {
+    for (int key = 0; key < 16; key++) {
+        bool held = (mask >> key) & 1;
+        if (held && !keypad[key]) {
+            this->handleKeyDown(key);
+        } else if (!held && keypad[key]) {
+            this->handleKeyUp(key);
+        }
     }
 }
 
+void Chip8::clearDisplay() {
+    dirtyRows = 0xFFFFFFFF;
+    memset(displayBuffer, 0, sizeof(displayBuffer));
+    displayHash = 0;
+}
+
 void Chip8::clearStack() {
     for (int i = 0; i < 16; i++) {
         stack[i] = 0;
@@ -78,23 +186,27 @@ void Chip8::clearKeypad() {
 }
 
 void Chip8::copyFontset() {
+    // Loaded images already hold the font, writing it again would take a
+    // private copy of the page
     for (int i = 0; i < 80; ++i) {
-        memory[i] = chip8Fontset[i];
+        if (memory.read(i) != FONTSET[i]) {
+            this->markMemoryDirty(i, 1);
+            memory.write(i, FONTSET[i]);
+        }
     }
 }
 
 void Chip8::printDisplay() {
     logger->display("printDisplay\n");
-    string out = "";
+    // Live views should use TerminalRenderer, this is for debugging
+    string out((DISPLAY_WIDTH + 1) * DISPLAY_HEIGHT, ' ');
     for (int j = 0; j < DISPLAY_HEIGHT; j ++) {
         for (int i = 0; i < DISPLAY_WIDTH; i++) {
-            if (displayBuffer[i + (j * DISPLAY_WIDTH)] == 1) {
-                out += 'X';
-            } else {
-                out += " ";
+            if (displayPixel(displayBuffer, i, j)) {
+                out[j * (DISPLAY_WIDTH + 1) + i] = 'X';
             }
         }
-        out += "\n";
+        out[j * (DISPLAY_WIDTH + 1) + DISPLAY_WIDTH] = '\n';
     }
 
     logger->display(out);
@@ -137,79 +249,672 @@ bool Chip8::load(const char *romPath) {
 
     this->init();
 
-    // Get the file size in bytes
-    struct stat fileStat;
-    int romFileSize = 0;
-    if (stat(romPath, &fileStat) == 0) {
-        romFileSize = fileStat.st_size;
-        logger->info("ROM File size (bytes): " + to_string(romFileSize) + "\n");
-    } else {
-        cout << "Error running stat! (file probably doesn't exist)" << endl;
+    shared_ptr<const LoadedRom> rom = RomCache::instance().load(romPath);
+    if (rom == nullptr) {
         return false;
     }
+    logger->info("ROM File size (bytes): " + to_string(rom->bytes.size()) + "\n");
+    return this->loadRom(rom);
+}
 
-    if (romFileSize > (MEMORY_SIZE - INTERPRETER_SIZE)) {
-        cout << "ROM too big!" << endl;
+bool Chip8::loadMemory(const uint8_t *rom, size_t size) {
+    shared_ptr<const LoadedRom> loaded = RomCache::instance().get(rom, size);
+    if (loaded == nullptr) {
+        // Too big. Nothing from a previous ROM may leak into this one.
+        this->loadMemoryUncached(nullptr, 0);
         return false;
     }
+    return this->loadRom(loaded);
+}
 
-    // Read the file into a buffer
-    char romReadBuffer[romFileSize];
-    ifstream romFile(romPath, ios::in | ios::binary);
-    romFile.read(romReadBuffer, romFileSize);
-    if (!romFile) {
-        cout << "Error reading ROM" << endl;
-        return false;
+bool Chip8::loadMemoryUncached(const uint8_t *rom, size_t size) {
+    bool fits = size <= (size_t) (MEMORY_SIZE - INTERPRETER_SIZE);
+    // Only this machine and its copies will ever run it, so it isn't interned
+    shared_ptr<Chip8MemoryImage> image = make_shared<Chip8MemoryImage>();
+    buildImage(fits ? rom : nullptr, fits ? size : 0, *image);
+    memory.share(image);
+    loadedRom = nullptr;
+    dirtyPages = 0xFFFF;
+    this->init();
+
+    // A compiled library can't be matched without hashing the bytes
+    romHash = 0;
+    aotRun = nullptr;
+    return fits;
+}
+
+void Chip8::buildImage(const uint8_t *rom, size_t size, Chip8MemoryImage &image) {
+    memset(image.bytes, 0, sizeof(image.bytes));
+    memcpy(image.bytes, FONTSET, sizeof(FONTSET));
+    if (rom != nullptr) {
+        // The ROM goes right after where the interpreter would have lived
+        memcpy(image.bytes + INTERPRETER_SIZE, rom, size);
     }
-    romFile.close();
+}
 
-    // Copy the file into memory, starting right after where the interpreter
-    // would have lived
-    for (int i = 0; i < romFileSize; i++) {
-        memory[INTERPRETER_SIZE + i] = romReadBuffer[i];
+bool Chip8::loadRom(const shared_ptr<const LoadedRom> &rom) {
+    loadedRom = rom;
+    memory.share(rom->image);
+    dirtyPages = 0xFFFF;
+    this->init();
+
+    uint64_t previousRomHash = romHash;
+    romHash = rom->hash;
+    if (aotRun != nullptr && romHash != previousRomHash) {
+        logger->info("Compiled ROM library does not match new ROM, interpreting\n");
+        aotRun = nullptr;
     }
 
     logger->info("ROM loaded into memory!\n");
     return true;
 }
 
-void Chip8::cycle() {
-    // Fetch Opcode
-    // opcode is two bytes long and located at the program counter
-    // shift the first byte by 8 and OR it with the following byte
-    opcode = memory[pc] << 8 | memory[pc + 1];
-    // cout << "PC: " << pc << endl;
-    // cout << endl << "OPCODE: " << hex << opcode;
+void Chip8::markMemoryDirty(uint16_t address, int length) {
+    int first = address >> 8;
+    int last = (address + length - 1) >> 8;
+    for (int page = first; page <= last; page++) {
+        dirtyPages |= 1 << (page & 0xF);
+    }
+}
+
+void Chip8::saveState(Chip8Checkpoint &state) const {
+    memory.copyTo(state.memory);
+    memcpy(state.displayBuffer, displayBuffer, sizeof(displayBuffer));
+    memcpy(state.V, V, sizeof(V));
+    state.I = I;
+    memcpy(state.stack, stack, sizeof(stack));
+    state.sp = sp;
+    state.delayTimer = delayTimer;
+    state.soundTimer = soundTimer;
+    state.pc = pc;
+    state.registerAwaitingKeyPress = registerAwaitingKeyPress;
+    state.status = status;
+    state.rngState = rngState;
+    memcpy(state.keypad, keypad, sizeof(keypad));
+}
+
+void Chip8::loadState(const Chip8Checkpoint &state) {
+    for (int page = 0; page < MEMORY_PAGES; page++) {
+        memory.setPage(page, state.memory + page * MEMORY_PAGE_SIZE);
+    }
+    memcpy(displayBuffer, state.displayBuffer, sizeof(displayBuffer));
+    dirtyPages = 0xFFFF;
+    dirtyRows = 0xFFFFFFFF;
+    requiresRerender = true;
+    contentHashed = false;
+    this->restoreRegisters(state);
+    this->checkAotStillValid();
+}
+
+void Chip8::restoreRegisters(const Chip8Checkpoint &state) {
+    memcpy(V, state.V, sizeof(V));
+    I = state.I;
+    memcpy(stack, state.stack, sizeof(stack));
+    sp = state.sp;
+    delayTimer = state.delayTimer;
+    soundTimer = state.soundTimer;
+    pc = state.pc;
+    registerAwaitingKeyPress = state.registerAwaitingKeyPress;
+    status = state.status;
+    rngState = state.rngState;
+    memcpy(keypad, state.keypad, sizeof(keypad));
+}
+
+void Chip8::checkpoint() {
+    shared_ptr<Chip8Checkpoint> saved = make_shared<Chip8Checkpoint>();
+    this->saveState(*saved);
+    savedCheckpoint = saved;
+    dirtyPages = 0;
+    dirtyRows = 0;
+}
+
+bool Chip8::resetToCheckpoint() {
+    if (!savedCheckpoint) {
+        cout << "No checkpoint to reset to" << endl;
+        return false;
+    }
+    const Chip8Checkpoint &saved = *savedCheckpoint;
+
+    for (int page = 0; dirtyPages != 0; page++, dirtyPages >>= 1) {
+        if (dirtyPages & 1) {
+            // Goes back to the shared page when the run left it as loaded
+            memory.setPage(page, saved.memory + page * MEMORY_PAGE_SIZE);
+        }
+    }
+    if (dirtyRows != 0) {
+        requiresRerender = true;
+    }
+    for (int row = 0; dirtyRows != 0; row++, dirtyRows >>= 1) {
+        if (dirtyRows & 1) {
+            memcpy(displayBuffer + row * DISPLAY_ROW_BYTES, saved.displayBuffer + row * DISPLAY_ROW_BYTES, DISPLAY_ROW_BYTES);
+        }
+    }
+    contentHashed = false;
+    this->restoreRegisters(saved);
+    this->checkAotStillValid();
+    return true;
+}
+
+void Chip8::checkAotStillValid() {
+    if (aotRun == nullptr) {
+        return;
+    }
+    // The library was built from the ROM alone, so it still applies if every
+    // byte of the ROM is back where it was loaded
+    bool intact = loadedRom != nullptr;
+    for (size_t i = 0; intact && i < loadedRom->bytes.size(); i++) {
+        intact = memory.read(INTERPRETER_SIZE + i) == loadedRom->bytes[i];
+    }
+    if (!intact) {
+        logger->info("Restored memory no longer holds the compiled ROM, interpreting\n");
+        aotRun = nullptr;
+    }
+}
+
+bool Chip8::loadAot(const char *libraryPath) {
+    // The library stays loaded for the life of the process, copies of this
+    // Chip8 may still be running its code.
+    // dlopen() only searches the library path for names without a slash
+    string path = string(libraryPath);
+    if (path.find('/') == string::npos) {
+        path = "./" + path;
+    }
+    void *library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (library == nullptr) {
+        cout << "Error loading compiled ROM: " << dlerror() << endl;
+        return false;
+    }
 
-    long long now = std::chrono::time_point_cast<std::chrono::milliseconds>(std::chrono::system_clock::now()).time_since_epoch().count();
-    if (lastProcessorCycleMS < 0) {
-        lastProcessorCycleMS = now;
+    const uint32_t *abiVersion = (const uint32_t *) dlsym(library, CHIP8_AOT_ABI_SYMBOL);
+    const uint64_t *libraryRomHash = (const uint64_t *) dlsym(library, CHIP8_AOT_HASH_SYMBOL);
+    Chip8AotRunFn run = (Chip8AotRunFn) dlsym(library, CHIP8_AOT_RUN_SYMBOL);
+    if (abiVersion == nullptr || libraryRomHash == nullptr || run == nullptr) {
+        cout << "Compiled ROM is missing symbols: " << libraryPath << endl;
+        dlclose(library);
+        return false;
     }
-    if (lastTimerCycleMS < 0) {
-        lastTimerCycleMS = now;
+    if (*abiVersion != CHIP8_AOT_ABI_VERSION) {
+        cout << "Compiled ROM was built for a different emulator version" << endl;
+        dlclose(library);
+        return false;
+    }
+    if (*libraryRomHash != romHash) {
+        cout << "Compiled ROM does not match the loaded ROM, interpreting instead" << endl;
+        dlclose(library);
+        return false;
     }
-    // cout << lastProcessorCycleMS << " " << now << " " << ((now - lastProcessorCycleMS) * (60 / (float)1000)) << endl;
-    bool processOpcode = (now - lastProcessorCycleMS) > 1;
-    bool processTimers = (now - lastTimerCycleMS) > 16;
 
-    // Decode Opcode
-    if (processOpcode && registerAwaitingKeyPress < 0) {
-        lastProcessorCycleMS = now;
-        this->handleOpcode();
+    aotRun = run;
+    logger->info("Compiled ROM loaded: " + string(libraryPath) + "\n");
+    return true;
+}
+
+bool Chip8::loadAotFrom(const char *directory) {
+    string path = string(directory) + "/" + aotLibraryName(romHash);
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        logger->info("No compiled ROM at " + path + ", interpreting\n");
+        return true;
     }
+    return this->loadAot(path.c_str());
+}
 
-    // Update timers
-    if (processTimers) {
-        lastTimerCycleMS = now;
+string Chip8::aotLibraryName(uint64_t romHash) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.so", (unsigned long long) romHash);
+    return name;
+}
+
+bool Chip8::aotInterpret(void *chip8) {
+    Chip8 *self = (Chip8 *) chip8;
+    self->step();
+    return !self->isBlocked();
+}
 
-        if (delayTimer) {
-            logger->info("Delay timer decrement: " + to_string(delayTimer));
-            delayTimer--;
+uint8_t *Chip8::aotWritablePage(void *chip8, unsigned page) {
+    return ((Chip8 *) chip8)->memory.writablePage(page & 0xF);
+}
+
+uint64_t Chip8::stateHash() const {
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (int page = 0; page < MEMORY_PAGES; page++) {
+        hash = fnv1a64(memory.page(page), MEMORY_PAGE_SIZE, hash);
+    }
+    hash = fnv1a64(V, sizeof(V), hash);
+    hash = fnv1a64(&I, sizeof(I), hash);
+    hash = fnv1a64(stack, sizeof(stack), hash);
+    hash = fnv1a64(&sp, sizeof(sp), hash);
+    hash = fnv1a64(&pc, sizeof(pc), hash);
+    hash = fnv1a64(&delayTimer, sizeof(delayTimer), hash);
+    hash = fnv1a64(&soundTimer, sizeof(soundTimer), hash);
+    hash = fnv1a64(&registerAwaitingKeyPress, sizeof(registerAwaitingKeyPress), hash);
+    hash = fnv1a64(&status, sizeof(status), hash);
+    hash = fnv1a64(&rngState, sizeof(rngState), hash);
+    return fnv1a64(displayBuffer, sizeof(displayBuffer), hash);
+}
+
+void Chip8::hashContent() {
+    memoryHash = 0;
+    for (int address = 0; address < MEMORY_SIZE; address++) {
+        memoryHash ^= contentKey(address, memory.read(address));
+    }
+    displayHash = 0;
+    for (int i = 0; i < DISPLAY_BYTES; i++) {
+        displayHash ^= contentKey(MEMORY_SIZE + i, displayBuffer[i]);
+    }
+    contentHashed = true;
+}
+
+void Chip8::writeMemory(uint16_t address, uint8_t value) {
+    if (contentHashed) {
+        uint16_t at = address & (MEMORY_SIZE - 1);
+        memoryHash ^= contentKey(at, memory.read(at)) ^ contentKey(at, value);
+    }
+    memory.write(address, value);
+}
+
+uint64_t Chip8::explorationHash() {
+    if (!contentHashed) {
+        this->hashContent();
+    }
+    uint64_t hash = fnv1a64(V, sizeof(V), memoryHash ^ displayHash);
+    hash = fnv1a64(&I, sizeof(I), hash);
+    hash = fnv1a64(stack, sizeof(stack), hash);
+    hash = fnv1a64(&sp, sizeof(sp), hash);
+    hash = fnv1a64(&pc, sizeof(pc), hash);
+    hash = fnv1a64(&delayTimer, sizeof(delayTimer), hash);
+    hash = fnv1a64(&soundTimer, sizeof(soundTimer), hash);
+    hash = fnv1a64(&registerAwaitingKeyPress, sizeof(registerAwaitingKeyPress), hash);
+    hash = fnv1a64(&status, sizeof(status), hash);
+    return fnv1a64(&rngState, sizeof(rngState), hash);
+}
+
+uint64_t Chip8::displayContentHash() {
+    if (!contentHashed) {
+        this->hashContent();
+    }
+    return displayHash;
+}
+
+// Cheap per-frame fingerprint of what's on screen, and optionally of the
+// registers, for regression checks.
+uint64_t Chip8::frameHash(bool includeRegisters) const {
+    uint64_t hash = fastHash64(displayBuffer, sizeof(displayBuffer));
+    if (includeRegisters) {
+        hash = fastHash64(V, sizeof(V), hash);
+        hash = fastHash64(stack, sizeof(stack), hash);
+        uint16_t registers[6] = { I, pc, sp, delayTimer, soundTimer, (uint16_t) registerAwaitingKeyPress };
+        hash = fastHash64(registers, sizeof(registers), hash);
+    }
+    return hash;
+}
+
+string Chip8::stateDifference(const Chip8 &other) const {
+    string out = "";
+    // Names are only built for fields that differ, but every byte is still
+    // read through the page table; sameState() is the quick check
+    auto compare = [&out](const char *name, int index, int mine, int theirs) {
+        if (mine != theirs) {
+            out += "  " + string(name) + (index >= 0 ? "[" + to_string(index) + "]" : "")
+                + ": " + to_string(mine) + " vs " + to_string(theirs) + "\n";
         }
-        if (soundTimer) {
-            soundTimer--;
+    };
+
+    compare("pc", -1, pc, other.pc);
+    compare("I", -1, I, other.I);
+    compare("sp", -1, sp, other.sp);
+    compare("delayTimer", -1, delayTimer, other.delayTimer);
+    compare("soundTimer", -1, soundTimer, other.soundTimer);
+    compare("registerAwaitingKeyPress", -1, registerAwaitingKeyPress, other.registerAwaitingKeyPress);
+    compare("status", -1, status, other.status);
+    compare("rngState", -1, rngState, other.rngState);
+    for (int i = 0; i < 16; i++) {
+        compare("V", i, V[i], other.V[i]);
+        compare("stack", i, stack[i], other.stack[i]);
+        compare("keypad", i, keypad[i], other.keypad[i]);
+    }
+    // Only the first differing byte of the big buffers
+    for (int i = 0; i < MEMORY_SIZE; i++) {
+        if (memory.read(i) != other.memory.read(i)) {
+            compare("memory", i, memory.read(i), other.memory.read(i));
+            break;
+        }
+    }
+    for (int i = 0; i < DISPLAY_BYTES; i++) {
+        if (displayBuffer[i] != other.displayBuffer[i]) {
+            compare("displayBuffer", i, displayBuffer[i], other.displayBuffer[i]);
+            break;
         }
     }
+    return out;
+}
+
+bool Chip8::sameState(const Chip8 &other) const {
+    return pc == other.pc && I == other.I && sp == other.sp
+        && delayTimer == other.delayTimer && soundTimer == other.soundTimer
+        && registerAwaitingKeyPress == other.registerAwaitingKeyPress
+        && status == other.status && rngState == other.rngState
+        && memcmp(V, other.V, sizeof(V)) == 0
+        && memcmp(stack, other.stack, sizeof(stack)) == 0
+        && memcmp(keypad, other.keypad, sizeof(keypad)) == 0
+        && memcmp(displayBuffer, other.displayBuffer, sizeof(displayBuffer)) == 0
+        && memory.sameContents(other.memory);
+}
+
+void Chip8::packDisplay(uint8_t *out) const {
+    memcpy(out, displayBuffer, sizeof(displayBuffer));
+}
+
+string Chip8::statusToString() const {
+    const char *reason;
+    switch (status) {
+        case CHIP8_OK:
+            return "";
+        case CHIP8_HALTED:
+            reason = "halted";
+            break;
+        case CHIP8_INVALID_OPCODE:
+            reason = "invalid opcode";
+            break;
+        case CHIP8_STACK_OVERFLOW:
+            reason = "stack overflow";
+            break;
+        case CHIP8_STACK_UNDERFLOW:
+            reason = "stack underflow";
+            break;
+        case CHIP8_INSTRUCTION_LIMIT:
+            reason = "instruction limit";
+            break;
+        case CHIP8_FRAME_LIMIT:
+            reason = "frame limit";
+            break;
+        case CHIP8_DEADLINE:
+            reason = "deadline";
+            break;
+        case CHIP8_STUCK_WAITING_FOR_KEY:
+            reason = "stuck waiting for a key";
+            break;
+        case CHIP8_STUCK:
+            reason = "stuck in a loop";
+            break;
+        default:
+            reason = "pc out of bounds";
+            break;
+    }
+    char out[64];
+    if (status >= CHIP8_OUT_OF_BOUNDS) {
+        // Never fetched an opcode, or stopped between instructions
+        snprintf(out, sizeof(out), "%s at 0x%03X", reason, pc);
+    } else {
+        snprintf(out, sizeof(out), "%s 0x%04X at 0x%03X", reason, opcode, pc);
+    }
+    return out;
+}
+
+void Chip8::halt(Chip8Status reason) {
+    status = reason;
+    logger->info("Stopped: " + this->statusToString() + "\n");
+}
+
+void Chip8::step() {
+    if (this->isBlocked()) {
+        return;
+    }
+    // The last instruction would straddle the end of memory
+    if (pc > MEMORY_SIZE - 2) {
+        this->halt(CHIP8_OUT_OF_BOUNDS);
+        return;
+    }
+    opcode = memory.read(pc) << 8 | memory.read(pc + 1);
+    this->handleOpcode();
+}
+
+int Chip8::runInstructions(int count) {
+    if (this->isBlocked()) {
+        return 0;
+    }
+    if (instrumentedDispatch != nullptr) {
+        return instrumentedDispatch->run(*this, count);
+    }
+
+    if (aotRun != nullptr) {
+        Chip8AotContext context;
+        context.pages = memory.pageTable();
+        context.V = V;
+        context.I = &I;
+        context.stack = stack;
+        context.sp = &sp;
+        context.pc = &pc;
+        context.delayTimer = &delayTimer;
+        context.soundTimer = &soundTimer;
+        context.keypad = keypad;
+        context.legacyShift = legacyShift;
+        context.dirtyPages = &dirtyPages;
+        context.invalidated = false;
+        context.chip8 = this;
+        context.interpret = &Chip8::aotInterpret;
+        context.writablePage = &Chip8::aotWritablePage;
+
+        int executed = aotRun(&context, count);
+        // Compiled code writes memory behind our back
+        contentHashed = false;
+        if (context.invalidated) {
+            // Self-modifying code, the compiled blocks no longer describe memory
+            logger->info("Compiled ROM invalidated by a store to code, interpreting\n");
+            aotRun = nullptr;
+            return executed + this->runInstructions(count - executed);
+        }
+        // Anything the library drew went through handleOpcode(), which already
+        // flagged requiresRerender.
+        return executed;
+    }
+
+    if (fusion) {
+        return this->runFused(count);
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (this->isBlocked()) {
+            return i;
+        }
+        this->step();
+    }
+    return count;
+}
+
+const FusionTable *Chip8::findFusionTable() {
+    const shared_ptr<const Chip8MemoryImage> &image = memory.sharedImage();
+    if (image == fusionImage) {
+        return fusionTable.get();
+    }
+    // Held on to, so a later image can't turn up at the same address
+    fusionImage = image;
+    fusionTable = nullptr;
+    if (image == nullptr) {
+        return nullptr;
+    }
+
+    RomArtifactBuilder build = [](const LoadedRom &rom, size_t &bytes) {
+        shared_ptr<FusionTable> table = make_shared<FusionTable>();
+        buildFusionTable(rom.image->bytes, *table);
+        bytes = sizeof(FusionTable);
+        return shared_ptr<const void>(table);
+    };
+    if (loadedRom != nullptr && loadedRom->image == image) {
+        // Every machine running the ROM shares one
+        fusionTable = static_pointer_cast<const FusionTable>(loadedRom->artifact("fusion", build));
+    } else {
+        shared_ptr<FusionTable> table = make_shared<FusionTable>();
+        buildFusionTable(image->bytes, *table);
+        fusionTable = table;
+    }
+    return fusionTable.get();
+}
+
+// The interpreter loop, running a whole group of instructions per dispatch
+// where the table has one. Groups never fault, wait for a key or write
+// memory, so nothing can stop the machine part way through one.
+int Chip8::runFused(int count) {
+    const FusionTable *table = this->findFusionTable();
+    int i = 0;
+    while (i < count) {
+        if (this->isBlocked()) {
+            return i;
+        }
+        int kind = table != nullptr && pc < MEMORY_SIZE ? table->kinds[pc] : (int) FUSED_NONE;
+        int length = FUSED_LENGTH[kind];
+        if (kind == FUSED_NONE || count - i < length || !memory.isShared(pc >> 8)
+                || !memory.isShared(((pc + 2 * length - 1) >> 8) & 0xF)) {
+            this->step();
+            i++;
+            continue;
+        }
+
+        uint16_t first = memory.read(pc) << 8 | memory.read(pc + 1);
+        uint16_t second = memory.read(pc + 2) << 8 | memory.read(pc + 3);
+        switch (kind) {
+            case FUSED_LOAD_DRAW:
+            case FUSED_DIGIT_DRAW:
+                I = kind == FUSED_LOAD_DRAW ? first & 0x0FFF : V[(first & 0x0F00) >> 8] * 0x5;
+                this->drawSprite(V[(second & 0x0F00) >> 8], V[(second & 0x00F0) >> 4], second & 0x000F);
+                opcode = second;
+                pc += 4;
+                i += 2;
+                break;
+            case FUSED_SET_SET:
+                V[(first & 0x0F00) >> 8] = first & 0x00FF;
+                V[(second & 0x0F00) >> 8] = second & 0x00FF;
+                opcode = second;
+                pc += 4;
+                i += 2;
+                break;
+            default:
+            {
+                V[(first & 0x0F00) >> 8] += first & 0x00FF;
+                bool equal = V[(second & 0x0F00) >> 8] == (second & 0x00FF);
+                if (equal == ((second & 0xF000) == 0x3000)) {
+                    // Skips the jump, out of the loop
+                    opcode = second;
+                    pc += 6;
+                    i += 2;
+                } else {
+                    opcode = memory.read(pc + 4) << 8 | memory.read(pc + 5);
+                    pc = opcode & 0x0FFF;
+                    i += 3;
+                }
+                break;
+            }
+        }
+    }
+    return count;
+}
+
+void Chip8::tickTimers() {
+    if (delayTimer) {
+        logger->info("Delay timer decrement: " + to_string(delayTimer));
+        delayTimer--;
+    }
+    if (soundTimer) {
+        soundTimer--;
+    }
+}
+
+void Chip8::runFrame() {
+    if (hasQuota) {
+        this->runQuotaFrame();
+        return;
+    }
+    this->runInstructions(INSTRUCTIONS_PER_FRAME);
+    this->tickTimers();
+}
+
+void Chip8::setQuota(const Chip8Quota &_quota) {
+    quota = _quota;
+    hasQuota = quota.maxInstructions > 0 || quota.maxFrames > 0 || quota.deadlineMS > 0 || quota.stuckFrames > 0;
+    this->startQuota();
+}
+
+void Chip8::startQuota() {
+    usedInstructions = 0;
+    usedFrames = 0;
+    cyclingFrames = 0;
+    if (quota.deadlineMS > 0) {
+        deadlineNs = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count()
+            + (int64_t) quota.deadlineMS * 1000000;
+    }
+}
+
+void Chip8::runQuotaFrame() {
+    int count = INSTRUCTIONS_PER_FRAME;
+    if (quota.maxInstructions > 0 && quota.maxInstructions - usedInstructions < (uint64_t) count) {
+        // Stops on the exact instruction
+        count = quota.maxInstructions - usedInstructions;
+    }
+    usedInstructions += this->runInstructions(count);
+    this->tickTimers();
+    usedFrames++;
+    if (status != CHIP8_OK) {
+        return;
+    }
+
+    if (quota.maxInstructions > 0 && usedInstructions >= quota.maxInstructions) {
+        this->halt(CHIP8_INSTRUCTION_LIMIT);
+    } else if (quota.maxFrames > 0 && usedFrames >= quota.maxFrames) {
+        this->halt(CHIP8_FRAME_LIMIT);
+    } else if (quota.deadlineMS > 0
+            && chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count() >= deadlineNs) {
+        this->halt(CHIP8_DEADLINE);
+    } else if (quota.stuckFrames > 0) {
+        // Incremental after the first frame, so a few dozen bytes of hashing
+        uint64_t hash = fnv1a64(keypad, sizeof(keypad), this->explorationHash());
+        bool repeated = false;
+        int recent = (int) min<uint64_t>(usedFrames - 1, STUCK_CYCLE_FRAMES);
+        for (int i = 0; i < recent && !repeated; i++) {
+            repeated = recentFrameHashes[i] == hash;
+        }
+        recentFrameHashes[(usedFrames - 1) % STUCK_CYCLE_FRAMES] = hash;
+        cyclingFrames = repeated ? cyclingFrames + 1 : 0;
+        if (cyclingFrames >= quota.stuckFrames) {
+            this->halt(registerAwaitingKeyPress >= 0 ? CHIP8_STUCK_WAITING_FOR_KEY : CHIP8_STUCK);
+        }
+    }
+}
+
+void Chip8::drawSprite(int xStart, int yStart, int height) {
+    // If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
+    V[0xF] = 0;
+
+    for (int y = 0; y < height; y++) {
+        // The interpreter reads n bytes from memory, starting at the address stored in I
+        uint8_t val = memory.read(I + y);
+        if (val == 0) {
+            continue;
+        }
+        // Pixels run on as one bit string, so a sprite crossing the
+        // right edge carries on at the start of the next row
+        unsigned pos = xStart + (yStart + y) * DISPLAY_WIDTH;
+        unsigned first = (pos / 8) % DISPLAY_BYTES;
+        unsigned second = (first + 1) % DISPLAY_BYTES;
+        uint8_t high = val >> (pos % 8);
+        uint8_t low = val << (8 - pos % 8);
+        if ((displayBuffer[first] & high) || (displayBuffer[second] & low)) {
+            // If this causes any pixels to be erased, VF is set to 1
+            V[0xF] = 1;
+        }
+
+        if (contentHashed) {
+            displayHash ^= contentKey(MEMORY_SIZE + first, displayBuffer[first])
+                ^ contentKey(MEMORY_SIZE + first, displayBuffer[first] ^ high)
+                ^ contentKey(MEMORY_SIZE + second, displayBuffer[second])
+                ^ contentKey(MEMORY_SIZE + second, displayBuffer[second] ^ low);
+        }
+        // Sprites are XORed onto the existing screen
+        displayBuffer[first] ^= high;
+        displayBuffer[second] ^= low;
+        dirtyRows |= (high ? 1u << (first / DISPLAY_ROW_BYTES) : 0)
+            | (low ? 1u << (second / DISPLAY_ROW_BYTES) : 0);
+    }
+    requiresRerender = true;
 }
 
 void Chip8::handleOpcode() {
@@ -227,7 +932,11 @@ void Chip8::handleOpcode() {
                     // 00EE - RET
                     // Return from a subroutine.
                     logger->debug(" -- 00EE Return from subroutine\n");
-                    pc = stack[--sp];
+                    if (sp == 0) {
+                        this->halt(CHIP8_STACK_UNDERFLOW);
+                        break;
+                    }
+                    pc = stack[--sp & 0xF];
                     logger->debug("  Removed from stack: " + to_string(pc) + "\n");
                     pc += 2;
                     break;
@@ -246,26 +955,35 @@ void Chip8::handleOpcode() {
                         // case 0x00F:
                             // 00FF - HIGH (super chip-49)
                         default:
-                            cout << "Unhandled " << hex << opcode << "\n";
-                            throw 1;
+                            this->halt(CHIP8_INVALID_OPCODE);
+                            break;
                     }
                     break;
                 default:
                     // 0nnn - SYS addr (unnecessary, I think?)
-                    cout << "Unhandled 0nnn instruction";
-                    throw "Unhandled 0nnn instruction";
+                    this->halt(CHIP8_INVALID_OPCODE);
+                    break;
             }
             break;
         case 0x1000:
             // 1nnn - JP addr
             // Jump to location nnn.
+            if ((opcode & 0x0FFF) == pc) {
+                // Nothing can ever move pc again
+                this->halt(CHIP8_HALTED);
+                break;
+            }
             pc = opcode & 0x0FFF;
             logger->debug(" -- 1nnn Jump to location: " + to_string(pc) + "\n");
             break;
         case 0x2000:
             // 2nnn - CALL addr
             // Call subroutine at nnn.
-            stack[sp++] = pc;
+            if (sp >= 16) {
+                this->halt(CHIP8_STACK_OVERFLOW);
+                break;
+            }
+            stack[sp++ & 0xF] = pc;
             logger->debug(" -- 2nnn Add to stack: " + to_string(pc) + "\n");
             // this->printStack();
             pc = opcode & 0x0FFF;
@@ -390,8 +1108,8 @@ void Chip8::handleOpcode() {
                     pc += 2;
                     break;
                 default:
-                    cout << "Unhandled " << hex << opcode << "\n";
-                    throw 1;
+                    this->halt(CHIP8_INVALID_OPCODE);
+                    break;
             }
             break;
         case 0x9000:
@@ -417,7 +1135,7 @@ void Chip8::handleOpcode() {
             // Cxkk - RND Vx, byte
             // Set Vx = random byte AND kk.
             logger->debug(" -- Cxkk\n");
-            V[(opcode & 0x0F00) >> 8] = (rand() % 256) & (opcode & 0x00FF);
+            V[(opcode & 0x0F00) >> 8] = this->randomByte() & (opcode & 0x00FF);
             pc += 2;
             break;
         case 0xD000:
@@ -425,32 +1143,7 @@ void Chip8::handleOpcode() {
             // Dxyn - DRW Vx, Vy, nibble
             // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
             logger->debug(" -- Dxyn\n");
-            unsigned short xStart = V[(opcode & 0x0F00) >> 8];
-            unsigned short yStart = V[(opcode & 0x00F0) >> 4];
-            unsigned short height = opcode & 0x000F;
-
-            // If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0.
-            V[0xF] = 0;
-
-            unsigned short pos;
-            unsigned short val;
-            for (int y = 0; y < height; y++) {
-                // The interpreter reads n bytes from memory, starting at the address stored in I
-                val = memory[I + y];
-                for (int x = 0; x < 8; x++) {
-                    if((val & (0x80 >> x)) != 0) {
-                        pos = (xStart + x + ((yStart + y) * DISPLAY_WIDTH));
-                        if (displayBuffer[pos] == 1) {
-                            // If this causes any pixels to be erased, VF is set to 1
-                            V[0xF] = 1;
-                        }
-
-                        // Sprites are XORed onto the existing screen
-                        displayBuffer[pos] ^= 1;
-                    }
-                }
-            }
-            requiresRerender = true;
+            this->drawSprite(V[(opcode & 0x0F00) >> 8], V[(opcode & 0x00F0) >> 4], opcode & 0x000F);
             pc += 2;
 
             // this->printDisplay();
@@ -466,7 +1159,7 @@ void Chip8::handleOpcode() {
                     logger->debug(" -- Ex9E\n");
                     // cout << "  Looking for : " << to_string(V[(opcode & 0x0F00) >> 8]) << endl;;
                     logger->debug(this->keypadToString());
-                    pc += keypad[V[(opcode & 0x0F00) >> 8]] == 1 ? 4 : 2;
+                    pc += keypad[V[(opcode & 0x0F00) >> 8] & 0xF] == 1 ? 4 : 2;
                     break;
                 }
                 case 0x00A1:
@@ -477,12 +1170,12 @@ void Chip8::handleOpcode() {
                     logger->debug(" -- ExA1\n");
                     logger->debug(this->keypadToString());
                     // cout << "  Looking for : " << to_string(V[(opcode & 0x0F00) >> 8]) << endl;;
-                    pc += keypad[V[(opcode & 0x0F00) >> 8]] == 0 ? 4 : 2;
+                    pc += keypad[V[(opcode & 0x0F00) >> 8] & 0xF] == 0 ? 4 : 2;
                     break;
                 }
                 default:
-                    cout << "Unhandled :( " << hex << opcode << "\n";
-                    throw 2;
+                    this->halt(CHIP8_INVALID_OPCODE);
+                    break;
             }
             break;
         case 0xF000:
@@ -544,12 +1237,13 @@ void Chip8::handleOpcode() {
                     {
                         logger->debug(" -- Fx33\n");
                         unsigned short vx = V[(opcode & 0x0F00) >> 8];
-                        memory[I] = vx / 100;
-                        memory[I + 1] = (vx / 10) % 10;
-                        memory[I + 2] = vx % 10;
+                        this->markMemoryDirty(I, 3);
+                        this->writeMemory(I, vx / 100);
+                        this->writeMemory(I + 1, (vx / 10) % 10);
+                        this->writeMemory(I + 2, vx % 10);
 
                         logger->debug("  VX: " + to_string(vx) + "\n");
-                        logger->debug("  Stored BCD: " + to_string(memory[I]) + " " + to_string(memory[I + 1]) + " " + to_string(memory[I + 2]) + "\n");
+                        logger->debug("  Stored BCD: " + to_string(memory.read(I)) + " " + to_string(memory.read(I + 1)) + " " + to_string(memory.read(I + 2)) + "\n");
                         pc += 2;
                         break;
                     }
@@ -559,8 +1253,9 @@ void Chip8::handleOpcode() {
                     {
                         logger->debug(" -- Fx55\n");
                         unsigned short endX = (opcode & 0x0F00) >> 8;
+                        this->markMemoryDirty(I, endX + 1);
                         for (int i = 0; i <= endX; i++) {
-                            memory[I + i] = V[i];
+                            this->writeMemory(I + i, V[i]);
                         }
                         pc += 2;
                         break;
@@ -572,7 +1267,7 @@ void Chip8::handleOpcode() {
                         logger->debug(" -- Fx65\n");
                         unsigned short endX = (opcode & 0x0F00) >> 8;
                         for (int i = 0; i <= endX; i++) {
-                            V[i] = memory[I + i];
+                            V[i] = memory.read(I + i);
                         }
                         pc += 2;
                         break;
@@ -583,8 +1278,8 @@ void Chip8::handleOpcode() {
                 // case 0x85: (super chip-48)
                     // Fx85 - LD Vx, R
                 default:
-                    cout << "Unhandled " << hex << opcode << "\n";
-                    throw "asdf";
+                    this->halt(CHIP8_INVALID_OPCODE);
+                    break;
             }
             break;
     }
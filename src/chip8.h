@@ -2,79 +2,272 @@
 #define CHIP_8_H
 
 #include <stdint.h>
+#include <memory>
+#include <string>
 
-using namespace std;
+#include "aot.h"
+#include "chip8Memory.h"
+#include "constants.h"
 
-class Chip8 {
-protected:
-    bool legacyShift = false;
-    uint16_t opcode;
+class ExecutionBackend;
+struct LoadedRom;
+struct FusionTable;
 
-    uint8_t memory[4096]; // "The Chip-8 language is capable of accessing up to 4KB (4,096 bytes) of RAM"
+// Why a machine stopped executing instructions. Anything but CHIP8_OK stays
+// until the machine is reset or loads a ROM or a state without it.
+enum Chip8Status {
+    CHIP8_OK = 0,
+    // Jumped to itself, nothing but the timers can change any more
+    CHIP8_HALTED,
+    CHIP8_INVALID_OPCODE,
+    CHIP8_STACK_OVERFLOW,
+    CHIP8_STACK_UNDERFLOW,
+    // pc ran off the end of memory
+    CHIP8_OUT_OF_BOUNDS,
+    // Ran out of a Chip8Quota
+    CHIP8_INSTRUCTION_LIMIT,
+    CHIP8_FRAME_LIMIT,
+    CHIP8_DEADLINE,
+    // Nothing changed for Chip8Quota::stuckFrames frames, waiting on Fx0A
+    // or going round the same loop
+    CHIP8_STUCK_WAITING_FOR_KEY,
+    CHIP8_STUCK,
+};
 
+// Limits for unattended runs, 0 for none. Checked at the end of each
+// runFrame(), so they cost nothing per instruction.
+struct Chip8Quota {
+    uint64_t maxInstructions = 0;
+    uint64_t maxFrames = 0;
+    // Host time from setQuota() or the next load
+    uint32_t deadlineMS = 0;
+    // Frames in a row that may end in a state seen in one of the last
+    // STUCK_CYCLE_FRAMES frames, keys included, before the machine counts
+    // as stuck: without new input it would go round that cycle forever.
+    int stuckFrames = 0;
+};
+
+// Everything checkpoint() saves and resetToCheckpoint() restores
+struct Chip8Checkpoint {
+    uint8_t memory[MEMORY_SIZE];
+    uint8_t displayBuffer[DISPLAY_BYTES];
+    uint8_t V[16];
+    uint16_t I;
+    uint16_t stack[16];
+    uint8_t sp;
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    uint16_t pc;
+    int registerAwaitingKeyPress;
+    Chip8Status status;
+    uint32_t rngState;
+    uint8_t keypad[16];
+};
+
+class Chip8 {
+    friend class Debugger;
+
+protected:
+    // What nearly every instruction touches comes first, so it shares a
+    // cache line instead of being spread between the big buffers.
     uint8_t V[16]; // "Chip-8 has 16 general purpose 8-bit registers"
+    uint16_t pc; // "The program counter (PC) should be 16-bit"
     uint16_t I; // "There is also a 16-bit register called I"
-
-    uint16_t stack[16]; // "The stack is an array of 16 16-bit values"
+    uint16_t opcode;
     uint8_t sp; // "The stack pointer (SP) can be 8-bit"
 
     // "Chip-8 also has two special purpose 8-bit registers".
     uint8_t delayTimer;
     uint8_t soundTimer;
 
-    uint16_t pc; // "The program counter (PC) should be 16-bit"
-
+    bool legacyShift = false;
     int registerAwaitingKeyPress;
+    Chip8Status status = CHIP8_OK;
+
+    // Per-instance xorshift32 state, so runs with the same seed repeat
+    // exactly no matter how many instances share the process.
+    uint32_t rngState;
+    uint8_t randomByte();
+
+    // One bit per 256-byte page of memory and per display row written since
+    // the last checkpoint, so a reset only copies back what a run touched.
+    uint16_t dirtyPages = 0xFFFF;
+    uint32_t dirtyRows = 0xFFFFFFFF;
+
+    uint16_t stack[16]; // "The stack is an array of 16 16-bit values"
+
+    // "The Chip-8 language is capable of accessing up to 4KB (4,096 bytes) of RAM".
+    // Font and ROM pages are shared with other machines running the same ROM.
+    Chip8Memory memory;
+
+    // Hash of the loaded ROM image, used to match ahead-of-time compiled
+    // libraries to the ROM they were built from.
+    uint64_t romHash = 0;
+    Chip8AotRunFn aotRun = nullptr;
+    // From the process-wide RomCache, null until a ROM loads
+    std::shared_ptr<const LoadedRom> loadedRom;
+
+    // Replaces runInstructions() while set, e.g. by an armed Debugger. Only
+    // checked once per batch, so the normal dispatch pays nothing for it.
+    ExecutionBackend* instrumentedDispatch = nullptr;
+
+    // Common instruction pairs and triples in the shared memory image, run
+    // as one dispatch by runFused()
+    bool fusion = true;
+    std::shared_ptr<const Chip8MemoryImage> fusionImage;
+    std::shared_ptr<const FusionTable> fusionTable;
+    const FusionTable *findFusionTable();
+    int runFused(int count);
+
+    static bool aotInterpret(void *chip8);
+    static uint8_t *aotWritablePage(void *chip8, unsigned page);
 
-    long long lastProcessorCycleMS;
-    long long lastTimerCycleMS;
+    // Shared by copies of this machine, it is never modified
+    std::shared_ptr<const Chip8Checkpoint> savedCheckpoint;
+
+    // Stops execution, pc stays on the instruction that caused it
+    void halt(Chip8Status reason);
+    // After memory is restored wholesale, drops a compiled library whose
+    // blocks no longer match the code in memory
+    void checkAotStillValid();
+
+    // Zobrist-style hashes of memory and the display for explorationHash().
+    // Built the first time they are asked for, then updated by each write
+    // until something replaces memory wholesale.
+    bool contentHashed = false;
+    uint64_t memoryHash;
+    uint64_t displayHash;
+    void hashContent();
+    void writeMemory(uint16_t address, uint8_t value);
+
+    Chip8Quota quota;
+    bool hasQuota = false;
+    uint64_t usedInstructions = 0;
+    uint64_t usedFrames = 0;
+    // steady_clock, in nanoseconds
+    int64_t deadlineNs = 0;
+    uint64_t recentFrameHashes[STUCK_CYCLE_FRAMES];
+    int cyclingFrames = 0;
+    void startQuota();
+    void runQuotaFrame();
+
+    void markMemoryDirty(uint16_t address, int length);
+    void restoreRegisters(const Chip8Checkpoint &state);
 
     void clearDisplay();
     void clearStack();
     void clearRegisters();
     void clearKeypad();
 
-    string registersToString();
+    std::string registersToString();
     void printDisplay();
     void printStack();
 
     void copyFontset();
 
-    unsigned char chip8Fontset[80] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-    };
-
     void handleOpcode();
+    void drawSprite(int x, int y, int height);
 
 public:
     bool requiresRerender;
 
-    uint8_t displayBuffer[64*32]; // "64x32-pixel monochrome display"
+    // "64x32-pixel monochrome display", one bit per pixel (see displayPixel())
+    uint8_t displayBuffer[DISPLAY_BYTES];
     uint8_t keypad[16]; // "16-key hexadecimal keypad"
 
     void init();
+    // Both go through RomCache, so a ROM any machine loaded before is shared
+    // rather than read again
     bool load(const char *romPath);
-    void cycle();
+    // Loads a ROM image already in memory
+    bool loadMemory(const uint8_t *rom, size_t size);
+    // Same, bypassing RomCache, for images run once and thrown away such as
+    // fuzz inputs. Not shared with other machines, and no AOT library.
+    bool loadMemoryUncached(const uint8_t *rom, size_t size);
+    bool loadRom(const std::shared_ptr<const LoadedRom> &rom);
+    const std::shared_ptr<const LoadedRom> &getLoadedRom() const { return loadedRom; }
+    // Font at 0, ROM at 0x200, zeros elsewhere. rom may be null.
+    static void buildImage(const uint8_t *rom, size_t size, Chip8MemoryImage &image);
+    void seed(uint32_t value);
+    // Deterministic execution, independent of wall-clock time
+    void step();
+    int runInstructions(int count);
+    void setInstrumentedDispatch(ExecutionBackend* dispatch) { instrumentedDispatch = dispatch; }
+    ExecutionBackend* getInstrumentedDispatch() const { return instrumentedDispatch; }
+    // On by default, off runs every instruction through step()
+    void setFusion(bool enabled) { fusion = enabled; }
+    void tickTimers();
+    void runFrame();
+    // Replaces any earlier quota and starts counting from here. A machine
+    // that runs out stops with the matching status. A quota also stops it
+    // on jump-to-self (CHIP8_HALTED), which otherwise only idles.
+    void setQuota(const Chip8Quota &_quota);
+    uint64_t getInstructionCount() const { return usedInstructions; }
+
+    // Cheap reset for running the same ROM many times: checkpoint() once, then
+    // resetToCheckpoint() restores only the memory pages and display rows
+    // dirtied since.
+    void checkpoint();
+    bool resetToCheckpoint();
+
+    // Full copies of the machine state, for save states
+    void saveState(Chip8Checkpoint &state) const;
+    void loadState(const Chip8Checkpoint &state);
+
+    bool loadAot(const char *libraryPath);
+    // Loads <directory>/<aotLibraryName()> if there is one, as written by
+    // `chip8-aot <rom> <directory>`. False only if it exists but can't be used.
+    bool loadAotFrom(const char *directory);
+    // File name of the compiled library for the ROM with this hash
+    static std::string aotLibraryName(uint64_t romHash);
+    uint64_t getRomHash() const { return romHash; }
+    uint64_t stateHash() const;
+    uint64_t frameHash(bool includeRegisters) const;
+    // Everything that decides what the machine does next, apart from the
+    // keypad. Costs a few dozen bytes of hashing once it has been asked for,
+    // and copies carry it along. Anything writing displayBuffer directly
+    // must call invalidateContentHash().
+    uint64_t explorationHash();
+    // Just the display, as incremental
+    uint64_t displayContentHash();
+    void invalidateContentHash() { contentHashed = false; }
+
+    // Describes the first differences from another machine, empty if the
+    // two are in the same state.
+    std::string stateDifference(const Chip8 &other) const;
+    // The same comparison without describing anything, cheap enough to run
+    // after every instruction
+    bool sameState(const Chip8 &other) const;
+
+    bool isSoundOn() const { return soundTimer > 0; }
+    uint8_t readMemory(uint16_t address) const { return memory.read(address); }
+    // Memory only this machine holds, the rest is shared
+    size_t privateMemoryBytes() const { return memory.privateBytes(); }
+    const uint8_t *getRegisters() const { return V; }
+    uint16_t getPc() const { return pc; }
+    uint16_t getI() const { return I; }
+    uint8_t getDelayTimer() const { return delayTimer; }
+    uint8_t getSoundTimer() const { return soundTimer; }
+    uint8_t getSp() const { return sp; }
+    const uint16_t *getStack() const { return stack; }
+    bool isAwaitingKeyPress() const { return registerAwaitingKeyPress >= 0; }
+    // Nothing runs until a key press, a reset or a load
+    bool isBlocked() const { return registerAwaitingKeyPress >= 0 || status != CHIP8_OK; }
+    Chip8Status getStatus() const { return status; }
+    bool isFaulted() const { return status > CHIP8_HALTED; }
+    // Faulted, out of quota, or halted under a quota: done for good
+    bool isFinished() const { return isFaulted() || (hasQuota && status == CHIP8_HALTED); }
+    // e.g. "invalid opcode 0x0123 at 0x2A4", empty while running
+    std::string statusToString() const;
+    // Copies displayBuffer, DISPLAY_BYTES
+    void packDisplay(uint8_t *out) const;
 
     void handleKeyDown(int key);
     void handleKeyUp(int key);
+    // Presses and releases keys to match a mask, bit k = key k held
+    void setKeys(uint16_t mask);
 
-    string keypadToString();
+    std::string keypadToString();
 
 };
 
@@ -0,0 +1,148 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <unistd.h>
+
+#include "chip8Headless.h"
+#include "constants.h"
+
+using namespace std;
+
+
+Chip8Headless::Chip8Headless(Chip8* _chip8) {
+    chip8 = _chip8;
+    beeper = nullptr;
+    wavWriter = nullptr;
+    frameCapture = nullptr;
+    inputScript = nullptr;
+    terminal = nullptr;
+    exporter = nullptr;
+    debugger = nullptr;
+}
+
+Chip8Headless::~Chip8Headless() {
+    delete wavWriter;
+    delete beeper;
+    delete frameCapture;
+    delete inputScript;
+    delete terminal;
+    delete exporter;
+}
+
+bool Chip8Headless::recordAudio(const char *wavPath) {
+    wavWriter = new WavWriter();
+    if (!wavWriter->open(wavPath, AUDIO_SAMPLE_RATE)) {
+        delete wavWriter;
+        wavWriter = nullptr;
+        return false;
+    }
+    beeper = new Beeper(AUDIO_SAMPLE_RATE, BEEP_FREQUENCY);
+    return true;
+}
+
+bool Chip8Headless::recordFrames(const char *capturePath, int scale) {
+    // Nothing runs in real time, so wait for the encoder instead of dropping
+    frameCapture = new FrameCapture(true);
+    if (!frameCapture->open(capturePath, scale)) {
+        delete frameCapture;
+        frameCapture = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool Chip8Headless::loadInputScript(const char *scriptPath) {
+    inputScript = new InputScript();
+    if (!inputScript->load(scriptPath)) {
+        delete inputScript;
+        inputScript = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool Chip8Headless::showInTerminal(const char *cellsName) {
+    TerminalCells cells;
+    if (!TerminalRenderer::parseCells(cellsName, cells)) {
+        cout << "Unknown terminal cells: " << cellsName << " (half or braille)" << endl;
+        return false;
+    }
+    terminal = new TerminalRenderer(STDOUT_FILENO, cells);
+    return true;
+}
+
+bool Chip8Headless::exportState(const char *shmName) {
+    exporter = new StateExporter();
+    if (!exporter->open(shmName)) {
+        delete exporter;
+        exporter = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Chip8Headless::attachDebugger(Debugger* _debugger) {
+    debugger = _debugger;
+}
+
+void Chip8Headless::run(int frames) {
+    int16_t samples[AUDIO_SAMPLES_PER_FRAME];
+    auto start = chrono::steady_clock::now();
+    // Everything printed so far has to reach the terminal first
+    cout.flush();
+
+    for (int frame = 0; frame < frames; frame++) {
+        if (inputScript != nullptr) {
+            inputScript->apply(chip8, frame);
+        }
+        chip8->runFrame();
+
+        if (wavWriter != nullptr) {
+            beeper->generate(samples, AUDIO_SAMPLES_PER_FRAME, chip8->isSoundOn());
+            wavWriter->write(samples, AUDIO_SAMPLES_PER_FRAME);
+        }
+        if (frameCapture != nullptr) {
+            frameCapture->capture(chip8->displayBuffer, frame);
+        }
+        if (exporter != nullptr) {
+            exporter->publish(chip8, frame + 1);
+        }
+        if (terminal != nullptr) {
+            if (chip8->requiresRerender || frame == 0) {
+                chip8->requiresRerender = false;
+                terminal->draw(chip8->displayBuffer);
+            }
+            this_thread::sleep_until(start + chrono::microseconds((int64_t) (frame + 1) * 1000000 / FRAMES_PER_SECOND));
+        }
+        if (debugger != nullptr && debugger->quitRequested()) {
+            frames = frame + 1;
+            break;
+        }
+        if (chip8->isFinished()) {
+            // Nothing more will happen, don't hold on to the core
+            frames = frame + 1;
+            break;
+        }
+    }
+    if (wavWriter != nullptr) {
+        wavWriter->close();
+    }
+    if (frameCapture != nullptr) {
+        frameCapture->close();
+    }
+    if (exporter != nullptr) {
+        exporter->close();
+    }
+    if (terminal != nullptr) {
+        terminal->close();
+        cout << "Terminal: " << terminal->byteCount() << " bytes in " << terminal->frameCount() << " draws" << endl;
+    }
+
+    if (chip8->isFinished()) {
+        cout << "Stopped: " << chip8->statusToString() << endl;
+    }
+    char hash[32];
+    snprintf(hash, sizeof(hash), "%016llx", (unsigned long long) chip8->stateHash());
+    cout << "Ran " << frames << " frames, state hash " << hash << endl;
+}
@@ -0,0 +1,48 @@
+#ifndef CHIP_8_HEADLESS_H
+#define CHIP_8_HEADLESS_H
+
+#include "beeper.h"
+#include "chip8.h"
+#include "debugger.h"
+#include "frameCapture.h"
+#include "inputScript.h"
+#include "stateExporter.h"
+#include "terminalRenderer.h"
+#include "wavWriter.h"
+
+// Runs a Chip8 without a window, one emulated frame after another as fast as
+// the host allows, or at 60Hz when shown in a terminal.
+class Chip8Headless {
+private:
+    Chip8* chip8;
+
+    // Audio is written in emulated time, one frame's worth of samples per
+    // emulated frame, so recordings line up with frame numbers.
+    Beeper* beeper;
+    WavWriter* wavWriter;
+
+    FrameCapture* frameCapture;
+    InputScript* inputScript;
+    TerminalRenderer* terminal;
+    StateExporter* exporter;
+    // Not owned
+    Debugger* debugger;
+
+public:
+    Chip8Headless(Chip8* _chip8);
+    ~Chip8Headless();
+
+    bool recordAudio(const char *wavPath);
+    bool recordFrames(const char *capturePath, int scale);
+    bool loadInputScript(const char *scriptPath);
+    // Draws the display on stdout as it changes, and runs in real time
+    // rather than as fast as possible so it can be watched
+    bool showInTerminal(const char *cellsName);
+    // Publishes every frame to shared memory for other processes
+    bool exportState(const char *shmName);
+    // Stops the run when the debugger console quits
+    void attachDebugger(Debugger* _debugger);
+    void run(int frames);
+};
+
+#endif // CHIP_8_HEADLESS_H
@@ -0,0 +1,171 @@
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+
+#include "chip8Memory.h"
+#include "hash.h"
+
+using namespace std;
+
+namespace {
+
+const uint8_t ZERO_PAGE[MEMORY_PAGE_SIZE] = {0};
+
+// Images by content, so separately loaded machines running the same ROM
+// share pages. Entries go when the last machine using them does.
+struct ImageCache {
+    mutex lock;
+    unordered_map<uint64_t, weak_ptr<const Chip8MemoryImage>> images;
+};
+
+// Never freed: machines in static storage may release images during exit
+ImageCache &imageCache() {
+    static ImageCache *cache = new ImageCache();
+    return *cache;
+}
+
+void releaseImage(uint64_t key, Chip8MemoryImage *image) {
+    ImageCache &cache = imageCache();
+    {
+        lock_guard<mutex> guard(cache.lock);
+        auto found = cache.images.find(key);
+        // Someone may have loaded the same bytes again in the meantime
+        if (found != cache.images.end() && found->second.expired()) {
+            cache.images.erase(found);
+        }
+    }
+    delete image;
+}
+
+}
+
+
+Chip8Memory::Chip8Memory() {
+    ownedPages = 0;
+    for (int page = 0; page < MEMORY_PAGES; page++) {
+        pages[page] = ZERO_PAGE;
+    }
+}
+
+Chip8Memory::Chip8Memory(const Chip8Memory &other) {
+    ownedPages = 0;
+    *this = other;
+}
+
+Chip8Memory &Chip8Memory::operator=(const Chip8Memory &other) {
+    if (this == &other) {
+        return *this;
+    }
+    this->releasePages();
+    image = other.image;
+    memcpy(pages, other.pages, sizeof(pages));
+    for (int page = 0; page < MEMORY_PAGES; page++) {
+        if (other.ownedPages & (1 << page)) {
+            // Point at the other machine's copy for a moment, then take our own
+            this->copyPage(page);
+        }
+    }
+    return *this;
+}
+
+Chip8Memory::~Chip8Memory() {
+    this->releasePages();
+}
+
+void Chip8Memory::releasePages() {
+    for (int page = 0; ownedPages != 0; page++, ownedPages >>= 1) {
+        if (ownedPages & 1) {
+            delete[] pages[page];
+            pages[page] = ZERO_PAGE;
+        }
+    }
+}
+
+uint8_t *Chip8Memory::copyPage(int page) {
+    uint8_t *copy = new uint8_t[MEMORY_PAGE_SIZE];
+    memcpy(copy, pages[page], MEMORY_PAGE_SIZE);
+    pages[page] = copy;
+    ownedPages |= 1 << page;
+    return copy;
+}
+
+shared_ptr<const Chip8MemoryImage> Chip8Memory::intern(const uint8_t *bytes) {
+    const size_t size = sizeof(Chip8MemoryImage);
+    uint64_t key = fastHash64(bytes, size);
+
+    // Both released only after the lock, dropping the last reference takes it
+    shared_ptr<const Chip8MemoryImage> found;
+    shared_ptr<const Chip8MemoryImage> collision;
+    ImageCache &cache = imageCache();
+    lock_guard<mutex> guard(cache.lock);
+    auto entry = cache.images.find(key);
+    if (entry != cache.images.end()) {
+        found = entry->second.lock();
+    }
+    if (found && memcmp(found->bytes, bytes, size) != 0) {
+        collision = found;
+        found = nullptr;
+    }
+    if (!found) {
+        Chip8MemoryImage *created = new Chip8MemoryImage();
+        memcpy(created->bytes, bytes, size);
+        found = shared_ptr<const Chip8MemoryImage>(created, [key](const Chip8MemoryImage *dying) {
+            releaseImage(key, (Chip8MemoryImage*) dying);
+        });
+        // The other image keeps the slot
+        if (!collision) {
+            cache.images[key] = found;
+        }
+    }
+    return found;
+}
+
+void Chip8Memory::share(const uint8_t *bytes) {
+    this->share(intern(bytes));
+}
+
+void Chip8Memory::share(const shared_ptr<const Chip8MemoryImage> &shared) {
+    // Dropped after the new pages are in, it may be the last reference
+    shared_ptr<const Chip8MemoryImage> previous = image;
+    this->releasePages();
+    image = shared;
+    for (int page = 0; page < MEMORY_PAGES; page++) {
+        pages[page] = image->bytes + page * MEMORY_PAGE_SIZE;
+    }
+}
+
+void Chip8Memory::setPage(int page, const uint8_t *bytes) {
+    const uint8_t *shared = image ? image->bytes + page * MEMORY_PAGE_SIZE : ZERO_PAGE;
+    if (memcmp(shared, bytes, MEMORY_PAGE_SIZE) != 0) {
+        memcpy(this->writablePage(page), bytes, MEMORY_PAGE_SIZE);
+        return;
+    }
+    if (ownedPages & (1 << page)) {
+        delete[] pages[page];
+        ownedPages &= ~(1 << page);
+    }
+    pages[page] = shared;
+}
+
+void Chip8Memory::copyTo(uint8_t *out) const {
+    for (int page = 0; page < MEMORY_PAGES; page++) {
+        memcpy(out + page * MEMORY_PAGE_SIZE, pages[page], MEMORY_PAGE_SIZE);
+    }
+}
+
+bool Chip8Memory::sameContents(const Chip8Memory &other) const {
+    for (int page = 0; page < MEMORY_PAGES; page++) {
+        if (pages[page] != other.pages[page] && memcmp(pages[page], other.pages[page], MEMORY_PAGE_SIZE) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int Chip8Memory::ownedPageCount() const {
+    return __builtin_popcount(ownedPages);
+}
+
+size_t Chip8Memory::privateBytes() const {
+    return (size_t) this->ownedPageCount() * MEMORY_PAGE_SIZE;
+}
@@ -0,0 +1,73 @@
+#ifndef CHIP_8_MEMORY_H
+#define CHIP_8_MEMORY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+
+const int MEMORY_PAGE_SIZE = 256;
+const int MEMORY_PAGES = 16;
+
+struct Chip8MemoryImage {
+    uint8_t bytes[MEMORY_PAGE_SIZE * MEMORY_PAGES];
+};
+
+// The 4KB address space as 16 pages of 256 bytes. Pages start out pointing
+// into a read-only image shared by every machine that loaded the same bytes,
+// and a machine only gets its own copy of a page the first time it writes to
+// it. Addresses wrap at 4KB.
+class Chip8Memory {
+private:
+    const uint8_t *pages[MEMORY_PAGES];
+    // Bit per page that points at this machine's own copy
+    uint16_t ownedPages;
+    std::shared_ptr<const Chip8MemoryImage> image;
+
+    void releasePages();
+    uint8_t *copyPage(int page);
+
+public:
+    // All zero
+    Chip8Memory();
+    Chip8Memory(const Chip8Memory &other);
+    Chip8Memory &operator=(const Chip8Memory &other);
+    ~Chip8Memory();
+
+    // The one image holding these 4KB of bytes, created if no machine has it
+    static std::shared_ptr<const Chip8MemoryImage> intern(const uint8_t *bytes);
+
+    // Replaces the whole address space with 4KB of bytes
+    void share(const uint8_t *bytes);
+    void share(const std::shared_ptr<const Chip8MemoryImage> &shared);
+
+    uint8_t read(uint16_t address) const {
+        return pages[(address >> 8) & 0xF][address & 0xFF];
+    }
+    void write(uint16_t address, uint8_t value) {
+        this->writablePage((address >> 8) & 0xF)[address & 0xFF] = value;
+    }
+    uint8_t *writablePage(int page) {
+        if (ownedPages & (1 << page)) {
+            return (uint8_t*) pages[page];
+        }
+        return this->copyPage(page);
+    }
+    const uint8_t *page(int page) const { return pages[page]; }
+    // Still the shared image's bytes, never written by this machine
+    bool isShared(int page) const { return !(ownedPages & (1 << page)); }
+    const std::shared_ptr<const Chip8MemoryImage> &sharedImage() const { return image; }
+    // Live page table, entries change when a page is copied
+    const uint8_t *const *pageTable() const { return pages; }
+
+    // Sets a page's contents, going back to the shared page if they match it
+    void setPage(int page, const uint8_t *bytes);
+    void copyTo(uint8_t *out) const;
+    // Pages both machines still share from one image aren't compared byte by byte
+    bool sameContents(const Chip8Memory &other) const;
+
+    int ownedPageCount() const;
+    // Bytes held by this machine alone, not counting shared images
+    size_t privateBytes() const;
+};
+
+#endif // CHIP_8_MEMORY_H
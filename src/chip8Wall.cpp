@@ -0,0 +1,289 @@
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <SDL2/SDL.h>
+
+#include "chip8Wall.h"
+#include "constants.h"
+#include "runtimeMetrics.h"
+
+using namespace std;
+
+
+// Smallest rectangle covering both, an empty one covers nothing
+static void growRect(SDL_Rect &rect, const SDL_Rect &other) {
+    if (rect.w == 0 || rect.h == 0) {
+        rect = other;
+        return;
+    }
+    int right = max(rect.x + rect.w, other.x + other.w);
+    int bottom = max(rect.y + rect.h, other.y + other.h);
+    rect.x = min(rect.x, other.x);
+    rect.y = min(rect.y, other.y);
+    rect.w = right - rect.x;
+    rect.h = bottom - rect.y;
+}
+
+
+Chip8Wall::Chip8Wall(const vector<Chip8*> &_machines, const char *title) {
+    if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_GAMECONTROLLER) < 0) {
+        cout << "SDL_Init failure: " << SDL_GetError() << endl;
+        exit(1);
+    }
+    cout << "SDL_Init success!\n";
+
+    machines = _machines;
+    inputMapper = new InputMapper();
+    // SDL scales the atlas up to the window
+    pixelExpander = new PixelExpander(1, PIXEL_COLOR | PIXEL_ALPHA, PIXEL_ALPHA);
+
+    // Tiles are twice as wide as they are tall, so a square grid gives a
+    // window the shape of a single display
+    int count = max((int) machines.size(), 1);
+    columns = (int) ceil(sqrt((double) count));
+    rows = (count + columns - 1) / columns;
+    atlasWidth = columns * (DISPLAY_WIDTH + WALL_GUTTER) - WALL_GUTTER;
+    atlasHeight = rows * (DISPLAY_HEIGHT + WALL_GUTTER) - WALL_GUTTER;
+    scale = max(1, min(WINDOW_WIDTH / atlasWidth, WINDOW_HEIGHT / atlasHeight));
+    atlasPixels.assign(atlasWidth * atlasHeight, WALL_GUTTER_COLOR);
+    shownDisplays.assign(machines.size() * DISPLAY_BYTES, 0);
+    faultReported.assign(machines.size(), false);
+    selected = -1;
+
+    presents = 0;
+    uploadedTiles = 0;
+    uploadedPixels = 0;
+    emulatedFrames = 0;
+    busyNs = 0;
+
+    // Every tile starts out blank
+    uint8_t blank[DISPLAY_BYTES] = {0};
+    for (size_t tile = 0; tile < machines.size(); tile++) {
+        SDL_Rect rect = this->tileRect(tile);
+        pixelExpander->expand(blank, &atlasPixels[rect.y * atlasWidth + rect.x], atlasWidth);
+    }
+
+    this->initWindow(title);
+}
+
+Chip8Wall::~Chip8Wall() {
+    if (atlas != nullptr) {
+        SDL_DestroyTexture(atlas);
+    }
+    delete inputMapper;
+    delete pixelExpander;
+    if (window != NULL) {
+        SDL_DestroyWindow(window);
+    }
+    SDL_Quit();
+}
+
+void Chip8Wall::initWindow(const char *title) {
+    window = SDL_CreateWindow(
+        title,
+        SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+        atlasWidth * scale,
+        atlasHeight * scale,
+        SDL_WINDOW_SHOWN);
+
+    if (window == NULL){
+        cout << "SDL_CreateWindow failure: " << SDL_GetError() << endl;
+        exit(2);
+    }
+    cout << "SDL_CreateWindow success!\n";
+
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    if (renderer == nullptr){
+        SDL_DestroyWindow(window);
+        cout << "SDL_CreateRenderer Error: " << SDL_GetError() << std::endl;
+        SDL_Quit();
+        exit(1);
+    }
+    cout << "SDL_CreateRenderer success!\n";
+
+    atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+        atlasWidth, atlasHeight);
+    if (atlas == nullptr) {
+        cout << "SDL_CreateTexture failure: " << SDL_GetError() << endl;
+        exit(1);
+    }
+}
+
+bool Chip8Wall::loadKeymap(const char *path) {
+    return inputMapper->loadConfig(path);
+}
+
+SDL_Rect Chip8Wall::tileRect(int tile) const {
+    SDL_Rect rect;
+    rect.x = (tile % columns) * (DISPLAY_WIDTH + WALL_GUTTER);
+    rect.y = (tile / columns) * (DISPLAY_HEIGHT + WALL_GUTTER);
+    rect.w = DISPLAY_WIDTH;
+    rect.h = DISPLAY_HEIGHT;
+    return rect;
+}
+
+bool Chip8Wall::updateTiles(SDL_Rect &dirty) {
+    bool changed = false;
+    uint8_t packed[DISPLAY_BYTES];
+    for (size_t tile = 0; tile < machines.size(); tile++) {
+        Chip8 *machine = machines[tile];
+        if (machine->isFaulted() && !faultReported[tile]) {
+            // The tile stays on the last frame
+            cout << "Instance " << tile << " stopped: " << machine->statusToString() << endl;
+            faultReported[tile] = true;
+        }
+        if (!machine->requiresRerender) {
+            continue;
+        }
+        machine->requiresRerender = false;
+        // Drawing the same sprite twice puts the screen back as it was
+        machine->packDisplay(packed);
+        uint8_t *shown = &shownDisplays[tile * DISPLAY_BYTES];
+        if (memcmp(packed, shown, DISPLAY_BYTES) == 0) {
+            continue;
+        }
+        memcpy(shown, packed, DISPLAY_BYTES);
+
+        SDL_Rect rect = this->tileRect(tile);
+        pixelExpander->expand(packed, &atlasPixels[rect.y * atlasWidth + rect.x], atlasWidth);
+        growRect(dirty, rect);
+        uploadedTiles++;
+        changed = true;
+    }
+    return changed;
+}
+
+void Chip8Wall::present(const SDL_Rect &dirty) {
+    if (dirty.w > 0 && dirty.h > 0) {
+        // One upload of the rows and columns the changed tiles span
+        SDL_UpdateTexture(atlas, &dirty, &atlasPixels[dirty.y * atlasWidth + dirty.x],
+            atlasWidth * sizeof(uint32_t));
+        uploadedPixels += dirty.w * dirty.h;
+    }
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, atlas, NULL, NULL);
+    if (selected >= 0) {
+        // Outlined in the gutter around the tile
+        SDL_Rect rect = this->tileRect(selected);
+        SDL_Rect outline = {
+            (rect.x - WALL_GUTTER) * scale, (rect.y - WALL_GUTTER) * scale,
+            (rect.w + 2 * WALL_GUTTER) * scale, (rect.h + 2 * WALL_GUTTER) * scale
+        };
+        SDL_SetRenderDrawColor(renderer, 0xFF, 0x40, 0x40, 0xFF);
+        SDL_RenderDrawRect(renderer, &outline);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
+    }
+    SDL_RenderPresent(renderer);
+    presents++;
+}
+
+void Chip8Wall::select(int tile) {
+    if (tile < -1 || tile >= (int) machines.size()) {
+        tile = -1;
+    }
+    selected = tile;
+    if (selected >= 0) {
+        cout << "Keys go to instance " << selected << endl;
+    } else {
+        cout << "Keys go to every instance" << endl;
+    }
+}
+
+void Chip8Wall::report() {
+    if (emulatedFrames == 0) {
+        return;
+    }
+    const double frameUs = 1e6 / FRAMES_PER_SECOND;
+    double busyUs = busyNs / 1e3 / emulatedFrames;
+    cout << "Wall of " << machines.size() << " instances: " << emulatedFrames << " frames, "
+        << presents << " presents, "
+        << (presents ? (double) uploadedTiles / presents : 0) << " tiles and "
+        << (presents ? uploadedPixels * sizeof(uint32_t) / 1024.0 / presents : 0) << "KB uploaded per present, "
+        << busyUs << "us emulating and drawing tiles per frame (" << 100 * busyUs / frameUs << "% of a frame)" << endl;
+}
+
+void Chip8Wall::run() {
+    SDL_Event e;
+
+    Uint32 startMS = SDL_GetTicks();
+    uint64_t frame = 0;
+    // Gutters and blank tiles go up with the first present
+    SDL_Rect dirty = { 0, 0, atlasWidth, atlasHeight };
+    bool redraw = true;
+
+    bool quit = false;
+    while (!quit) {
+        while (SDL_PollEvent(&e)){
+            if (e.type == SDL_QUIT){
+                quit = true;
+            }
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE) {
+                quit = true;
+            }
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_TAB) {
+                // Cycles through the tiles and back to all of them
+                this->select(selected + 1);
+                redraw = true;
+            }
+            if (e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) {
+                int x = e.button.x / scale;
+                int y = e.button.y / scale;
+                int tile = y / (DISPLAY_HEIGHT + WALL_GUTTER) * columns + x / (DISPLAY_WIDTH + WALL_GUTTER);
+                // Clicking the selected tile again goes back to all of them
+                this->select(tile == selected ? -1 : tile);
+                redraw = true;
+            }
+            inputMapper->handleDeviceEvent(e);
+
+            int key;
+            bool down;
+            if (inputMapper->translate(e, key, down)) {
+                for (size_t tile = 0; tile < machines.size(); tile++) {
+                    if (selected >= 0 && (int) tile != selected) {
+                        continue;
+                    }
+                    if (down) {
+                        machines[tile]->handleKeyDown(key);
+                    } else {
+                        machines[tile]->handleKeyUp(key);
+                    }
+                }
+            }
+        }
+
+        uint64_t target = (uint64_t) (SDL_GetTicks() - startMS) * FRAMES_PER_SECOND / 1000;
+        if (target - frame > MAX_CATCH_UP_FRAMES) {
+            // The host stalled, drop the lost time instead of racing to catch up
+            uint64_t dropped = target - frame - MAX_CATCH_UP_FRAMES;
+            startMS += dropped * 1000 / FRAMES_PER_SECOND;
+            target -= dropped;
+        }
+
+        uint64_t busyStart = RuntimeMetrics::nowNs();
+        for (; frame < target; frame++) {
+            for (Chip8 *machine : machines) {
+                machine->runFrame();
+            }
+            emulatedFrames++;
+        }
+        redraw = this->updateTiles(dirty) || redraw;
+        // Presenting waits for vsync, so it isn't counted
+        busyNs += RuntimeMetrics::nowNs() - busyStart;
+        if (redraw) {
+            this->present(dirty);
+            dirty.w = 0;
+            dirty.h = 0;
+            redraw = false;
+        }
+
+        // Nothing can change on screen before the next emulated frame
+        Uint32 nextFrameMS = startMS + (Uint32) ((frame + 1) * 1000 / FRAMES_PER_SECOND);
+        Uint32 now = SDL_GetTicks();
+        if (nextFrameMS > now) {
+            SDL_Delay(nextFrameMS - now);
+        }
+    }
+
+    this->report();
+}
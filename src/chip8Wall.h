@@ -0,0 +1,67 @@
+#ifndef CHIP_8_WALL_H
+#define CHIP_8_WALL_H
+
+#include <SDL2/SDL.h>
+#include <stdint.h>
+#include <vector>
+
+#include "chip8.h"
+#include "inputMapper.h"
+#include "pixelExpander.h"
+
+using namespace std;
+
+// One window showing many machines at once, laid out in a grid. Every
+// machine's display is a tile of a single streaming atlas texture; tiles are
+// only redrawn when their display changed, and each frame uploads just the
+// rectangle around the changed tiles in one call. Keys go to the selected
+// tile (click or Tab to pick one), or to every machine when none is.
+class Chip8Wall {
+private:
+    // Not owned
+    vector<Chip8*> machines;
+    SDL_Window* window;
+    SDL_Renderer* renderer;
+    SDL_Texture* atlas;
+
+    InputMapper* inputMapper;
+    PixelExpander* pixelExpander;
+
+    int columns;
+    int rows;
+    // Window pixels per atlas pixel
+    int scale;
+    int atlasWidth;
+    int atlasHeight;
+    vector<uint32_t> atlasPixels;
+    // What each tile shows now, DISPLAY_BYTES per machine
+    vector<uint8_t> shownDisplays;
+    vector<bool> faultReported;
+    // -1 when keys go to every machine
+    int selected;
+
+    uint64_t presents;
+    uint64_t uploadedTiles;
+    uint64_t uploadedPixels;
+    uint64_t emulatedFrames;
+    uint64_t busyNs;
+
+    void initWindow(const char *title);
+    SDL_Rect tileRect(int tile) const;
+    // Redraws the tiles whose display changed, true if any did. Grows
+    // dirty to cover them.
+    bool updateTiles(SDL_Rect &dirty);
+    void present(const SDL_Rect &dirty);
+    void select(int tile);
+    void report();
+
+public:
+    Chip8Wall(const vector<Chip8*> &_machines, const char *title);
+    ~Chip8Wall();
+
+    bool loadKeymap(const char *path);
+
+    void run();
+};
+
+#endif // CHIP_8_WALL_H
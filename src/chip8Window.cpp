@@ -1,12 +1,12 @@
 #include <iostream>
-#include <chrono>
-#include <unordered_map>
-#include <thread>
+#include <algorithm>
+#include <cstring>
 #include <SDL2/SDL.h>
 
 #include "chip8Window.h"
 #include "constants.h"
 #include "logger.h"
+#include "pixelExpander.h"
 
 
 using namespace std;
@@ -15,39 +15,43 @@ using namespace std;
 Logger* logger2 = Logger::getLogger();
 
 
-std::unordered_map<int, int> KEYMAP = {
-    { SDLK_1, 0 },
-    { SDLK_2, 1 },
-    { SDLK_3, 2 },
-    { SDLK_4, 3 },
-    { SDLK_q, 4 },
-    { SDLK_w, 5 },
-    { SDLK_e, 6 },
-    { SDLK_r, 7 },
-    { SDLK_a, 8 },
-    { SDLK_s, 9 },
-    { SDLK_d, 10 },
-    { SDLK_f, 11 },
-    { SDLK_z, 12 },
-    { SDLK_x, 13 },
-    { SDLK_c, 14 },
-    { SDLK_v, 15 }
-};
-
-
 Chip8Window::Chip8Window(Chip8* _chip8, const char *title, int width, int height) {
-    if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_AUDIO) < 0) {
+    if (SDL_Init(SDL_INIT_VIDEO|SDL_INIT_AUDIO|SDL_INIT_GAMECONTROLLER) < 0) {
         cout << "SDL_Init failure: " << SDL_GetError() << endl;
         exit(1);
     }
     cout << "SDL_Init success!\n";
 
     chip8 = _chip8;
+    inputMapper = new InputMapper();
+    latencyProbe = nullptr;
+    frameCapture = nullptr;
+    metrics = nullptr;
+    exporter = nullptr;
+    debugger = nullptr;
+    executedInstructions = 0;
+    runAheadFrames = 0;
+    runAheadPasses = 0;
+    runAheadTotalNs = 0;
+    runAheadMaxNs = 0;
+    speed = 1;
+    fastForwardSpeed = 0;
+    this->title = title;
 
     this->initWindow(title, width, height);
+    this->initAudio();
 }
 
 Chip8Window::~Chip8Window() {
+    if (audioDevice != 0) {
+        SDL_CloseAudioDevice(audioDevice);
+    }
+    delete beeper;
+    delete inputMapper;
+    delete latencyProbe;
+    delete frameCapture;
+    delete metrics;
+    delete exporter;
     if (window != NULL) {
         SDL_DestroyWindow(window);
     }
@@ -79,6 +83,171 @@ void Chip8Window::initWindow(const char *title, int width, int height) {
     cout << "SDL_CreateRenderer success!\n";
 }
 
+void Chip8Window::initAudio() {
+    beeper = new Beeper(AUDIO_SAMPLE_RATE, BEEP_FREQUENCY);
+
+    SDL_AudioSpec want;
+    SDL_AudioSpec have;
+    SDL_memset(&want, 0, sizeof(want));
+    want.freq = AUDIO_SAMPLE_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    // Small buffers keep the beep within 10ms of the sound timer
+    want.samples = AUDIO_BUFFER_SAMPLES;
+    want.callback = &Chip8Window::audioCallback;
+    want.userdata = beeper;
+
+    audioDevice = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
+    if (audioDevice == 0) {
+        // Not fatal, the emulator just runs silently
+        cout << "SDL_OpenAudioDevice failure: " << SDL_GetError() << endl;
+        return;
+    }
+    SDL_PauseAudioDevice(audioDevice, 0);
+    cout << "SDL_OpenAudioDevice success!\n";
+}
+
+// Runs on SDL's audio thread, must not allocate or lock
+void Chip8Window::audioCallback(void *userdata, Uint8 *stream, int len) {
+    Beeper* beeper = (Beeper*) userdata;
+    beeper->fill((int16_t*) stream, len / sizeof(int16_t));
+}
+
+bool Chip8Window::loadKeymap(const char *path) {
+    return inputMapper->loadConfig(path);
+}
+
+void Chip8Window::enableLatencyProbe() {
+    if (latencyProbe == nullptr) {
+        latencyProbe = new LatencyProbe();
+    }
+}
+
+bool Chip8Window::recordFrames(const char *capturePath, int scale) {
+    // Drops frames rather than stall the display if the encoder falls behind
+    frameCapture = new FrameCapture(false);
+    if (!frameCapture->open(capturePath, scale)) {
+        delete frameCapture;
+        frameCapture = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool Chip8Window::publishMetrics(const char *destination, int intervalMS) {
+    metrics = new RuntimeMetrics();
+    if (!metrics->open(destination, intervalMS)) {
+        delete metrics;
+        metrics = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool Chip8Window::exportState(const char *shmName) {
+    exporter = new StateExporter();
+    if (!exporter->open(shmName)) {
+        delete exporter;
+        exporter = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void Chip8Window::enableRunAhead(int frames) {
+    runAheadFrames = max(frames, 0);
+}
+
+void Chip8Window::setSpeed(double multiplier) {
+    speed = max(multiplier, 0.0);
+    fastForwardSpeed = speed != 1 ? speed : 0;
+}
+
+void Chip8Window::attachDebugger(Debugger* _debugger) {
+    debugger = _debugger;
+}
+
+// Runs instructions up to (not including) the given one, ticking the timers
+// on every frame boundary crossed.
+void Chip8Window::runUntil(uint64_t instruction) {
+    while (executedInstructions < instruction) {
+        uint64_t frameEnd = (executedInstructions / INSTRUCTIONS_PER_FRAME + 1) * INSTRUCTIONS_PER_FRAME;
+        uint64_t end = min(frameEnd, instruction);
+        int executed = chip8->runInstructions(end - executedInstructions);
+        executedInstructions = end;
+        if (metrics != nullptr) {
+            metrics->instructionsRun(executed);
+        }
+        if (executedInstructions == frameEnd) {
+            chip8->tickTimers();
+            if (metrics != nullptr) {
+                metrics->emulatedFrame();
+            }
+            if (frameCapture != nullptr) {
+                frameCapture->capture(chip8->displayBuffer, frameEnd / INSTRUCTIONS_PER_FRAME - 1);
+            }
+            if (exporter != nullptr) {
+                exporter->publish(chip8, frameEnd / INSTRUCTIONS_PER_FRAME);
+            }
+        }
+    }
+}
+
+// Emulates runAheadFrames frames past the machine on a throwaway copy, and
+// leaves what the copy shows in display. Copies share all but the pages the
+// ROM wrote to, so this costs a few hundred bytes plus the instructions.
+void Chip8Window::runAhead(uint8_t *display) {
+    uint64_t start = RuntimeMetrics::nowNs();
+    Chip8 ahead(*chip8);
+    // A debugger or profiler only watches the real machine
+    ahead.setInstrumentedDispatch(nullptr);
+
+    uint64_t instruction = executedInstructions;
+    uint64_t end = instruction + (uint64_t) runAheadFrames * INSTRUCTIONS_PER_FRAME;
+    while (instruction < end) {
+        uint64_t frameEnd = (instruction / INSTRUCTIONS_PER_FRAME + 1) * INSTRUCTIONS_PER_FRAME;
+        ahead.runInstructions(frameEnd - instruction);
+        ahead.tickTimers();
+        instruction = frameEnd;
+    }
+    ahead.packDisplay(display);
+
+    uint64_t elapsed = RuntimeMetrics::nowNs() - start;
+    runAheadPasses++;
+    runAheadTotalNs += elapsed;
+    runAheadMaxNs = max(runAheadMaxNs, elapsed);
+    if (metrics != nullptr) {
+        metrics->ranAhead(runAheadFrames * INSTRUCTIONS_PER_FRAME, elapsed);
+    }
+}
+
+void Chip8Window::reportRunAhead() {
+    if (runAheadPasses == 0) {
+        return;
+    }
+    const double frameUs = 1e6 / FRAMES_PER_SECOND;
+    double meanUs = runAheadTotalNs / 1e3 / runAheadPasses;
+    cout << "Run-ahead of " << runAheadFrames << " frames over " << runAheadPasses << " passes: "
+        << "mean " << meanUs << "us (" << 100 * meanUs / frameUs << "% of a frame), "
+        << "max " << runAheadMaxNs / 1e3 << "us" << endl;
+}
+
+// Puts the speed actually reached in the title while not at normal speed
+void Chip8Window::showSpeed(double achieved) {
+    if (speed == 1) {
+        SDL_SetWindowTitle(window, title.c_str());
+        return;
+    }
+    char text[256];
+    if (achieved <= 0) {
+        // Nothing measured yet
+        snprintf(text, sizeof(text), "%s - unthrottled", title.c_str());
+    } else {
+        snprintf(text, sizeof(text), "%s - %.1fx%s", title.c_str(), achieved, speed == 0 ? " (unthrottled)" : "");
+    }
+    SDL_SetWindowTitle(window, text);
+}
+
 void Chip8Window::run() {
     SDL_Event e;
 
@@ -92,47 +261,193 @@ void Chip8Window::run() {
         DISPLAY_HEIGHT);
 
     uint32_t sdlTextureBuffer[DISPLAY_WIDTH * DISPLAY_HEIGHT];
+    uint8_t packedDisplay[DISPLAY_WIDTH * DISPLAY_HEIGHT / 8];
+    uint8_t aheadDisplay[DISPLAY_WIDTH * DISPLAY_HEIGHT / 8];
+    // Emulated frame the run-ahead display was made from
+    uint64_t aheadFrame = UINT64_MAX;
+    bool keysChanged = false;
+    // SDL scales the texture up to the window
+    PixelExpander pixelExpander(1, PIXEL_COLOR | PIXEL_ALPHA, PIXEL_ALPHA);
+
+    // Emulated time runs off SDL's millisecond clock, which is also the
+    // clock input events are stamped with. It runs `speed` times as fast as
+    // normal, counted from the last speed change.
+    const uint64_t instructionsPerSecond = INSTRUCTIONS_PER_FRAME * FRAMES_PER_SECOND;
+    const uint64_t maxCatchUp = INSTRUCTIONS_PER_FRAME * MAX_CATCH_UP_FRAMES;
+    const Uint32 presentIntervalMS = 1000 / FRAMES_PER_SECOND;
+    Uint32 baseMS = SDL_GetTicks();
+    uint64_t baseInstruction = 0;
+    executedInstructions = 0;
+    Uint32 lastPresentMS = baseMS;
+    Uint32 speedShownMS = baseMS;
+    uint64_t speedShownInstruction = 0;
+
+    auto instructionAt = [&](Uint32 ms) -> uint64_t {
+        if (speed == 0) {
+            // Unthrottled, so input lands wherever emulation has got to
+            return executedInstructions;
+        }
+        Uint32 now = SDL_GetTicks();
+        ms = max(baseMS, min(ms, now));
+        return baseInstruction + (uint64_t) ((ms - baseMS) * (instructionsPerSecond * speed) / 1000);
+    };
+    if (speed != 1) {
+        this->showSpeed(speed);
+    }
 
     bool quit = false;
-    // int quit = 2;
+    bool faultReported = false;
     while (!quit) {
         while (SDL_PollEvent(&e)){
             if (e.type == SDL_QUIT){
                 quit = true;
             }
-            if (e.type == SDL_KEYDOWN){
-                if (e.key.keysym.sym == SDLK_ESCAPE) {
-                    quit = true;
-                } else if (KEYMAP.count(e.key.keysym.sym)) {
-                    chip8->handleKeyDown(KEYMAP[e.key.keysym.sym]);
-                    logger2->debug(chip8->keypadToString());
-                }
-            } else if (e.type == SDL_KEYUP) {
-                if (KEYMAP.count(e.key.keysym.sym)) {
-                    chip8->handleKeyUp(KEYMAP[e.key.keysym.sym]);
-                    logger2->debug(chip8->keypadToString());
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE) {
+                quit = true;
+            }
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_F12 && debugger != nullptr) {
+                debugger->breakNow();
+            }
+            if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_TAB && !e.key.repeat) {
+                // Fast-forward on or off, from where emulation is now
+                this->runUntil(instructionAt(e.common.timestamp));
+                speed = speed == 1 ? fastForwardSpeed : 1;
+                baseMS = SDL_GetTicks();
+                baseInstruction = executedInstructions;
+                speedShownMS = baseMS;
+                speedShownInstruction = executedInstructions;
+                this->showSpeed(speed);
+                // Redone from scratch back at normal speed
+                aheadFrame = UINT64_MAX;
+            }
+            inputMapper->handleDeviceEvent(e);
+
+            int key;
+            bool down;
+            if (inputMapper->translate(e, key, down)) {
+                // Apply the input at the emulated instruction it happened on
+                this->runUntil(instructionAt(e.common.timestamp));
+                if (down) {
+                    chip8->handleKeyDown(key);
+                    if (latencyProbe != nullptr) {
+                        latencyProbe->inputApplied(e.common.timestamp);
+                    }
+                } else {
+                    chip8->handleKeyUp(key);
                 }
-            } else if (e.type == SDL_MOUSEBUTTONDOWN){
-                // quit = true;
+                keysChanged = true;
+                logger2->debug(chip8->keypadToString());
             }
         }
-        chip8->cycle();
 
-        if (chip8->requiresRerender) {
-            for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; ++i) {
-                    uint8_t pixel = chip8->displayBuffer[i];
-                    sdlTextureBuffer[i] = (PIXEL_COLOR * pixel) | PIXEL_ALPHA;
+        if (speed == 0) {
+            // As much as fits in a host frame, in batches between clock reads
+            Uint32 sliceStartMS = SDL_GetTicks();
+            do {
+                this->runUntil(executedInstructions + INSTRUCTIONS_PER_FRAME * UNTHROTTLED_BATCH_FRAMES);
+            } while (SDL_GetTicks() - sliceStartMS < presentIntervalMS);
+        } else {
+            uint64_t target = instructionAt(SDL_GetTicks());
+            uint64_t catchUp = (uint64_t) (maxCatchUp * max(speed, 1.0));
+            if (target - executedInstructions > catchUp) {
+                // The host stalled, drop the lost time instead of racing to catch up
+                uint64_t dropped = target - executedInstructions - catchUp;
+                target -= dropped;
+                baseMS = SDL_GetTicks();
+                baseInstruction = target;
+                if (metrics != nullptr) {
+                    metrics->instructionsDropped(dropped);
                 }
+            }
+            this->runUntil(target);
+        }
+        if (debugger != nullptr && debugger->quitRequested()) {
+            quit = true;
+        }
+        if (chip8->isFaulted() && !faultReported) {
+            // The window stays open on the last frame
+            cout << "Stopped: " << chip8->statusToString() << endl;
+            faultReported = true;
+        }
+        beeper->setTone(chip8->isSoundOn());
+
+        Uint32 now = SDL_GetTicks();
+        if (speed != 1 && now - speedShownMS >= SPEED_TITLE_INTERVAL_MS) {
+            double emulatedSeconds = (double) (executedInstructions - speedShownInstruction) / instructionsPerSecond;
+            this->showSpeed(emulatedSeconds * 1000 / (now - speedShownMS));
+            speedShownMS = now;
+            speedShownInstruction = executedInstructions;
+        }
+
+        bool redraw = chip8->requiresRerender;
+        // Fast-forwarding skips frames, presenting at most once per host
+        // frame so converting and presenting never hold emulation back
+        if (speed != 1 && now - lastPresentMS < presentIntervalMS) {
+            redraw = false;
+        }
+        // Nothing to hide while fast-forwarding
+        bool showAhead = runAheadFrames > 0 && speed == 1;
+        if (showAhead) {
+            // Only redone when the machine or the keys move on
+            uint64_t frame = executedInstructions / INSTRUCTIONS_PER_FRAME;
+            redraw = false;
+            if (frame != aheadFrame || keysChanged) {
+                this->runAhead(aheadDisplay);
+                redraw = aheadFrame == UINT64_MAX || memcmp(aheadDisplay, packedDisplay, sizeof(aheadDisplay)) != 0;
+                aheadFrame = frame;
+                keysChanged = false;
+            }
+            chip8->requiresRerender = false;
+        }
+
+        if (redraw) {
+            if (metrics != nullptr) {
+                metrics->presentStarted();
+            }
+            if (showAhead) {
+                memcpy(packedDisplay, aheadDisplay, sizeof(packedDisplay));
+            } else {
+                chip8->packDisplay(packedDisplay);
+            }
+            pixelExpander.expand(packedDisplay, sdlTextureBuffer, DISPLAY_WIDTH);
             // Update SDL texture
             SDL_UpdateTexture(sdlTexture, NULL, sdlTextureBuffer, 64 * sizeof(Uint32));
             // Clear screen and render
             SDL_RenderClear(renderer);
             SDL_RenderCopy(renderer, sdlTexture, NULL, NULL);
             SDL_RenderPresent(renderer);
+            if (metrics != nullptr) {
+                metrics->presentFinished();
+            }
             chip8->requiresRerender = false;
+            lastPresentMS = SDL_GetTicks();
+            if (latencyProbe != nullptr) {
+                latencyProbe->presented(lastPresentMS);
+            }
+        } else if (speed != 0) {
+            // Nothing can change on screen before the next emulated frame
+            uint64_t nextFrame = (executedInstructions / INSTRUCTIONS_PER_FRAME + 1) * INSTRUCTIONS_PER_FRAME;
+            Uint32 nextFrameMS = baseMS + (Uint32) ((nextFrame - baseInstruction) * 1000 / (instructionsPerSecond * speed));
+            now = SDL_GetTicks();
+            if (nextFrameMS > now) {
+                uint64_t sleepStart = metrics != nullptr ? RuntimeMetrics::nowNs() : 0;
+                SDL_Delay(nextFrameMS - now);
+                if (metrics != nullptr) {
+                    metrics->slept((uint64_t) (nextFrameMS - now) * 1000000, sleepStart);
+                }
+            }
+        }
+        if (metrics != nullptr) {
+            metrics->tick();
         }
+    }
 
-        // system( "read -n 1 -s -p \"Press any key to continue...\"" );
-        this_thread::sleep_for(chrono::microseconds(MICROSECOND_DELAY));
+    SDL_DestroyTexture(sdlTexture);
+    if (frameCapture != nullptr) {
+        frameCapture->close();
+    }
+    if (latencyProbe != nullptr) {
+        latencyProbe->report();
     }
+    this->reportRunAhead();
 }
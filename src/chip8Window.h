@@ -2,21 +2,78 @@
 #define CHIP_8_WINDOW_H
 
 #include <SDL2/SDL.h>
+#include <string>
 
+#include "beeper.h"
 #include "chip8.h"
+#include "debugger.h"
+#include "frameCapture.h"
+#include "inputMapper.h"
+#include "latencyProbe.h"
+#include "runtimeMetrics.h"
+#include "stateExporter.h"
 
 class Chip8Window {
 private:
     Chip8* chip8;
     SDL_Window* window;
     SDL_Renderer* renderer;
+    std::string title;
+
+    Beeper* beeper;
+    SDL_AudioDeviceID audioDevice;
+
+    InputMapper* inputMapper;
+    LatencyProbe* latencyProbe;
+    FrameCapture* frameCapture;
+    RuntimeMetrics* metrics;
+    StateExporter* exporter;
+    // Not owned
+    Debugger* debugger;
+
+    // Emulated time, counted in instructions since run() started
+    uint64_t executedInstructions;
+
+    // Frames shown ahead of the emulated machine, 0 when off
+    int runAheadFrames;
+    uint64_t runAheadPasses;
+    uint64_t runAheadTotalNs;
+    uint64_t runAheadMaxNs;
+
+    // Multiple of normal speed, 0 for as fast as the host can go
+    double speed;
+    // What Tab switches to from normal speed
+    double fastForwardSpeed;
 
     void initWindow(const char *title, int width, int height);
+    void initAudio();
+    static void audioCallback(void *userdata, Uint8 *stream, int len);
+
+    void runUntil(uint64_t instruction);
+    void runAhead(uint8_t *display);
+    void reportRunAhead();
+    void showSpeed(double achieved);
 
 public:
     Chip8Window(Chip8* _chip8, const char *title, int width, int height);
     ~Chip8Window();
 
+    bool loadKeymap(const char *path);
+    void enableLatencyProbe();
+    bool recordFrames(const char *capturePath, int scale);
+    bool publishMetrics(const char *destination, int intervalMS);
+    // Publishes every emulated frame to shared memory for other processes
+    bool exportState(const char *shmName);
+    // Shows what the machine will draw this many frames from now with the
+    // keys held now, hiding that much of the game's own input latency
+    void enableRunAhead(int frames);
+    // Starts at this multiple of normal speed, 0 runs unthrottled. Tab
+    // switches between normal speed and this one, or unthrottled if it's 1.
+    // Timers stay in emulated time; only some frames are presented.
+    void setSpeed(double multiplier);
+    // F12 breaks into the debugger console, quitting it closes the window
+    void attachDebugger(Debugger* _debugger);
+
     void run();
 };
 
@@ -1,12 +1,22 @@
 #ifndef CONSTANTS_H
 #define CONSTANTS_H
 
+#include <stdint.h>
+
 const int MEMORY_SIZE = 4096;
 const int INTERPRETER_SIZE = 512;
 
 const int DISPLAY_WIDTH = 64;
 const int DISPLAY_HEIGHT = 32;
 
+// The display is stored one bit per pixel, most significant bit leftmost
+const int DISPLAY_ROW_BYTES = DISPLAY_WIDTH / 8;
+const int DISPLAY_BYTES = DISPLAY_ROW_BYTES * DISPLAY_HEIGHT;
+
+inline bool displayPixel(const uint8_t *display, int x, int y) {
+    return (display[y * DISPLAY_ROW_BYTES + x / 8] >> (7 - x % 8)) & 1;
+}
+
 // Dimensions of the native window
 const int WINDOW_WIDTH = 1024;
 const int WINDOW_HEIGHT = 512;
@@ -15,6 +25,39 @@ const int WINDOW_HEIGHT = 512;
 const uint32_t PIXEL_COLOR = 0x00FFFF00;
 const uint32_t PIXEL_ALPHA = 0x000000FF;
 
-const int MICROSECOND_DELAY = 1600;
+// Largest integer scale PixelExpander renders at
+const int MAX_PIXEL_SCALE = 16;
+
+const int FRAMES_PER_SECOND = 60;
+
+// About 500 instructions per second, with the timers ticking at 60Hz
+const int INSTRUCTIONS_PER_FRAME = 8;
+
+// How far the window lets emulation fall behind before dropping time
+const int MAX_CATCH_UP_FRAMES = 10;
+// A quota's stuck check looks for the state at the end of a frame among
+// this many before it, so loops shorter than that many frames are caught
+// whatever their length in instructions
+const int STUCK_CYCLE_FRAMES = 8;
+
+// Fast-forward: frames run between clock reads when unthrottled, and how
+// often the speed reached is shown
+const int UNTHROTTLED_BATCH_FRAMES = 64;
+const int SPEED_TITLE_INTERVAL_MS = 500;
+
+// Frames the window may show ahead of emulation
+const int MAX_RUN_AHEAD_FRAMES = 8;
+
+// Machines one wall window shows, and the atlas pixels between their tiles
+const int MAX_WALL_INSTANCES = 1024;
+const int WALL_GUTTER = 1;
+const uint32_t WALL_GUTTER_COLOR = 0x303030FF;
+
+// Beeper output. 256 samples at 48kHz is 5.3ms per audio buffer.
+const int AUDIO_SAMPLE_RATE = 48000;
+const int AUDIO_BUFFER_SAMPLES = 256;
+const int AUDIO_SAMPLES_PER_FRAME = AUDIO_SAMPLE_RATE / FRAMES_PER_SECOND;
+const int BEEP_FREQUENCY = 440;
+const int16_t BEEP_VOLUME = 3000;
 
 #endif
@@ -0,0 +1,468 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#include "debugger.h"
+#include "disassembler.h"
+
+using namespace std;
+
+const uint8_t NO_BREAKPOINT = 0;
+const uint8_t BREAKPOINT = 1;
+const uint8_t CONDITIONAL_BREAKPOINT = 2;
+
+
+// Addresses are always hex, with or without 0x
+static bool parseAddress(const string &text, uint16_t &address) {
+    char *end;
+    unsigned long value = strtoul(text.c_str(), &end, 16);
+    if (text.empty() || *end != '\0' || value >= (unsigned long) MEMORY_SIZE) {
+        return false;
+    }
+    address = value;
+    return true;
+}
+
+static string hexString(int value, int digits) {
+    char text[16];
+    snprintf(text, sizeof(text), "0x%0*X", digits, value);
+    return text;
+}
+
+bool DebugCondition::parse(const string &text) {
+    istringstream in(text);
+    string name;
+    string valueText;
+    if (!(in >> name >> op >> valueText)) {
+        return false;
+    }
+    if (name == "I" || name == "i") {
+        target = 16;
+    } else if ((name[0] == 'V' || name[0] == 'v') && name.size() == 2 && isxdigit(name[1])) {
+        target = strtol(name.c_str() + 1, NULL, 16);
+    } else {
+        return false;
+    }
+    if (op != "==" && op != "!=" && op != "<" && op != "<=" && op != ">" && op != ">=") {
+        return false;
+    }
+    char *end;
+    value = strtol(valueText.c_str(), &end, 0);
+    return *end == '\0';
+}
+
+string DebugCondition::toString() const {
+    string name = target == 16 ? "I" : "V" + string(1, "0123456789ABCDEF"[target]);
+    return name + " " + op + " " + to_string(value);
+}
+
+
+Debugger::Debugger(Chip8* _chip8) {
+    chip8 = _chip8;
+    underlyingDispatch = nullptr;
+    memset(breakpoints, NO_BREAKPOINT, sizeof(breakpoints));
+    breakpointCount = 0;
+    watchedPages = 0;
+    breakPending = false;
+    stepsRemaining = 0;
+    resuming = false;
+    quit = false;
+}
+
+Debugger::~Debugger() {
+    if (chip8->instrumentedDispatch == this) {
+        chip8->setInstrumentedDispatch(underlyingDispatch);
+    }
+}
+
+const char *Debugger::name() {
+    return "debugger";
+}
+
+bool Debugger::isArmed() {
+    return breakpointCount > 0 || !watchpoints.empty() || !stopConditions.empty()
+        || breakPending || stepsRemaining > 0;
+}
+
+void Debugger::updateArming() {
+    bool armed = this->isArmed() && !quit;
+    bool installed = chip8->instrumentedDispatch == this;
+    if (armed && !installed) {
+        // Keeps whatever was instrumenting before, e.g. a Profiler, running
+        // underneath
+        underlyingDispatch = chip8->instrumentedDispatch;
+        chip8->setInstrumentedDispatch(this);
+    } else if (!armed && installed) {
+        chip8->setInstrumentedDispatch(underlyingDispatch);
+    }
+}
+
+int Debugger::run(Chip8 &machine, int count) {
+    string reason;
+    for (int i = 0; i < count; i++) {
+        if (machine.isBlocked()) {
+            return i;
+        }
+        if (!resuming && this->shouldStop(machine, reason)) {
+            this->stop(reason);
+            if (quit) {
+                return i;
+            }
+        }
+        resuming = false;
+
+        if (underlyingDispatch != nullptr) {
+            underlyingDispatch->run(machine, 1);
+        } else {
+            machine.step();
+        }
+        if (stepsRemaining > 0 && --stepsRemaining == 0) {
+            breakPending = true;
+        }
+    }
+    return count;
+}
+
+bool Debugger::evaluate(const DebugCondition &condition, const Chip8 &machine) {
+    int actual = condition.target == 16 ? machine.I : machine.V[condition.target];
+    const string &op = condition.op;
+    if (op == "==") return actual == condition.value;
+    if (op == "!=") return actual != condition.value;
+    if (op == "<") return actual < condition.value;
+    if (op == "<=") return actual <= condition.value;
+    if (op == ">") return actual > condition.value;
+    return actual >= condition.value;
+}
+
+bool Debugger::shouldStop(Chip8 &machine, string &reason) {
+    if (breakPending) {
+        breakPending = false;
+        reason = "Stopped";
+        return true;
+    }
+
+    uint16_t pc = machine.pc;
+    if (breakpoints[pc & 0xFFF] == BREAKPOINT) {
+        reason = "Breakpoint at " + hexString(pc, 3);
+        return true;
+    }
+    if (breakpoints[pc & 0xFFF] == CONDITIONAL_BREAKPOINT
+            && this->evaluate(breakpointConditions[pc & 0xFFF], machine)) {
+        reason = "Breakpoint at " + hexString(pc, 3) + " if " + breakpointConditions[pc & 0xFFF].toString();
+        return true;
+    }
+
+    bool stopping = false;
+    for (DebugCondition &condition : stopConditions) {
+        bool result = this->evaluate(condition, machine);
+        if (result && !condition.lastResult) {
+            reason = "Condition " + condition.toString();
+            stopping = true;
+        }
+        condition.lastResult = result;
+    }
+    if (stopping) {
+        return true;
+    }
+
+    if (watchedPages != 0 && pc + 1 < MEMORY_SIZE) {
+        uint16_t opcode = machine.memory.read(pc) << 8 | machine.memory.read(pc + 1);
+        return this->hitsWatchpoint(machine, opcode, reason);
+    }
+    return false;
+}
+
+// Checks the memory the instruction is about to touch, so the stop happens
+// before the access
+bool Debugger::hitsWatchpoint(Chip8 &machine, uint16_t opcode, string &reason) {
+    int length;
+    bool write;
+    switch (opcode & 0xF0FF) {
+        case 0xF033: length = 3; write = true; break;
+        case 0xF055: length = ((opcode & 0x0F00) >> 8) + 1; write = true; break;
+        case 0xF065: length = ((opcode & 0x0F00) >> 8) + 1; write = false; break;
+        default:
+            if ((opcode & 0xF000) != 0xD000 || (opcode & 0x000F) == 0) {
+                return false;
+            }
+            length = opcode & 0x000F;
+            write = false;
+    }
+
+    // Addresses wrap at the end of memory, so an access running past it is
+    // checked as two ranges
+    int start = machine.I & (MEMORY_SIZE - 1);
+    int end = start + length - 1;
+    int ranges[2][2] = { { start, min(end, MEMORY_SIZE - 1) }, { 0, end - MEMORY_SIZE } };
+    int rangeCount = end < MEMORY_SIZE ? 1 : 2;
+    uint16_t pages = 0;
+    for (int r = 0; r < rangeCount; r++) {
+        for (int page = ranges[r][0] >> 8; page <= ranges[r][1] >> 8; page++) {
+            pages |= 1 << page;
+        }
+    }
+    if ((pages & watchedPages) == 0) {
+        return false;
+    }
+
+    for (const Watchpoint &watchpoint : watchpoints) {
+        bool overlaps = false;
+        for (int r = 0; r < rangeCount; r++) {
+            overlaps |= ranges[r][0] <= watchpoint.end && ranges[r][1] >= watchpoint.start;
+        }
+        if ((write ? watchpoint.write : watchpoint.read) && overlaps) {
+            reason = string("Watchpoint ") + hexString(watchpoint.start, 3) + "-" + hexString(watchpoint.end, 3)
+                + (write ? " written" : " read") + " by " + disassemble(opcode) + " at " + hexString(machine.pc, 3);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Debugger::stop(const string &reason) {
+    cout << dec << reason << endl;
+    this->printDisassembly(chip8->pc, 1);
+    this->console();
+}
+
+bool Debugger::addBreakpoint(uint16_t address, const string &condition) {
+    if (breakpoints[address] == NO_BREAKPOINT) {
+        breakpointCount++;
+    }
+    if (condition.empty()) {
+        breakpoints[address] = BREAKPOINT;
+        breakpointConditions.erase(address);
+    } else {
+        DebugCondition parsed;
+        if (!parsed.parse(condition)) {
+            cout << "Bad condition: " << condition << endl;
+            if (breakpoints[address] == NO_BREAKPOINT) {
+                breakpointCount--;
+            }
+            return false;
+        }
+        breakpoints[address] = CONDITIONAL_BREAKPOINT;
+        breakpointConditions[address] = parsed;
+    }
+    this->updateArming();
+    return true;
+}
+
+void Debugger::removeBreakpoint(uint16_t address) {
+    if (breakpoints[address] != NO_BREAKPOINT) {
+        breakpointCount--;
+    }
+    breakpoints[address] = NO_BREAKPOINT;
+    breakpointConditions.erase(address);
+    this->updateArming();
+}
+
+void Debugger::addWatchpoint(uint16_t start, uint16_t end, bool read, bool write) {
+    Watchpoint watchpoint = { start, end, read, write };
+    watchpoints.push_back(watchpoint);
+    for (int page = start >> 8; page <= end >> 8; page++) {
+        watchedPages |= 1 << page;
+    }
+    this->updateArming();
+}
+
+void Debugger::removeWatchpoints(uint16_t start) {
+    watchedPages = 0;
+    for (size_t i = watchpoints.size(); i-- > 0;) {
+        if (watchpoints[i].start == start) {
+            watchpoints.erase(watchpoints.begin() + i);
+        } else {
+            for (int page = watchpoints[i].start >> 8; page <= watchpoints[i].end >> 8; page++) {
+                watchedPages |= 1 << page;
+            }
+        }
+    }
+    this->updateArming();
+}
+
+bool Debugger::addStopCondition(const string &condition) {
+    DebugCondition parsed;
+    if (!parsed.parse(condition)) {
+        cout << "Bad condition: " << condition << endl;
+        return false;
+    }
+    // Already true conditions stop when they next become true
+    parsed.lastResult = this->evaluate(parsed, *chip8);
+    stopConditions.push_back(parsed);
+    this->updateArming();
+    return true;
+}
+
+void Debugger::breakNow() {
+    breakPending = true;
+    this->updateArming();
+}
+
+void Debugger::console() {
+    string line;
+    while (true) {
+        cout << "(chip8) " << flush;
+        if (!getline(cin, line)) {
+            // No more commands, run to the end untouched
+            cout << endl;
+            breakPending = false;
+            stepsRemaining = 0;
+            memset(breakpoints, NO_BREAKPOINT, sizeof(breakpoints));
+            breakpointCount = 0;
+            breakpointConditions.clear();
+            watchpoints.clear();
+            watchedPages = 0;
+            stopConditions.clear();
+            break;
+        }
+        if (this->command(line)) {
+            break;
+        }
+    }
+    resuming = true;
+    this->updateArming();
+}
+
+bool Debugger::command(const string &line) {
+    istringstream in(line);
+    string verb;
+    if (!(in >> verb)) {
+        return false;
+    }
+    string argument;
+    in >> argument;
+    string rest;
+    getline(in, rest);
+
+    uint16_t address;
+    if (verb == "c") {
+        return true;
+    } else if (verb == "s") {
+        stepsRemaining = argument.empty() ? 1 : max(1, atoi(argument.c_str()));
+        return true;
+    } else if (verb == "q") {
+        quit = true;
+        return true;
+    } else if (verb == "b" && parseAddress(argument, address)) {
+        size_t condition = rest.find("if ");
+        if (this->addBreakpoint(address, condition == string::npos ? "" : rest.substr(condition + 3))) {
+            cout << "Breakpoint at " << hexString(address, 3) << endl;
+        }
+    } else if (verb == "bd" && parseAddress(argument, address)) {
+        this->removeBreakpoint(address);
+    } else if (verb == "w") {
+        // w <start>[-<end>] [r|w|rw]
+        size_t dash = argument.find('-');
+        uint16_t end = 0;
+        if (!parseAddress(argument.substr(0, dash), address)
+                || !parseAddress(dash == string::npos ? argument : argument.substr(dash + 1), end)
+                || end < address) {
+            cout << "Bad range: " << argument << endl;
+            return false;
+        }
+        string mode;
+        istringstream(rest) >> mode;
+        bool read = mode.empty() || mode.find('r') != string::npos;
+        bool write = mode.empty() || mode.find('w') != string::npos;
+        this->addWatchpoint(address, end, read, write);
+        cout << "Watching " << hexString(address, 3) << "-" << hexString(end, 3) << endl;
+    } else if (verb == "wd" && parseAddress(argument, address)) {
+        this->removeWatchpoints(address);
+    } else if (verb == "when") {
+        this->addStopCondition(argument + rest);
+    } else if (verb == "whend") {
+        stopConditions.clear();
+        this->updateArming();
+    } else if (verb == "r") {
+        this->printRegisters();
+    } else if (verb == "x" && parseAddress(argument, address)) {
+        this->printMemory(address, rest.empty() ? 16 : atoi(rest.c_str()));
+    } else if (verb == "l") {
+        if (argument.empty() || !parseAddress(argument, address)) {
+            address = chip8->pc;
+        }
+        this->printDisassembly(address, rest.empty() ? 8 : atoi(rest.c_str()));
+    } else if (verb == "i") {
+        this->printStops();
+    } else {
+        this->printHelp();
+    }
+    return false;
+}
+
+void Debugger::printRegisters() {
+    char line[128];
+    for (int i = 0; i < 16; i++) {
+        snprintf(line, sizeof(line), "V%X=%02X%s", i, chip8->V[i], i % 8 == 7 ? "\n" : " ");
+        cout << line;
+    }
+    snprintf(line, sizeof(line), "PC=%03X I=%03X SP=%d DT=%d ST=%d\n",
+        chip8->pc, chip8->I, chip8->sp, chip8->delayTimer, chip8->soundTimer);
+    cout << line;
+    cout << "Stack:";
+    for (int i = 0; i < chip8->sp && i < 16; i++) {
+        snprintf(line, sizeof(line), " %03X", chip8->stack[i]);
+        cout << line;
+    }
+    cout << endl;
+}
+
+void Debugger::printMemory(uint16_t address, int length) {
+    char line[16];
+    for (int i = 0; i < length && address + i < MEMORY_SIZE; i++) {
+        if (i % 16 == 0) {
+            snprintf(line, sizeof(line), "%s%03X:", i == 0 ? "" : "\n", address + i);
+            cout << line;
+        }
+        snprintf(line, sizeof(line), " %02X", chip8->memory.read(address + i));
+        cout << line;
+    }
+    cout << endl;
+}
+
+void Debugger::printDisassembly(uint16_t address, int count) {
+    char line[64];
+    for (int i = 0; i < count && address + 1 < MEMORY_SIZE; i++, address += 2) {
+        uint16_t opcode = chip8->memory.read(address) << 8 | chip8->memory.read(address + 1);
+        snprintf(line, sizeof(line), "%s %03X: %04X  %s", address == chip8->pc ? "=>" : "  ",
+            address, opcode, disassemble(opcode).c_str());
+        cout << line << endl;
+    }
+}
+
+void Debugger::printStops() {
+    for (int i = 0; i < MEMORY_SIZE; i++) {
+        if (breakpoints[i] == BREAKPOINT) {
+            cout << "Breakpoint " << hexString(i, 3) << endl;
+        } else if (breakpoints[i] == CONDITIONAL_BREAKPOINT) {
+            cout << "Breakpoint " << hexString(i, 3) << " if " << breakpointConditions[i].toString() << endl;
+        }
+    }
+    for (const Watchpoint &watchpoint : watchpoints) {
+        cout << "Watchpoint " << hexString(watchpoint.start, 3) << "-" << hexString(watchpoint.end, 3)
+            << (watchpoint.read ? " r" : " ") << (watchpoint.write ? "w" : "") << endl;
+    }
+    for (const DebugCondition &condition : stopConditions) {
+        cout << "When " << condition.toString() << endl;
+    }
+}
+
+void Debugger::printHelp() {
+    cout << "Addresses are hex. Commands:" << endl;
+    cout << "  c                      continue" << endl;
+    cout << "  s [n]                  step n instructions" << endl;
+    cout << "  b <addr> [if <cond>]   breakpoint, e.g. b 2A4 if V3 == 5" << endl;
+    cout << "  bd <addr>              delete breakpoint" << endl;
+    cout << "  w <addr>[-<end>] [r|w] watch memory reads and/or writes" << endl;
+    cout << "  wd <addr>              delete watchpoints starting at addr" << endl;
+    cout << "  when <cond>            stop when a condition becomes true, e.g. when I >= 0x300" << endl;
+    cout << "  whend                  delete all conditions" << endl;
+    cout << "  r                      registers and stack" << endl;
+    cout << "  x <addr> [n]           dump memory" << endl;
+    cout << "  l [addr] [n]           disassemble" << endl;
+    cout << "  i                      list breakpoints, watchpoints and conditions" << endl;
+    cout << "  q                      quit" << endl;
+}
@@ -0,0 +1,96 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "constants.h"
+#include "executionBackend.h"
+
+using namespace std;
+
+// `<register> <op> <value>`, e.g. "V3 == 5" or "I >= 0x300"
+struct DebugCondition {
+    int target; // 0-15 for V0-VF, 16 for I
+    string op;
+    int value;
+    // Stop conditions fire when they become true, not while they stay true
+    bool lastResult = false;
+
+    bool parse(const string &text);
+    string toString() const;
+};
+
+// Inclusive range of memory addresses
+struct Watchpoint {
+    uint16_t start;
+    uint16_t end;
+    bool read;
+    bool write;
+};
+
+// Breakpoints on pc, watchpoints on memory ranges and stop conditions on
+// registers, with a stepping console on stdin. While nothing is set the
+// Chip8 runs its normal dispatch; arming any of them swaps in this one, which
+// checks before every instruction.
+class Debugger : public ExecutionBackend {
+private:
+    Chip8* chip8;
+    ExecutionBackend* underlyingDispatch;
+
+    uint8_t breakpoints[MEMORY_SIZE];
+    int breakpointCount;
+    map<uint16_t, DebugCondition> breakpointConditions;
+    vector<Watchpoint> watchpoints;
+    // Bit per 256-byte page holding any watchpoint, so most accesses are
+    // rejected without walking the list
+    uint16_t watchedPages;
+    vector<DebugCondition> stopConditions;
+
+    bool breakPending;
+    int stepsRemaining;
+    // Set when leaving the console, so the instruction it stopped on runs
+    bool resuming;
+    bool quit;
+
+    bool isArmed();
+    void updateArming();
+
+    bool evaluate(const DebugCondition &condition, const Chip8 &machine);
+    bool shouldStop(Chip8 &machine, string &reason);
+    bool hitsWatchpoint(Chip8 &machine, uint16_t opcode, string &reason);
+    void stop(const string &reason);
+
+    void printRegisters();
+    void printMemory(uint16_t address, int length);
+    void printDisassembly(uint16_t address, int count);
+    void printStops();
+    void printHelp();
+
+public:
+    Debugger(Chip8* _chip8);
+    ~Debugger();
+
+    const char *name() override;
+    int run(Chip8 &machine, int count) override;
+
+    bool addBreakpoint(uint16_t address, const string &condition);
+    void removeBreakpoint(uint16_t address);
+    void addWatchpoint(uint16_t start, uint16_t end, bool read, bool write);
+    void removeWatchpoints(uint16_t start);
+    bool addStopCondition(const string &condition);
+    // Stops before the next instruction
+    void breakNow();
+
+    // Runs one console command, returns true if execution should resume
+    bool command(const string &line);
+    // Reads commands from stdin until one resumes execution
+    void console();
+
+    bool quitRequested() { return quit; }
+};
+
+#endif // DEBUGGER_H
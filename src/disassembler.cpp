@@ -0,0 +1,79 @@
+#include <cstdio>
+
+#include "disassembler.h"
+
+using namespace std;
+
+
+string disassemble(uint16_t opcode) {
+    int x = (opcode & 0x0F00) >> 8;
+    int y = (opcode & 0x00F0) >> 4;
+    int n = opcode & 0x000F;
+    int kk = opcode & 0x00FF;
+    int nnn = opcode & 0x0FFF;
+
+    char text[32];
+    snprintf(text, sizeof(text), "DW 0x%04X", opcode);
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if (opcode == 0x00E0) {
+                snprintf(text, sizeof(text), "CLS");
+            } else if (opcode == 0x00EE) {
+                snprintf(text, sizeof(text), "RET");
+            }
+            break;
+        case 0x1000: snprintf(text, sizeof(text), "JP 0x%03X", nnn); break;
+        case 0x2000: snprintf(text, sizeof(text), "CALL 0x%03X", nnn); break;
+        case 0x3000: snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, kk); break;
+        case 0x4000: snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, kk); break;
+        case 0x5000:
+            if (n == 0) {
+                snprintf(text, sizeof(text), "SE V%X, V%X", x, y);
+            }
+            break;
+        case 0x6000: snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, kk); break;
+        case 0x7000: snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, kk); break;
+        case 0x8000:
+        {
+            static const char *names[16] = {
+                "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+                nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr
+            };
+            if (names[n] != nullptr) {
+                snprintf(text, sizeof(text), "%s V%X, V%X", names[n], x, y);
+            }
+            break;
+        }
+        case 0x9000:
+            if (n == 0) {
+                snprintf(text, sizeof(text), "SNE V%X, V%X", x, y);
+            }
+            break;
+        case 0xA000: snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); break;
+        case 0xB000: snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); break;
+        case 0xC000: snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, kk); break;
+        case 0xD000: snprintf(text, sizeof(text), "DRW V%X, V%X, %d", x, y, n); break;
+        case 0xE000:
+            if (kk == 0x9E) {
+                snprintf(text, sizeof(text), "SKP V%X", x);
+            } else if (kk == 0xA1) {
+                snprintf(text, sizeof(text), "SKNP V%X", x);
+            }
+            break;
+        case 0xF000:
+            switch (kk) {
+                case 0x07: snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+                case 0x0A: snprintf(text, sizeof(text), "LD V%X, K", x); break;
+                case 0x15: snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+                case 0x18: snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+                case 0x1E: snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+                case 0x29: snprintf(text, sizeof(text), "LD F, V%X", x); break;
+                case 0x33: snprintf(text, sizeof(text), "LD B, V%X", x); break;
+                case 0x55: snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+                case 0x65: snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+            }
+            break;
+    }
+    return text;
+}
@@ -0,0 +1,10 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <stdint.h>
+#include <string>
+
+// Cowgod-style mnemonic for one instruction, e.g. "LD V3, 0x2A"
+std::string disassemble(uint16_t opcode);
+
+#endif // DISASSEMBLER_H
@@ -0,0 +1,96 @@
+#include <iostream>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+
+#include "constants.h"
+#include "envServer.h"
+
+using namespace std;
+
+
+void usage() {
+    cout << "Usage: ./chip8-env [options] <rom>" << endl;
+    cout << "  --envs <n>                  environments to host (default 16)" << endl;
+    cout << "  --socket <path>             Unix socket to listen on (default chip8-env.sock)" << endl;
+    cout << "  --shm <name>                shared memory object for observations (default /chip8-env)" << endl;
+    cout << "  --reward <addr>[:<bytes>]   reward is the growth of this big-endian value, repeatable" << endl;
+    cout << "  --done <addr>=<value>       episode ends when memory[addr] == value" << endl;
+    cout << "  --max-frames <n>            episode ends after n frames" << endl;
+}
+
+void handleSignal(int) {
+    EnvServer::stop();
+}
+
+bool parseReward(const char *spec, RewardSpec &reward) {
+    char *end;
+    unsigned long address = strtoul(spec, &end, 0);
+    reward.bytes = 1;
+    if (*end == ':') {
+        reward.bytes = atoi(end + 1);
+    } else if (*end != '\0') {
+        return false;
+    }
+    reward.address = address;
+    return end != spec && address < MEMORY_SIZE && reward.bytes >= 1 && reward.bytes <= 8;
+}
+
+int main(int argc, char *argv[]) {
+    EnvOptions options;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--envs") == 0 && hasValue) {
+            options.environments = atoi(argv[++i]);
+        } else if (strcmp(arg, "--socket") == 0 && hasValue) {
+            options.socketPath = argv[++i];
+        } else if (strcmp(arg, "--shm") == 0 && hasValue) {
+            options.shmName = argv[++i];
+        } else if (strcmp(arg, "--reward") == 0 && hasValue) {
+            RewardSpec reward;
+            if (!parseReward(argv[++i], reward)) {
+                cout << "Bad reward address: " << argv[i] << endl;
+                return 1;
+            }
+            options.rewards.push_back(reward);
+        } else if (strcmp(arg, "--done") == 0 && hasValue) {
+            char *end;
+            options.doneAddress = strtoul(argv[++i], &end, 0);
+            if (*end != '=') {
+                cout << "Bad done condition: " << argv[i] << endl;
+                return 1;
+            }
+            options.doneValue = strtoul(end + 1, NULL, 0);
+            options.hasDone = true;
+        } else if (strcmp(arg, "--max-frames") == 0 && hasValue) {
+            options.maxFrames = atoi(argv[++i]);
+        } else if (arg[0] == '-' || options.romPath != nullptr) {
+            cout << "Unknown option: " << arg << endl;
+            usage();
+            return 1;
+        } else {
+            options.romPath = arg;
+        }
+    }
+    if (options.romPath == nullptr || options.environments < 1) {
+        usage();
+        return 1;
+    }
+
+    EnvServer server(options);
+    if (!server.open()) {
+        return 1;
+    }
+
+    // Without SA_RESTART, so a blocked accept() or read() returns and the
+    // socket and shared memory get cleaned up
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    server.run();
+    return 0;
+}
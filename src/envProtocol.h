@@ -0,0 +1,66 @@
+#ifndef ENV_PROTOCOL_H
+#define ENV_PROTOCOL_H
+
+#include <stdint.h>
+
+// Wire format of the chip8-env server. Every message is a fixed header
+// followed by a payload, all fields little-endian and unpadded, so clients
+// in any language can build them with plain struct packing.
+//
+// Requests act on environments [first, first + count):
+//   ENV_RESET  payload: uint32_t seeds[count]
+//   ENV_STEP   payload: uint16_t keyMasks[count] (bit k = key k held),
+//                       uint32_t frames (at most ENV_MAX_STEP_FRAMES)
+// Replies to both:
+//   EnvReplyHeader, then float rewards[count], uint8_t done[count]
+//   (all zero for a reset)
+//
+// Observations are not sent over the socket. Environment i's display is
+// packed into ENV_OBSERVATION_BYTES at
+// sizeof(EnvShmHeader) + i * ENV_OBSERVATION_BYTES of the shared memory
+// object, one bit per pixel, 8 bytes per row, most significant bit leftmost.
+// It is up to date when the reply arrives.
+
+#define ENV_PROTOCOL_VERSION 1
+#define ENV_SHM_MAGIC 0x43384556 // "C8EV"
+#define ENV_OBSERVATION_BYTES (64 * 32 / 8)
+// A minute of emulated time. The server runs one request at a time, so more
+// would hold up every other client.
+#define ENV_MAX_STEP_FRAMES 3600
+
+enum EnvCommand {
+    ENV_RESET = 1,
+    ENV_STEP = 2,
+};
+
+enum EnvStatus {
+    ENV_OK = 0,
+    ENV_BAD_COMMAND = 1,
+    // Environments out of range, or too many frames in a step
+    ENV_BAD_RANGE = 2,
+};
+
+#pragma pack(push, 1)
+
+struct EnvRequestHeader {
+    uint32_t command;
+    uint32_t first;
+    uint32_t count;
+};
+
+struct EnvReplyHeader {
+    uint32_t status;
+    uint32_t count;
+};
+
+// At the start of the shared memory object
+struct EnvShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t environments;
+    uint32_t observationBytes;
+};
+
+#pragma pack(pop)
+
+#endif // ENV_PROTOCOL_H
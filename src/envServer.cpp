@@ -0,0 +1,265 @@
+#include <iostream>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "envServer.h"
+#include "constants.h"
+
+using namespace std;
+
+static volatile sig_atomic_t stopping = 0;
+
+
+EnvServer::EnvServer(const EnvOptions &_options) {
+    options = _options;
+}
+
+EnvServer::~EnvServer() {
+    for (Chip8 *chip8 : environments) {
+        delete chip8;
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(options.socketPath);
+    }
+    if (shm != nullptr) {
+        munmap(shm, shmSize);
+    }
+    if (shmFd >= 0) {
+        close(shmFd);
+        shm_unlink(options.shmName);
+    }
+}
+
+bool EnvServer::open() {
+    // Load once, then every environment starts from a copy of the checkpoint
+    Chip8 *first = new Chip8();
+    environments.push_back(first);
+    if (!first->load(options.romPath)) {
+        return false;
+    }
+    first->checkpoint();
+    for (int i = 1; i < options.environments; i++) {
+        environments.push_back(new Chip8(*first));
+    }
+    episodeFrames.assign(options.environments, 0);
+    finished.assign(options.environments, false);
+
+    shmSize = sizeof(EnvShmHeader) + (size_t) options.environments * ENV_OBSERVATION_BYTES;
+    shmFd = shm_open(options.shmName, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (shmFd < 0 || ftruncate(shmFd, shmSize) != 0) {
+        cout << "Error creating shared memory " << options.shmName << ": " << strerror(errno) << endl;
+        return false;
+    }
+    shm = (uint8_t*) mmap(nullptr, shmSize, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+    if (shm == MAP_FAILED) {
+        shm = nullptr;
+        cout << "Error mapping shared memory: " << strerror(errno) << endl;
+        return false;
+    }
+    EnvShmHeader *header = (EnvShmHeader*) shm;
+    header->magic = ENV_SHM_MAGIC;
+    header->version = ENV_PROTOCOL_VERSION;
+    header->environments = options.environments;
+    header->observationBytes = ENV_OBSERVATION_BYTES;
+    for (int i = 0; i < options.environments; i++) {
+        writeObservation(i);
+    }
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(options.socketPath) >= sizeof(address.sun_path)) {
+        cout << "Socket path too long" << endl;
+        return false;
+    }
+    strcpy(address.sun_path, options.socketPath);
+    unlink(options.socketPath);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0
+            || bind(listenFd, (sockaddr*) &address, sizeof(address)) != 0
+            || listen(listenFd, 1) != 0) {
+        cout << "Error listening on " << options.socketPath << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    cout << "Serving " << dec << options.environments << " environments on " << options.socketPath
+        << ", observations in " << options.shmName << endl;
+    return true;
+}
+
+void EnvServer::stop() {
+    stopping = 1;
+}
+
+void EnvServer::run() {
+    while (!stopping) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            cout << "Error accepting client: " << strerror(errno) << endl;
+            return;
+        }
+        serve(fd);
+        close(fd);
+    }
+}
+
+void EnvServer::serve(int fd) {
+    EnvRequestHeader request;
+    while (readFully(fd, &request, sizeof(request))) {
+        bool ok;
+        if (request.first > environments.size() || request.count > environments.size() - request.first) {
+            // The payload length depends on the command, so the stream can't be
+            // resynchronised
+            reply(fd, ENV_BAD_RANGE, 0, vector<float>(), vector<uint8_t>());
+            return;
+        }
+        switch (request.command) {
+            case ENV_RESET:
+                ok = handleReset(fd, request.first, request.count);
+                break;
+            case ENV_STEP:
+                ok = handleStep(fd, request.first, request.count);
+                break;
+            default:
+                reply(fd, ENV_BAD_COMMAND, 0, vector<float>(), vector<uint8_t>());
+                return;
+        }
+        if (!ok) {
+            return;
+        }
+    }
+}
+
+bool EnvServer::handleReset(int fd, uint32_t first, uint32_t count) {
+    vector<uint32_t> seeds(count);
+    if (!readFully(fd, seeds.data(), count * sizeof(uint32_t))) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        int environment = first + i;
+        environments[environment]->resetToCheckpoint();
+        environments[environment]->seed(seeds[i]);
+        episodeFrames[environment] = 0;
+        finished[environment] = false;
+        writeObservation(environment);
+    }
+    return reply(fd, ENV_OK, count, vector<float>(count, 0), vector<uint8_t>(count, 0));
+}
+
+bool EnvServer::handleStep(int fd, uint32_t first, uint32_t count) {
+    vector<uint16_t> keyMasks(count);
+    uint32_t frames;
+    if (!readFully(fd, keyMasks.data(), count * sizeof(uint16_t)) || !readFully(fd, &frames, sizeof(frames))) {
+        return false;
+    }
+    if (frames > ENV_MAX_STEP_FRAMES) {
+        // The whole request has been read, so the client can carry on
+        return reply(fd, ENV_BAD_RANGE, 0, vector<float>(), vector<uint8_t>());
+    }
+
+    vector<float> rewards(count, 0);
+    vector<uint8_t> done(count, 0);
+    for (uint32_t i = 0; i < count; i++) {
+        int environment = first + i;
+        Chip8 *chip8 = environments[environment];
+        if (finished[environment]) {
+            // Stays done until the client resets it
+            done[i] = 1;
+            continue;
+        }
+
+        chip8->setKeys(keyMasks[i]);
+
+        uint64_t before = rewardValue(chip8);
+        for (uint32_t frame = 0; frame < frames && !finished[environment]; frame++) {
+            chip8->runFrame();
+            episodeFrames[environment]++;
+            // Halting ends the episode as well as faults, nothing would change after
+            finished[environment] = isDone(chip8, episodeFrames[environment]) || chip8->getStatus() != CHIP8_OK;
+        }
+        rewards[i] = (float) ((int64_t) rewardValue(chip8) - (int64_t) before);
+        done[i] = finished[environment];
+        writeObservation(environment);
+    }
+    return reply(fd, ENV_OK, count, rewards, done);
+}
+
+uint64_t EnvServer::rewardValue(Chip8 *chip8) {
+    uint64_t total = 0;
+    for (const RewardSpec &reward : options.rewards) {
+        uint64_t value = 0;
+        for (int i = 0; i < reward.bytes; i++) {
+            value = value << 8 | chip8->readMemory(reward.address + i);
+        }
+        total += value;
+    }
+    return total;
+}
+
+bool EnvServer::isDone(Chip8 *chip8, int frames) {
+    if (options.hasDone && chip8->readMemory(options.doneAddress) == options.doneValue) {
+        return true;
+    }
+    return options.maxFrames > 0 && frames >= options.maxFrames;
+}
+
+void EnvServer::writeObservation(int environment) {
+    environments[environment]->packDisplay(shm + sizeof(EnvShmHeader) + environment * ENV_OBSERVATION_BYTES);
+}
+
+bool EnvServer::reply(int fd, uint32_t status, uint32_t count, const vector<float> &rewards, const vector<uint8_t> &done) {
+    // One write per reply, the client is waiting on all of it
+    EnvReplyHeader header;
+    header.status = status;
+    header.count = count;
+    vector<uint8_t> message(sizeof(header) + count * (sizeof(float) + 1));
+    memcpy(message.data(), &header, sizeof(header));
+    if (count > 0) {
+        memcpy(message.data() + sizeof(header), rewards.data(), count * sizeof(float));
+        memcpy(message.data() + sizeof(header) + count * sizeof(float), done.data(), count);
+    }
+    return writeFully(fd, message.data(), message.size());
+}
+
+bool EnvServer::readFully(int fd, void *data, size_t size) {
+    uint8_t *bytes = (uint8_t*) data;
+    while (size > 0) {
+        ssize_t got = read(fd, bytes, size);
+        if (got < 0 && errno == EINTR && !stopping) {
+            continue;
+        }
+        if (got <= 0) {
+            return false;
+        }
+        bytes += got;
+        size -= got;
+    }
+    return true;
+}
+
+bool EnvServer::writeFully(int fd, const void *data, size_t size) {
+    const uint8_t *bytes = (const uint8_t*) data;
+    while (size > 0) {
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
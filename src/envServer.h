@@ -0,0 +1,72 @@
+#ifndef ENV_SERVER_H
+#define ENV_SERVER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "envProtocol.h"
+
+using namespace std;
+
+// Big-endian value of `bytes` bytes at `address`; the reward is how much
+// these values grew during a step.
+struct RewardSpec {
+    uint16_t address;
+    int bytes;
+};
+
+struct EnvOptions {
+    const char *romPath = nullptr;
+    int environments = 16;
+    const char *socketPath = "chip8-env.sock";
+    const char *shmName = "/chip8-env";
+
+    vector<RewardSpec> rewards;
+    // An episode ends when memory[doneAddress] == doneValue, when the machine
+    // hits an instruction it can't run, or after maxFrames frames.
+    bool hasDone = false;
+    uint16_t doneAddress = 0;
+    uint8_t doneValue = 0;
+    int maxFrames = 0; // 0 = no limit
+};
+
+// Hosts a batch of Chip8 instances behind a Unix socket for agent training.
+// See envProtocol.h for the wire format.
+class EnvServer {
+private:
+    EnvOptions options;
+    vector<Chip8*> environments;
+    vector<int> episodeFrames;
+    vector<bool> finished;
+
+    int listenFd = -1;
+    int shmFd = -1;
+    uint8_t *shm = nullptr;
+    size_t shmSize = 0;
+
+    uint64_t rewardValue(Chip8 *chip8);
+    bool isDone(Chip8 *chip8, int frames);
+    void writeObservation(int environment);
+
+    bool readFully(int fd, void *data, size_t size);
+    bool writeFully(int fd, const void *data, size_t size);
+    bool reply(int fd, uint32_t status, uint32_t count, const vector<float> &rewards, const vector<uint8_t> &done);
+
+    bool handleReset(int fd, uint32_t first, uint32_t count);
+    bool handleStep(int fd, uint32_t first, uint32_t count);
+    void serve(int fd);
+
+public:
+    EnvServer(const EnvOptions &_options);
+    ~EnvServer();
+
+    bool open();
+    // Serves clients one at a time until stop() is called
+    void run();
+    // Safe to call from a signal handler
+    static void stop();
+};
+
+#endif // ENV_SERVER_H
@@ -0,0 +1,101 @@
+#include <map>
+#include <mutex>
+
+#include "executionBackend.h"
+#include "debugger.h"
+
+
+namespace {
+
+class ReferenceBackend : public ExecutionBackend {
+public:
+    const char *name() override {
+        return "reference";
+    }
+
+    int run(Chip8 &chip8, int count) override {
+        for (int i = 0; i < count; i++) {
+            if (chip8.isBlocked()) {
+                return i;
+            }
+            chip8.step();
+        }
+        return count;
+    }
+};
+
+// The batch dispatch loop used by the window and headless runs
+class DispatchBackend : public ExecutionBackend {
+public:
+    const char *name() override {
+        return "runInstructions";
+    }
+
+    int run(Chip8 &chip8, int count) override {
+        return chip8.runInstructions(count);
+    }
+};
+
+// The debugger's instrumented dispatch, armed with a condition that never
+// fires, so every instruction goes through its checks without stopping. Each
+// machine gets its debugger in attach(), which installs it as the machine's
+// dispatch until detach().
+class ArmedDebuggerBackend : public ExecutionBackend {
+private:
+    mutex debuggersMutex;
+    map<Chip8*, Debugger*> debuggers;
+
+public:
+    ~ArmedDebuggerBackend() {
+        for (auto &entry : debuggers) {
+            delete entry.second;
+        }
+    }
+
+    const char *name() override {
+        return "armedDebugger";
+    }
+
+    void attach(Chip8 &chip8) override {
+        Debugger *debugger = new Debugger(&chip8);
+        debugger->addStopCondition("I > 0xFFFF");
+        lock_guard<mutex> lock(debuggersMutex);
+        delete debuggers[&chip8];
+        debuggers[&chip8] = debugger;
+    }
+
+    void detach(Chip8 &chip8) override {
+        Debugger *debugger = nullptr;
+        {
+            lock_guard<mutex> lock(debuggersMutex);
+            auto found = debuggers.find(&chip8);
+            if (found != debuggers.end()) {
+                debugger = found->second;
+                debuggers.erase(found);
+            }
+        }
+        delete debugger;
+    }
+
+    int run(Chip8 &chip8, int count) override {
+        return chip8.runInstructions(count);
+    }
+};
+
+}
+
+
+ExecutionBackend* referenceBackend() {
+    static ReferenceBackend reference;
+    return &reference;
+}
+
+// Compiled ROMs (chip8-aot) aren't here: every program would need a C++
+// compiler run, and a random starting state can't be loaded as a ROM. They are
+// checked one ROM at a time by chip8-aot --verify instead.
+const vector<ExecutionBackend*> &alternativeBackends() {
+    static DispatchBackend dispatch;
+    static ArmedDebuggerBackend armedDebugger;
+    static const vector<ExecutionBackend*> backends = { &dispatch, &armedDebugger };
+    return backends;
+}
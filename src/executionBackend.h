@@ -0,0 +1,33 @@
+#ifndef EXECUTION_BACKEND_H
+#define EXECUTION_BACKEND_H
+
+#include <vector>
+
+#include "chip8.h"
+
+using namespace std;
+
+// A way of executing instructions on a Chip8. Every alternative backend must
+// leave the machine in exactly the state the reference backend would after
+// the same number of instructions; test/differentialTest.cpp checks this.
+class ExecutionBackend {
+public:
+    virtual ~ExecutionBackend() {}
+
+    virtual const char *name() = 0;
+    // Called once before a machine's first run() and once after its last,
+    // for backends that set something up per machine
+    virtual void attach(Chip8 &) {}
+    virtual void detach(Chip8 &) {}
+    // Returns how many instructions ran, fewer than `count` only when the
+    // machine blocks waiting for a key or a debugger stops it
+    virtual int run(Chip8 &chip8, int count) = 0;
+};
+
+// One instruction at a time through Chip8::step() and handleOpcode()
+ExecutionBackend* referenceBackend();
+
+// Everything else that executes instructions, compared against the reference
+const vector<ExecutionBackend*> &alternativeBackends();
+
+#endif // EXECUTION_BACKEND_H
@@ -0,0 +1,81 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include "stateExplorer.h"
+
+using namespace std;
+
+
+void usage() {
+    cout << "Usage: ./chip8-explore [options] <rom>" << endl;
+    cout << "  --inputs <masks>    comma-separated hex key masks tried from each state" << endl;
+    cout << "                      (default: no keys, then each of the 16 keys alone)" << endl;
+    cout << "  --frames <n>        frames each input is held for (default 1)" << endl;
+    cout << "  --max-states <n>    stop after this many distinct states (default 1000000)" << endl;
+    cout << "  --max-depth <n>     stop after this many steps (default: no limit)" << endl;
+    cout << "  --frontier <n>      states expanded per step, the rest are dropped (default 20000)" << endl;
+    cout << "  --bfs               drop states in breadth-first order, not old screens first" << endl;
+    cout << "  --seed <n>          random seed (default 1)" << endl;
+    cout << "  --threads <n>       worker threads (default: one per core)" << endl;
+    cout << "  --screens <path>    write every distinct screen and the inputs reaching it" << endl;
+}
+
+bool parseInputs(const char *list, vector<uint16_t> &inputs) {
+    inputs.clear();
+    const char *at = list;
+    while (*at != '\0') {
+        char *end;
+        unsigned long mask = strtoul(at, &end, 16);
+        if (end == at || mask > 0xFFFF || (*end != ',' && *end != '\0')) {
+            return false;
+        }
+        inputs.push_back((uint16_t) mask);
+        at = *end == ',' ? end + 1 : end;
+    }
+    return !inputs.empty();
+}
+
+int main(int argc, char *argv[]) {
+    ExplorerOptions options;
+    const char *rom = nullptr;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--inputs") == 0 && hasValue) {
+            if (!parseInputs(argv[++i], options.inputs)) {
+                cout << "Bad input masks: " << argv[i] << endl;
+                return 1;
+            }
+        } else if (strcmp(arg, "--frames") == 0 && hasValue) {
+            options.framesPerStep = atoi(argv[++i]);
+        } else if (strcmp(arg, "--max-states") == 0 && hasValue) {
+            options.maxStates = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "--max-depth") == 0 && hasValue) {
+            options.maxDepth = atoi(argv[++i]);
+        } else if (strcmp(arg, "--frontier") == 0 && hasValue) {
+            options.maxFrontier = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "--bfs") == 0) {
+            options.noveltyFirst = false;
+        } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+            options.seed = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "--threads") == 0 && hasValue) {
+            options.threads = atoi(argv[++i]);
+        } else if (strcmp(arg, "--screens") == 0 && hasValue) {
+            options.screensPath = argv[++i];
+        } else if (arg[0] == '-' || rom != nullptr) {
+            cout << "Unknown option: " << arg << endl;
+            usage();
+            return 1;
+        } else {
+            rom = arg;
+        }
+    }
+    if (rom == nullptr) {
+        usage();
+        return 1;
+    }
+
+    StateExplorer explorer(options);
+    return explorer.run(rom) ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+#include <iostream>
+#include <cstring>
+#include <string>
+
+#include "frameCapture.h"
+#include "gifEncoder.h"
+#include "y4mEncoder.h"
+
+using namespace std;
+
+
+FrameCapture::FrameCapture(bool _blockWhenFull) {
+    encoder = nullptr;
+    queue = nullptr;
+    blockWhenFull = _blockWhenFull;
+    stopping = false;
+    hasQueued = false;
+    lastFrameNumber = 0;
+    droppedFrames = 0;
+}
+
+FrameCapture::~FrameCapture() {
+    this->close();
+}
+
+bool FrameCapture::open(const char *path, int scale) {
+    string name(path);
+    string extension = name.substr(name.find_last_of('.') + 1);
+    if (extension == "gif") {
+        encoder = new GifEncoder();
+    } else if (extension == "y4m") {
+        encoder = new Y4mEncoder();
+    } else {
+        cout << "Capture file must end in .gif or .y4m: " << path << endl;
+        return false;
+    }
+    if (!encoder->open(path, scale)) {
+        delete encoder;
+        encoder = nullptr;
+        return false;
+    }
+
+    queue = new SpscRing<CapturedFrame, CAPTURE_QUEUE_FRAMES>();
+    stopping = false;
+    encoderThread = thread(&FrameCapture::encodeLoop, this);
+    return true;
+}
+
+void FrameCapture::capture(const uint8_t *displayBuffer, uint64_t frameNumber) {
+    if (queue == nullptr) {
+        return;
+    }
+    lastFrameNumber = frameNumber;
+    if (hasQueued && memcmp(lastQueued.display, displayBuffer, sizeof(lastQueued.display)) == 0) {
+        return;
+    }
+
+    CapturedFrame frame;
+    frame.frameNumber = frameNumber;
+    memcpy(frame.display, displayBuffer, sizeof(frame.display));
+    if (!queue->push(frame)) {
+        if (!blockWhenFull) {
+            droppedFrames++;
+            return;
+        }
+        unique_lock<mutex> lock(wakeMutex);
+        frameTaken.wait(lock, [&] { return queue->push(frame); });
+    }
+    lastQueued = frame;
+    hasQueued = true;
+    this->wake(frameQueued);
+}
+
+// Taking the lock first means the other side is either still about to check
+// the queue or already waiting, so the notification can't be missed
+void FrameCapture::wake(condition_variable &condition) {
+    {
+        lock_guard<mutex> lock(wakeMutex);
+    }
+    condition.notify_one();
+}
+
+// Each frame is written once the next one arrives, since only then is its
+// duration known.
+void FrameCapture::encodeLoop() {
+    CapturedFrame pending;
+    CapturedFrame next;
+    bool hasPending = false;
+
+    while (true) {
+        if (queue->pop(next)) {
+            this->wake(frameTaken);
+            if (hasPending) {
+                encoder->writeFrame(pending.display, next.frameNumber - pending.frameNumber);
+            }
+            pending = next;
+            hasPending = true;
+            continue;
+        }
+        unique_lock<mutex> lock(wakeMutex);
+        if (stopping && queue->empty()) {
+            break;
+        }
+        frameQueued.wait(lock, [this] { return stopping || !queue->empty(); });
+    }
+
+    if (hasPending) {
+        encoder->writeFrame(pending.display, lastFrameNumber + 1 - pending.frameNumber);
+    }
+}
+
+void FrameCapture::close() {
+    if (encoder == nullptr) {
+        return;
+    }
+    stopping = true;
+    this->wake(frameQueued);
+    encoderThread.join();
+    encoder->close();
+    if (droppedFrames > 0) {
+        cout << "Capture dropped " << droppedFrames << " frames, the encoder fell behind" << endl;
+    }
+
+    delete encoder;
+    delete queue;
+    encoder = nullptr;
+    queue = nullptr;
+}
@@ -0,0 +1,61 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "constants.h"
+#include "frameEncoder.h"
+#include "spscRing.h"
+
+using namespace std;
+
+const int CAPTURE_QUEUE_FRAMES = 128;
+
+struct CapturedFrame {
+    uint64_t frameNumber;
+    uint8_t display[DISPLAY_BYTES];
+};
+
+// Records the display once per emulated frame and encodes it on a background
+// thread. Frames identical to the previous one are merged before queueing.
+// The queue is a fixed ring, so memory stays bounded on long runs. If the
+// encoder falls behind, a headless run waits for it, while the window drops
+// frames rather than stalling emulation and the previous frame simply stays on
+// screen longer.
+class FrameCapture {
+private:
+    FrameEncoder* encoder;
+    SpscRing<CapturedFrame, CAPTURE_QUEUE_FRAMES>* queue;
+    bool blockWhenFull;
+    thread encoderThread;
+    atomic<bool> stopping;
+    // Only held to sleep and to wake the other side, never while encoding
+    mutex wakeMutex;
+    condition_variable frameQueued;
+    condition_variable frameTaken;
+
+    // Producer side
+    CapturedFrame lastQueued;
+    bool hasQueued;
+    uint64_t lastFrameNumber;
+    uint64_t droppedFrames;
+
+    void encodeLoop();
+    void wake(condition_variable &condition);
+
+public:
+    // Without blockWhenFull, frames that don't fit in the queue are dropped
+    FrameCapture(bool _blockWhenFull);
+    ~FrameCapture();
+
+    // Picks GIF or Y4M from the file extension
+    bool open(const char *path, int scale);
+    void capture(const uint8_t *displayBuffer, uint64_t frameNumber);
+    void close();
+};
+
+#endif // FRAME_CAPTURE_H
@@ -0,0 +1,18 @@
+#ifndef FRAME_ENCODER_H
+#define FRAME_ENCODER_H
+
+#include <stdint.h>
+
+// Output format for FrameCapture. Frames arrive in order as packed displays
+// (see displayPixel()), each with the number of emulated frames it stays on
+// screen.
+class FrameEncoder {
+public:
+    virtual ~FrameEncoder() {}
+
+    virtual bool open(const char *path, int scale) = 0;
+    virtual void writeFrame(const uint8_t *display, int durationFrames) = 0;
+    virtual void close() = 0;
+};
+
+#endif // FRAME_ENCODER_H
@@ -0,0 +1,180 @@
+#include <iostream>
+#include <cstring>
+
+#include "constants.h"
+#include "gifEncoder.h"
+
+using namespace std;
+
+
+namespace {
+
+const int MIN_CODE_SIZE = 2; // smallest LZW code size GIF allows
+const int CLEAR_CODE = 1 << MIN_CODE_SIZE;
+const int END_CODE = CLEAR_CODE + 1;
+
+}
+
+
+GifEncoder::GifEncoder() {
+    scale = 1;
+    width = DISPLAY_WIDTH;
+    height = DISPLAY_HEIGHT;
+    elapsedFrames = 0;
+    writtenCentiseconds = 0;
+}
+
+void GifEncoder::writeWord(uint16_t value) {
+    file.put((char) (value & 0xFF));
+    file.put((char) (value >> 8));
+}
+
+bool GifEncoder::open(const char *path, int _scale) {
+    scale = _scale;
+    width = DISPLAY_WIDTH * scale;
+    height = DISPLAY_HEIGHT * scale;
+    elapsedFrames = 0;
+    writtenCentiseconds = 0;
+
+    file.open(path, ios::out | ios::binary | ios::trunc);
+    if (!file) {
+        cout << "Error opening capture file: " << path << endl;
+        return false;
+    }
+
+    file.write("GIF89a", 6);
+    this->writeWord(width);
+    this->writeWord(height);
+    file.put((char) 0x80); // global colour table of 2 entries
+    file.put(0);           // background colour index
+    file.put(0);           // square pixels
+
+    // Palette: off, then on, matching the window's colours
+    file.put(0); file.put(0); file.put(0);
+    file.put((char) ((PIXEL_COLOR >> 24) & 0xFF));
+    file.put((char) ((PIXEL_COLOR >> 16) & 0xFF));
+    file.put((char) ((PIXEL_COLOR >> 8) & 0xFF));
+
+    // Loop forever
+    file.write("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+    return true;
+}
+
+void GifEncoder::writeFrame(const uint8_t *display, int durationFrames) {
+    elapsedFrames += durationFrames;
+    uint64_t endCentiseconds = (elapsedFrames * 100 + FRAMES_PER_SECOND / 2) / FRAMES_PER_SECOND;
+    uint64_t delay = endCentiseconds - writtenCentiseconds;
+    writtenCentiseconds = endCentiseconds;
+
+    // Graphic control extension, GIF delays are 16-bit
+    file.write("\x21\xF9\x04\x00", 4);
+    this->writeWord(delay > 0xFFFF ? 0xFFFF : (uint16_t) delay);
+    file.put(0);
+    file.put(0);
+
+    // Image descriptor covering the whole screen, no local palette
+    file.put(0x2C);
+    this->writeWord(0);
+    this->writeWord(0);
+    this->writeWord(width);
+    this->writeWord(height);
+    file.put(0);
+
+    this->compress(display);
+}
+
+void GifEncoder::resetTable() {
+    for (int i = 0; i < TABLE_SIZE; i++) {
+        tableKeys[i] = -1;
+    }
+    nextCode = END_CODE + 1;
+    codeSize = MIN_CODE_SIZE + 1;
+}
+
+void GifEncoder::flushBlock() {
+    if (blockSize > 0) {
+        file.put((char) blockSize);
+        file.write((const char *) block, blockSize);
+        blockSize = 0;
+    }
+}
+
+void GifEncoder::emitCode(int code) {
+    bitBuffer |= (uint32_t) code << bitCount;
+    bitCount += codeSize;
+    while (bitCount >= 8) {
+        block[blockSize++] = bitBuffer & 0xFF;
+        bitBuffer >>= 8;
+        bitCount -= 8;
+        if (blockSize == 255) {
+            this->flushBlock();
+        }
+    }
+}
+
+void GifEncoder::compress(const uint8_t *display) {
+    file.put(MIN_CODE_SIZE);
+    bitBuffer = 0;
+    bitCount = 0;
+    blockSize = 0;
+    this->resetTable();
+    this->emitCode(CLEAR_CODE);
+
+    int prefix = -1;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int pixel = displayPixel(display, x / scale, y / scale) ? 1 : 0;
+            if (prefix < 0) {
+                prefix = pixel;
+                continue;
+            }
+
+            // Open addressing on (prefix, pixel)
+            int32_t key = (prefix << 8) | pixel;
+            int slot = (key * 31) % TABLE_SIZE;
+            while (tableKeys[slot] != -1 && tableKeys[slot] != key) {
+                slot = (slot + 1) % TABLE_SIZE;
+            }
+            if (tableKeys[slot] == key) {
+                prefix = tableCodes[slot];
+                continue;
+            }
+
+            this->emitCode(prefix);
+            if (nextCode < MAX_CODES) {
+                tableKeys[slot] = key;
+                tableCodes[slot] = nextCode;
+                // The decoder grows its code size one code later than us
+                if (nextCode == (1 << codeSize)) {
+                    codeSize++;
+                }
+                nextCode++;
+            } else {
+                this->emitCode(CLEAR_CODE);
+                this->resetTable();
+            }
+            prefix = pixel;
+        }
+    }
+
+    this->emitCode(prefix);
+    this->emitCode(END_CODE);
+    if (bitCount > 0) {
+        block[blockSize++] = bitBuffer & 0xFF;
+        bitBuffer = 0;
+        bitCount = 0;
+        if (blockSize == 255) {
+            this->flushBlock();
+        }
+    }
+    this->flushBlock();
+    file.put(0); // block terminator
+}
+
+void GifEncoder::close() {
+    if (!file.is_open()) {
+        return;
+    }
+    file.put(0x3B);
+    file.close();
+}
@@ -0,0 +1,51 @@
+#ifndef GIF_ENCODER_H
+#define GIF_ENCODER_H
+
+#include <stdint.h>
+#include <fstream>
+
+#include "frameEncoder.h"
+
+using namespace std;
+
+// Animated GIF with a two colour palette. Pixels are LZW compressed as they
+// are produced, so nothing larger than one 255 byte sub-block is buffered.
+class GifEncoder : public FrameEncoder {
+private:
+    ofstream file;
+    int scale;
+    int width;
+    int height;
+
+    // GIF delays are in 1/100s, emulated frames are 1/60s. Track the total
+    // so rounding never drifts.
+    uint64_t elapsedFrames;
+    uint64_t writtenCentiseconds;
+
+    // LZW state
+    static const int MAX_CODES = 4096;
+    static const int TABLE_SIZE = 5003;
+    int32_t tableKeys[TABLE_SIZE];
+    uint16_t tableCodes[TABLE_SIZE];
+    int nextCode;
+    int codeSize;
+    uint32_t bitBuffer;
+    int bitCount;
+    uint8_t block[255];
+    int blockSize;
+
+    void writeWord(uint16_t value);
+    void resetTable();
+    void emitCode(int code);
+    void flushBlock();
+    void compress(const uint8_t *display);
+
+public:
+    GifEncoder();
+
+    bool open(const char *path, int _scale) override;
+    void writeFrame(const uint8_t *display, int durationFrames) override;
+    void close() override;
+};
+
+#endif // GIF_ENCODER_H
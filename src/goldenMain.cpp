@@ -0,0 +1,61 @@
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#include "goldenRunner.h"
+
+using namespace std;
+
+
+void usage() {
+    cout << "Usage: ./chip8-golden [options] <rom>..." << endl;
+    cout << "  --update            record golden files instead of checking them" << endl;
+    cout << "  --frames <n>        frames to run per ROM (default 600)" << endl;
+    cout << "  --seed <n>          random seed (default 1)" << endl;
+    cout << "  --registers         hash registers as well as the display" << endl;
+    cout << "  --threads <n>       worker threads (default: one per core)" << endl;
+    cout << "  --golden-dir <dir>  where golden files live (default: next to each ROM)" << endl;
+    cout << "  --dump-dir <dir>    where mismatching frames are written" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    GoldenOptions options;
+    vector<string> roms;
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (strcmp(arg, "--update") == 0) {
+            options.update = true;
+        } else if (strcmp(arg, "--frames") == 0 && hasValue) {
+            options.frames = atoi(argv[++i]);
+        } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+            options.seed = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "--registers") == 0) {
+            options.includeRegisters = true;
+        } else if (strcmp(arg, "--threads") == 0 && hasValue) {
+            options.threads = atoi(argv[++i]);
+        } else if (strcmp(arg, "--golden-dir") == 0 && hasValue) {
+            options.goldenDir = argv[++i];
+        } else if (strcmp(arg, "--dump-dir") == 0 && hasValue) {
+            options.dumpDir = argv[++i];
+        } else if (arg[0] == '-') {
+            cout << "Unknown option: " << arg << endl;
+            usage();
+            return 1;
+        } else {
+            roms.push_back(arg);
+        }
+    }
+    if (roms.empty()) {
+        usage();
+        return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    GoldenRunner runner(options, roms);
+    bool passed = runner.run();
+    auto elapsed = chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start);
+    cout << "Finished in " << dec << elapsed.count() << "ms" << endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+#include <iostream>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <thread>
+
+#include "chip8.h"
+#include "constants.h"
+#include "goldenRunner.h"
+#include "inputScript.h"
+
+using namespace std;
+
+
+namespace {
+
+string baseName(const string &path) {
+    size_t slash = path.find_last_of('/');
+    return slash == string::npos ? path : path.substr(slash + 1);
+}
+
+bool fileExists(const string &path) {
+    struct stat fileStat;
+    return stat(path.c_str(), &fileStat) == 0;
+}
+
+bool writePbm(const string &path, const uint8_t *display) {
+    ofstream out(path.c_str());
+    out << "P1\n" << DISPLAY_WIDTH << " " << DISPLAY_HEIGHT << "\n";
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            out << (displayPixel(display, x, y) ? '1' : '0');
+        }
+        out << "\n";
+    }
+    return (bool) out;
+}
+
+}
+
+
+GoldenRunner::GoldenRunner(const GoldenOptions &_options, const vector<string> &_roms) : nextRom(0) {
+    options = _options;
+    roms = _roms;
+}
+
+string GoldenRunner::goldenPath(const string &romPath) {
+    if (options.goldenDir == nullptr) {
+        return romPath + ".golden";
+    }
+    return string(options.goldenDir) + "/" + baseName(romPath) + ".golden";
+}
+
+string GoldenRunner::dumpPath(const string &romPath, int frame) {
+    string name = baseName(romPath) + ".frame" + to_string(frame) + ".pbm";
+    if (options.dumpDir == nullptr) {
+        string golden = this->goldenPath(romPath);
+        size_t slash = golden.find_last_of('/');
+        return slash == string::npos ? name : golden.substr(0, slash + 1) + name;
+    }
+    return string(options.dumpDir) + "/" + name;
+}
+
+// Golden files are only comparable when recorded with the same settings
+string GoldenRunner::header() {
+    return "# chip8 golden frames=" + to_string(options.frames)
+        + " seed=" + to_string(options.seed)
+        + " registers=" + (options.includeRegisters ? "1" : "0")
+        + " instructions_per_frame=" + to_string(INSTRUCTIONS_PER_FRAME);
+}
+
+GoldenResult GoldenRunner::check(const string &romPath) {
+    GoldenResult result = { false, "" };
+
+    // Expected hashes, and the frame the ROM stopped on (-1 if it ran to the end)
+    vector<uint64_t> expected;
+    int expectedStop = -1;
+    string golden = this->goldenPath(romPath);
+    if (!options.update) {
+        ifstream goldenFile(golden.c_str());
+        string line;
+        if (!goldenFile || !getline(goldenFile, line)) {
+            result.message = "no golden file " + golden + " (record it with --update)";
+            return result;
+        }
+        if (line != this->header()) {
+            result.message = "golden file recorded with different settings: " + line;
+            return result;
+        }
+        // Line 1 is the header
+        int lineNumber = 1;
+        while (getline(goldenFile, line)) {
+            lineNumber++;
+            if (line.empty()) {
+                continue;
+            }
+            bool stopLine = line.compare(0, 8, "stopped ") == 0;
+            const char *text = line.c_str() + (stopLine ? 8 : 0);
+            char *end;
+            errno = 0;
+            unsigned long long value = strtoull(text, &end, stopLine ? 10 : 16);
+            if (!isxdigit((unsigned char) *text) || *end != '\0' || errno != 0 || (stopLine && value > INT_MAX)) {
+                result.message = "bad golden file line " + to_string(lineNumber) + " in " + golden;
+                return result;
+            }
+            if (stopLine) {
+                expectedStop = (int) value;
+            } else {
+                expected.push_back(value);
+            }
+        }
+    }
+
+    Chip8 chip8 = Chip8();
+    if (!chip8.load(romPath.c_str())) {
+        result.message = "could not load ROM";
+        return result;
+    }
+    chip8.seed(options.seed);
+
+    InputScript script;
+    string scriptPath = romPath + ".input";
+    if (fileExists(scriptPath) && !script.load(scriptPath.c_str())) {
+        result.message = "bad input script " + scriptPath;
+        return result;
+    }
+
+    vector<uint64_t> hashes;
+    int stoppedAt = -1;
+    for (int frame = 0; frame < options.frames; frame++) {
+        script.apply(&chip8, frame);
+        chip8.runFrame();
+        if (chip8.isFaulted()) {
+            stoppedAt = frame;
+            break;
+        }
+
+        uint64_t hash = chip8.frameHash(options.includeRegisters);
+        if (options.update) {
+            hashes.push_back(hash);
+        } else if ((size_t) frame >= expected.size() || hash != expected[frame]) {
+            string dump = this->dumpPath(romPath, frame);
+            writePbm(dump, chip8.displayBuffer);
+            result.message = "first mismatch at frame " + to_string(frame) + ", dumped to " + dump;
+            return result;
+        }
+    }
+
+    if (options.update) {
+        ofstream goldenFile(golden.c_str(), ios::out | ios::trunc);
+        goldenFile << this->header() << "\n";
+        char hex[32];
+        for (uint64_t hash : hashes) {
+            snprintf(hex, sizeof(hex), "%016llx", (unsigned long long) hash);
+            goldenFile << hex << "\n";
+        }
+        if (stoppedAt >= 0) {
+            goldenFile << "stopped " << stoppedAt << "\n";
+        }
+        if (!goldenFile) {
+            result.message = "could not write " + golden;
+            return result;
+        }
+        result.passed = true;
+        result.message = "recorded " + to_string(hashes.size()) + " frames";
+        return result;
+    }
+
+    if (stoppedAt != expectedStop) {
+        result.message = stoppedAt >= 0
+            ? "stopped on an unhandled opcode at frame " + to_string(stoppedAt)
+            : "ran past frame " + to_string(expectedStop) + ", where the golden run stopped";
+        return result;
+    }
+    result.passed = true;
+    return result;
+}
+
+void GoldenRunner::worker() {
+    while (true) {
+        size_t index = nextRom++;
+        if (index >= roms.size()) {
+            return;
+        }
+        results[index] = this->check(roms[index]);
+    }
+}
+
+bool GoldenRunner::run() {
+    results.assign(roms.size(), GoldenResult());
+    nextRom = 0;
+
+    int threadCount = options.threads > 0 ? options.threads : (int) thread::hardware_concurrency();
+    threadCount = max(1, min(threadCount, (int) roms.size()));
+    vector<thread> threads;
+    for (int i = 0; i < threadCount; i++) {
+        threads.push_back(thread(&GoldenRunner::worker, this));
+    }
+    for (thread &t : threads) {
+        t.join();
+    }
+
+    int failures = 0;
+    for (size_t i = 0; i < roms.size(); i++) {
+        const GoldenResult &result = results[i];
+        cout << dec << (result.passed ? "PASS " : "FAIL ") << roms[i];
+        if (!result.message.empty()) {
+            cout << ": " << result.message;
+        }
+        cout << endl;
+        failures += result.passed ? 0 : 1;
+    }
+    cout << dec << roms.size() - failures << "/" << roms.size() << " ROMs passed" << endl;
+    return failures == 0;
+}
@@ -0,0 +1,54 @@
+#ifndef GOLDEN_RUNNER_H
+#define GOLDEN_RUNNER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct GoldenOptions {
+    int frames = 600;
+    uint32_t seed = 1;
+    bool includeRegisters = false;
+
+    // Rewrite the golden files instead of checking them
+    bool update = false;
+    int threads = 0; // 0 = one per core
+
+    // Defaults to next to each ROM
+    const char *goldenDir = nullptr;
+    const char *dumpDir = nullptr;
+};
+
+struct GoldenResult {
+    bool passed;
+    string message;
+};
+
+// Runs every ROM for a fixed number of frames with a fixed seed and its
+// input script (<rom>.input, if present), hashing the display after every
+// frame, and compares the hashes against <rom>.golden. ROMs run in parallel.
+class GoldenRunner {
+private:
+    GoldenOptions options;
+    vector<string> roms;
+    vector<GoldenResult> results;
+    atomic<size_t> nextRom;
+
+    string goldenPath(const string &romPath);
+    string dumpPath(const string &romPath, int frame);
+    string header();
+
+    void worker();
+    GoldenResult check(const string &romPath);
+
+public:
+    GoldenRunner(const GoldenOptions &_options, const vector<string> &_roms);
+
+    // Returns true if every ROM passed
+    bool run();
+};
+
+#endif // GOLDEN_RUNNER_H
@@ -0,0 +1,50 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const uint64_t FNV_OFFSET_BASIS = 0xcbf29ce484222325ULL;
+const uint64_t FNV_PRIME = 0x100000001b3ULL;
+
+// 64-bit FNV-1a, used to identify ROM images and machine states.
+// `seed` allows hashing several buffers into one value.
+inline uint64_t fnv1a64(const void *data, size_t size, uint64_t seed = FNV_OFFSET_BASIS) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+inline uint64_t mix64(uint64_t value) {
+    value ^= value >> 33;
+    value *= 0xff51afd7ed558ccdULL;
+    value ^= value >> 33;
+    value *= 0xc4ceb9fe1a85ec53ULL;
+    value ^= value >> 33;
+    return value;
+}
+
+// Hashes eight bytes at a time, for buffers hashed every frame. Values depend
+// on host byte order, so only compare them between little-endian hosts.
+inline uint64_t fastHash64(const void *data, size_t size, uint64_t seed = 0) {
+    const uint8_t *bytes = (const uint8_t *) data;
+    uint64_t hash = seed ^ (size * 0x9E3779B97F4A7C15ULL);
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        hash = (hash ^ (word * 0x87c37b91114253d5ULL)) * 0x4cf5ad432745937fULL;
+        hash ^= hash >> 31;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + i, size - i);
+    hash ^= tail;
+    return mix64(hash);
+}
+
+#endif // HASH_H
@@ -0,0 +1,162 @@
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <string>
+
+#include "inputMapper.h"
+
+using namespace std;
+
+
+InputMapper::InputMapper() {
+    this->loadDefaults();
+}
+
+InputMapper::~InputMapper() {
+    for (SDL_GameController* controller : controllers) {
+        SDL_GameControllerClose(controller);
+    }
+}
+
+void InputMapper::clear() {
+    for (int i = 0; i < SDL_NUM_SCANCODES; i++) {
+        scancodeKeys[i] = NO_KEY;
+    }
+    for (int i = 0; i < SDL_CONTROLLER_BUTTON_MAX; i++) {
+        buttonKeys[i] = NO_KEY;
+    }
+}
+
+void InputMapper::loadDefaults() {
+    this->clear();
+
+    // Scancodes are layout independent, so this is the same 4x4 block of
+    // physical keys on any keyboard.
+    const SDL_Scancode keyboard[16] = {
+        SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3, SDL_SCANCODE_4,
+        SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_R,
+        SDL_SCANCODE_A, SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_F,
+        SDL_SCANCODE_Z, SDL_SCANCODE_X, SDL_SCANCODE_C, SDL_SCANCODE_V,
+    };
+    for (int key = 0; key < 16; key++) {
+        scancodeKeys[keyboard[key]] = key;
+    }
+
+    // Most ROMs move with 2/4/6/8 and act with 5
+    buttonKeys[SDL_CONTROLLER_BUTTON_DPAD_UP] = 0x2;
+    buttonKeys[SDL_CONTROLLER_BUTTON_DPAD_LEFT] = 0x4;
+    buttonKeys[SDL_CONTROLLER_BUTTON_DPAD_RIGHT] = 0x6;
+    buttonKeys[SDL_CONTROLLER_BUTTON_DPAD_DOWN] = 0x8;
+    buttonKeys[SDL_CONTROLLER_BUTTON_A] = 0x5;
+    buttonKeys[SDL_CONTROLLER_BUTTON_B] = 0x0;
+    buttonKeys[SDL_CONTROLLER_BUTTON_START] = 0xF;
+}
+
+// Config lines look like `<hex key> <SDL scancode name>` or
+// `<hex key> button:<SDL controller button name>`, e.g.
+//     5 Space
+//     5 button:a
+// Lines starting with # are ignored. Keys not listed are unmapped.
+bool InputMapper::loadConfig(const char *path) {
+    ifstream config(path);
+    if (!config) {
+        cout << "Error reading keymap: " << path << endl;
+        return false;
+    }
+
+    this->clear();
+    string line;
+    int lineNumber = 0;
+    while (getline(config, line)) {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string::npos || line[start] == '#') {
+            continue;
+        }
+
+        size_t split = line.find_first_of(" \t", start);
+        size_t nameStart = split == string::npos ? string::npos : line.find_first_not_of(" \t", split);
+        if (nameStart == string::npos) {
+            cout << "Bad keymap line " << lineNumber << ": " << line << endl;
+            return false;
+        }
+        string keyToken = line.substr(start, split - start);
+        char *keyEnd;
+        long key = strtol(keyToken.c_str(), &keyEnd, 16);
+        string name = line.substr(nameStart, line.find_last_not_of(" \t\r") + 1 - nameStart);
+        // The whole token has to be hex, so "G" or "x" isn't taken as key 0
+        if (*keyEnd != '\0' || key < 0 || key > 0xF) {
+            cout << "Bad keypad key on keymap line " << lineNumber << endl;
+            return false;
+        }
+
+        if (name.compare(0, 7, "button:") == 0) {
+            SDL_GameControllerButton button = SDL_GameControllerGetButtonFromString(name.c_str() + 7);
+            if (button == SDL_CONTROLLER_BUTTON_INVALID) {
+                cout << "Unknown controller button on keymap line " << lineNumber << endl;
+                return false;
+            }
+            buttonKeys[button] = key;
+        } else {
+            SDL_Scancode scancode = SDL_GetScancodeFromName(name.c_str());
+            if (scancode == SDL_SCANCODE_UNKNOWN) {
+                cout << "Unknown key on keymap line " << lineNumber << endl;
+                return false;
+            }
+            scancodeKeys[scancode] = key;
+        }
+    }
+    return true;
+}
+
+bool InputMapper::translate(const SDL_Event &e, int &key, bool &down) {
+    uint8_t mapped = NO_KEY;
+    switch (e.type) {
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+            // Held keys repeat, the keypad only cares about the first press
+            if (e.key.repeat) {
+                return false;
+            }
+            mapped = scancodeKeys[e.key.keysym.scancode];
+            down = e.type == SDL_KEYDOWN;
+            break;
+        case SDL_CONTROLLERBUTTONDOWN:
+        case SDL_CONTROLLERBUTTONUP:
+            if (e.cbutton.button < SDL_CONTROLLER_BUTTON_MAX) {
+                mapped = buttonKeys[e.cbutton.button];
+            }
+            down = e.type == SDL_CONTROLLERBUTTONDOWN;
+            break;
+    }
+    if (mapped == NO_KEY) {
+        return false;
+    }
+    key = mapped;
+    return true;
+}
+
+void InputMapper::handleDeviceEvent(const SDL_Event &e) {
+    if (e.type == SDL_CONTROLLERDEVICEREMOVED) {
+        // Removal events carry the joystick instance id, not the device index
+        for (auto it = controllers.begin(); it != controllers.end(); ++it) {
+            if (SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(*it)) == e.cdevice.which) {
+                SDL_GameControllerClose(*it);
+                controllers.erase(it);
+                cout << "Game controller disconnected\n";
+                return;
+            }
+        }
+        return;
+    }
+    if (e.type != SDL_CONTROLLERDEVICEADDED || !SDL_IsGameController(e.cdevice.which)) {
+        return;
+    }
+    SDL_GameController* controller = SDL_GameControllerOpen(e.cdevice.which);
+    if (controller == NULL) {
+        cout << "SDL_GameControllerOpen failure: " << SDL_GetError() << endl;
+        return;
+    }
+    controllers.push_back(controller);
+    cout << "Game controller connected\n";
+}
@@ -0,0 +1,37 @@
+#ifndef INPUT_MAPPER_H
+#define INPUT_MAPPER_H
+
+#include <stdint.h>
+#include <vector>
+#include <SDL2/SDL.h>
+
+using namespace std;
+
+const uint8_t NO_KEY = 0xFF;
+
+// Translates SDL keyboard and game controller events into keypad presses
+// with flat lookup tables.
+class InputMapper {
+private:
+    uint8_t scancodeKeys[SDL_NUM_SCANCODES];
+    uint8_t buttonKeys[SDL_CONTROLLER_BUTTON_MAX];
+
+    vector<SDL_GameController*> controllers;
+
+    void clear();
+
+public:
+    InputMapper();
+    ~InputMapper();
+
+    void loadDefaults();
+    bool loadConfig(const char *path);
+
+    // Returns true if the event pressed or released a keypad key
+    bool translate(const SDL_Event &e, int &key, bool &down);
+
+    // Opens controllers as they're plugged in and closes them when unplugged
+    void handleDeviceEvent(const SDL_Event &e);
+};
+
+#endif // INPUT_MAPPER_H
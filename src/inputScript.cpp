@@ -0,0 +1,65 @@
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "inputScript.h"
+
+using namespace std;
+
+
+InputScript::InputScript() {
+    nextEvent = 0;
+}
+
+bool InputScript::load(const char *path) {
+    ifstream script(path);
+    if (!script) {
+        cout << "Error reading input script: " << path << endl;
+        return false;
+    }
+
+    events.clear();
+    string line;
+    int lineNumber = 0;
+    while (getline(script, line)) {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == string::npos || line[start] == '#') {
+            continue;
+        }
+
+        istringstream fields(line);
+        InputScriptEvent event;
+        string action;
+        fields >> event.frame >> action >> hex >> event.key;
+        if (!fields || (action != "down" && action != "up") || event.key < 0 || event.key > 0xF) {
+            cout << "Bad input script line " << lineNumber << ": " << line << endl;
+            return false;
+        }
+        event.down = action == "down";
+        events.push_back(event);
+    }
+
+    stable_sort(events.begin(), events.end(), [](const InputScriptEvent &a, const InputScriptEvent &b) {
+        return a.frame < b.frame;
+    });
+    nextEvent = 0;
+    return true;
+}
+
+void InputScript::rewind() {
+    nextEvent = 0;
+}
+
+void InputScript::apply(Chip8* chip8, uint64_t frame) {
+    while (nextEvent < events.size() && events[nextEvent].frame <= frame) {
+        const InputScriptEvent &event = events[nextEvent++];
+        if (event.down) {
+            chip8->handleKeyDown(event.key);
+        } else {
+            chip8->handleKeyUp(event.key);
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef INPUT_SCRIPT_H
+#define INPUT_SCRIPT_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "chip8.h"
+
+using namespace std;
+
+struct InputScriptEvent {
+    uint64_t frame;
+    int key;
+    bool down;
+};
+
+// Scripted keypad input for headless runs. Each line of a script is
+// `<frame> down|up <hex key>`, applied before that frame runs. Lines starting
+// with # are ignored.
+class InputScript {
+private:
+    vector<InputScriptEvent> events;
+    size_t nextEvent;
+
+public:
+    InputScript();
+
+    bool load(const char *path);
+    void rewind();
+    void apply(Chip8* chip8, uint64_t frame);
+};
+
+#endif // INPUT_SCRIPT_H
@@ -0,0 +1,45 @@
+#include <iostream>
+#include <algorithm>
+#include <vector>
+
+#include "latencyProbe.h"
+
+using namespace std;
+
+
+LatencyProbe::LatencyProbe() {
+    sampleCount = 0;
+    nextSample = 0;
+    pendingCount = 0;
+}
+
+void LatencyProbe::inputApplied(uint32_t eventMS) {
+    if (pendingCount < LATENCY_MAX_PENDING) {
+        pending[pendingCount++] = eventMS;
+    }
+}
+
+void LatencyProbe::presented(uint32_t nowMS) {
+    for (int i = 0; i < pendingCount; i++) {
+        samples[nextSample] = nowMS - pending[i];
+        nextSample = (nextSample + 1) % LATENCY_MAX_SAMPLES;
+        sampleCount = min(sampleCount + 1, LATENCY_MAX_SAMPLES);
+    }
+    pendingCount = 0;
+}
+
+uint32_t LatencyProbe::percentile(double p) {
+    if (sampleCount == 0) {
+        return 0;
+    }
+    vector<uint32_t> sorted(samples, samples + sampleCount);
+    size_t index = min((size_t) (p * sampleCount), sorted.size() - 1);
+    nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+void LatencyProbe::report() {
+    cout << "Input to present latency over " << sampleCount << " presses: "
+        << "p50 " << this->percentile(0.50) << "ms, "
+        << "p99 " << this->percentile(0.99) << "ms" << endl;
+}
@@ -0,0 +1,30 @@
+#ifndef LATENCY_PROBE_H
+#define LATENCY_PROBE_H
+
+#include <stdint.h>
+
+const int LATENCY_MAX_SAMPLES = 4096;
+const int LATENCY_MAX_PENDING = 16;
+
+// Measures the time from a key press to the first present that could show
+// its effect. Samples are kept in a fixed ring, the oldest are overwritten.
+class LatencyProbe {
+private:
+    uint32_t samples[LATENCY_MAX_SAMPLES];
+    int sampleCount;
+    int nextSample;
+
+    uint32_t pending[LATENCY_MAX_PENDING];
+    int pendingCount;
+
+public:
+    LatencyProbe();
+
+    void inputApplied(uint32_t eventMS);
+    void presented(uint32_t nowMS);
+
+    uint32_t percentile(double p);
+    void report();
+};
+
+#endif // LATENCY_PROBE_H
@@ -0,0 +1,199 @@
+#include <cstring>
+
+#include "libchip8.h"
+#include "chip8.h"
+#include "pixelExpander.h"
+#include "romCache.h"
+
+using namespace std;
+
+const uint32_t CHIP8_STATE_MAGIC = 0x54533843; // "C8ST"
+// Bump whenever Chip8Checkpoint changes layout
+const uint32_t CHIP8_STATE_VERSION = 3;
+
+struct chip8_vm {
+    Chip8 chip8;
+};
+
+struct StateHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+};
+
+// Every entry point that can reach an allocation catches everything, C
+// callers can't unwind a C++ exception. The rest only read fields.
+
+chip8_vm *chip8_create(void) {
+    try {
+        chip8_vm *vm = new chip8_vm();
+        // Starts out as an empty ROM, so every pointer is valid right away
+        static const uint8_t empty = 0;
+        vm->chip8.loadMemory(&empty, 0);
+        return vm;
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void chip8_destroy(chip8_vm *vm) {
+    delete vm;
+}
+
+int chip8_load_memory(chip8_vm *vm, const uint8_t *rom, size_t size) {
+    try {
+        return vm->chip8.loadMemory(rom, size) ? 0 : -1;
+    } catch (...) {
+        return -1;
+    }
+}
+
+void chip8_seed(chip8_vm *vm, uint32_t seed) {
+    try {
+        vm->chip8.seed(seed);
+    } catch (...) {
+        // Nothing to report it to
+    }
+}
+
+void chip8_set_rom_cache_capacity(size_t bytes) {
+    try {
+        RomCache::instance().setCapacity(bytes);
+    } catch (...) {
+        // Nothing to report it to
+    }
+}
+
+int chip8_run_frames(chip8_vm *vm, int frames) {
+    try {
+        for (int frame = 0; frame < frames; frame++) {
+            vm->chip8.runFrame();
+            if (vm->chip8.isFinished()) {
+                return -1;
+            }
+        }
+        return frames;
+    } catch (...) {
+        return -1;
+    }
+}
+
+void chip8_set_quota(chip8_vm *vm, uint64_t max_instructions, uint64_t max_frames, uint32_t deadline_ms, int stuck_frames) {
+    try {
+        Chip8Quota quota;
+        quota.maxInstructions = max_instructions;
+        quota.maxFrames = max_frames;
+        quota.deadlineMS = deadline_ms;
+        quota.stuckFrames = stuck_frames;
+        vm->chip8.setQuota(quota);
+    } catch (...) {
+        // Nothing to report it to
+    }
+}
+
+int chip8_status(const chip8_vm *vm) {
+    return vm->chip8.getStatus();
+}
+
+void chip8_set_keys(chip8_vm *vm, uint16_t mask) {
+    try {
+        vm->chip8.setKeys(mask);
+    } catch (...) {
+        // Nothing to report it to
+    }
+}
+
+int chip8_sound_on(const chip8_vm *vm) {
+    return vm->chip8.isSoundOn();
+}
+
+const uint8_t *chip8_framebuffer_ptr(const chip8_vm *vm) {
+    return vm->chip8.displayBuffer;
+}
+
+void chip8_read_memory(const chip8_vm *vm, uint16_t address, uint8_t *out, size_t length) {
+    try {
+        for (size_t i = 0; i < length; i++) {
+            out[i] = vm->chip8.readMemory(address + i);
+        }
+    } catch (...) {
+        // Nothing to report it to
+    }
+}
+
+const uint8_t *chip8_registers_ptr(const chip8_vm *vm) {
+    return vm->chip8.getRegisters();
+}
+
+int chip8_render(const chip8_vm *vm, uint32_t *out, int pitch, int scale, uint32_t on_color, uint32_t off_color) {
+    try {
+        if (out == nullptr || scale < 1 || scale > MAX_PIXEL_SCALE || pitch < CHIP8_DISPLAY_WIDTH * scale) {
+            return -1;
+        }
+        uint8_t packed[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT / 8];
+        vm->chip8.packDisplay(packed);
+        PixelExpander(scale, on_color, off_color).expand(packed, out, pitch);
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+// Only what the machine itself could have saved. I isn't checked: Fx1E can
+// leave any 16-bit value in it and every access wraps to 12 bits.
+static bool isValidState(const Chip8Checkpoint &state) {
+    // Compared as the int it was stored as, not as an enum it may not be
+    int status;
+    static_assert(sizeof(status) == sizeof(state.status), "Chip8Status is not int sized");
+    memcpy(&status, &state.status, sizeof(status));
+    return state.registerAwaitingKeyPress >= -1 && state.registerAwaitingKeyPress <= 0xF
+        && status >= CHIP8_OK && status <= CHIP8_STUCK
+        && state.sp <= 16
+        // Bnnn can jump as far as 0xFFF + 0xFF
+        && state.pc <= 0x0FFF + 0xFF;
+}
+
+size_t chip8_state_size(void) {
+    return sizeof(StateHeader) + sizeof(Chip8Checkpoint);
+}
+
+int chip8_save_state(const chip8_vm *vm, void *buffer, size_t size) {
+    try {
+        if (size < chip8_state_size()) {
+            return -1;
+        }
+        StateHeader header = { CHIP8_STATE_MAGIC, CHIP8_STATE_VERSION, (uint32_t) chip8_state_size() };
+        // Chip8Checkpoint is plain data, so the blob is a straight copy. The
+        // caller's buffer may not be aligned for it.
+        Chip8Checkpoint state;
+        vm->chip8.saveState(state);
+        memcpy(buffer, &header, sizeof(header));
+        memcpy((uint8_t*) buffer + sizeof(header), &state, sizeof(state));
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
+
+int chip8_load_state(chip8_vm *vm, const void *buffer, size_t size) {
+    try {
+        StateHeader header;
+        if (size < chip8_state_size()) {
+            return -1;
+        }
+        memcpy(&header, buffer, sizeof(header));
+        if (header.magic != CHIP8_STATE_MAGIC || header.version != CHIP8_STATE_VERSION
+                || header.size != chip8_state_size()) {
+            return -1;
+        }
+        Chip8Checkpoint state;
+        memcpy(&state, (const uint8_t*) buffer + sizeof(header), sizeof(state));
+        if (!isValidState(state)) {
+            return -1;
+        }
+        vm->chip8.loadState(state);
+        return 0;
+    } catch (...) {
+        return -1;
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef LIBCHIP8_H
+#define LIBCHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// C interface to the emulator core, built into libchip8.so and libchip8.a by
+// `make lib`. No SDL, no C++ types, and no exceptions cross this boundary.
+// Only these functions are exported from the shared library.
+
+#if defined(__GNUC__)
+#define CHIP8_API __attribute__((visibility("default")))
+#else
+#define CHIP8_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHIP8_DISPLAY_WIDTH 64
+#define CHIP8_DISPLAY_HEIGHT 32
+#define CHIP8_DISPLAY_ROW_BYTES (CHIP8_DISPLAY_WIDTH / 8)
+#define CHIP8_MEMORY_SIZE 4096
+
+// Why the machine stopped, from chip8_status(). Anything but CHIP8_STATUS_OK
+// lasts until the next load.
+#define CHIP8_STATUS_OK 0
+// Jumped to itself
+#define CHIP8_STATUS_HALTED 1
+#define CHIP8_STATUS_INVALID_OPCODE 2
+#define CHIP8_STATUS_STACK_OVERFLOW 3
+#define CHIP8_STATUS_STACK_UNDERFLOW 4
+#define CHIP8_STATUS_OUT_OF_BOUNDS 5
+// Out of the quota set with chip8_set_quota()
+#define CHIP8_STATUS_INSTRUCTION_LIMIT 6
+#define CHIP8_STATUS_FRAME_LIMIT 7
+#define CHIP8_STATUS_DEADLINE 8
+#define CHIP8_STATUS_STUCK_WAITING_FOR_KEY 9
+#define CHIP8_STATUS_STUCK 10
+
+typedef struct chip8_vm chip8_vm;
+
+CHIP8_API chip8_vm *chip8_create(void);
+CHIP8_API void chip8_destroy(chip8_vm *vm);
+
+// Resets the machine and loads a ROM image at 0x200. Returns 0 on success.
+CHIP8_API int chip8_load_memory(chip8_vm *vm, const uint8_t *rom, size_t size);
+CHIP8_API void chip8_seed(chip8_vm *vm, uint32_t seed);
+// Loaded ROMs are cached process-wide by content, least recently loaded
+// dropped first past this many bytes. 16MB unless set.
+CHIP8_API void chip8_set_rom_cache_capacity(size_t bytes);
+
+// Runs whole 60Hz frames. Returns the number of frames run, or -1 as soon
+// as the machine has faulted or run out of quota, when chip8_status() says
+// why, or out of host memory.
+CHIP8_API int chip8_run_frames(chip8_vm *vm, int frames);
+// Limits for unattended runs, 0 for none, counted from this call and reset
+// by each load: instructions, frames, host milliseconds, and frames in a
+// row ending in exactly the same state before the machine counts as stuck.
+// Under a quota a jump-to-self also ends the run.
+CHIP8_API void chip8_set_quota(chip8_vm *vm, uint64_t max_instructions, uint64_t max_frames,
+    uint32_t deadline_ms, int stuck_frames);
+CHIP8_API int chip8_status(const chip8_vm *vm);
+// Bit k set = key k held
+CHIP8_API void chip8_set_keys(chip8_vm *vm, uint16_t mask);
+CHIP8_API int chip8_sound_on(const chip8_vm *vm);
+
+// Read-only views of live state, valid until chip8_destroy(). They are not
+// copies: read them between calls, not while another thread runs the machine.
+// One bit per pixel, CHIP8_DISPLAY_ROW_BYTES per row, most significant bit
+// leftmost.
+CHIP8_API const uint8_t *chip8_framebuffer_ptr(const chip8_vm *vm);
+// V0 to VF
+CHIP8_API const uint8_t *chip8_registers_ptr(const chip8_vm *vm);
+
+// Memory is paged and partly shared between machines, so it is copied out:
+// length bytes from address, wrapping at 4KB.
+CHIP8_API void chip8_read_memory(const chip8_vm *vm, uint16_t address, uint8_t *out, size_t length);
+
+// Renders the display into out, CHIP8_DISPLAY_WIDTH * scale pixels per row
+// and CHIP8_DISPLAY_HEIGHT * scale rows, pitch pixels apart. scale is 1 to
+// 16. The colours are copied as given, e.g. 0xRRGGBBAA for RGBA8888. Returns
+// 0 on success.
+CHIP8_API int chip8_render(const chip8_vm *vm, uint32_t *out, int pitch, int scale,
+    uint32_t on_color, uint32_t off_color);
+
+// Save states are opaque blobs of chip8_state_size() bytes, tied to the
+// library version that wrote them. Both return 0 on success; loading also
+// fails on a blob holding registers the machine could never have had.
+CHIP8_API size_t chip8_state_size(void);
+CHIP8_API int chip8_save_state(const chip8_vm *vm, void *buffer, size_t size);
+CHIP8_API int chip8_load_state(chip8_vm *vm, const void *buffer, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBCHIP8_H
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstring>
 
 #include "constants.h"
 #include "logger.h"
@@ -2,9 +2,7 @@
 #define LOGGER
 
 #include <stdint.h>
-
-
-using namespace std;
+#include <string>
 
 
 class Logger {
@@ -28,7 +26,7 @@ public:
 
     // Log without level checking
     void log(const char* s);
-    void log(string s);
+    void log(std::string s);
 
     void info(const char* s);
     void debug(const char* s);
@@ -36,11 +34,11 @@ public:
     void display(const char* s);
     void target(const char* s);
 
-    void info(string s);
-    void debug(string s);
-    void error(string s);
-    void display(string s);
-    void target(string s);
+    void info(std::string s);
+    void debug(std::string s);
+    void error(std::string s);
+    void display(std::string s);
+    void target(std::string s);
 };
 
 
@@ -1,24 +1,158 @@
 #include <iostream>
+#include <ctime>
 #include <SDL2/SDL.h>
 
 #include "constants.h"
 #include "chip8.h"
+#include "chip8Headless.h"
+#include "chip8Wall.h"
 #include "chip8Window.h"
+#include "debugger.h"
+#include "options.h"
+#include "profiler.h"
 
 using namespace std;
 
 
+void setUpDebugger(Debugger &debugger, const Options &options) {
+    for (uint16_t address : options.breakpoints) {
+        debugger.addBreakpoint(address, "");
+    }
+    if (options.debug) {
+        debugger.breakNow();
+    }
+}
+
+// --aot names the library, --aot-dir finds it by the ROM's hash
+bool loadCompiledRom(Chip8 &chip8, const Options &options) {
+    if (options.aotPath != nullptr && !chip8.loadAot(options.aotPath)) {
+        return false;
+    }
+    return options.aotDir == nullptr || chip8.loadAotFrom(options.aotDir);
+}
+
+int runWall(const Options &options) {
+    vector<Chip8> machines(options.wallInstances);
+    vector<Chip8*> pointers;
+    for (size_t i = 0; i < machines.size(); i++) {
+        pointers.push_back(&machines[i]);
+    }
+    Chip8Wall wall(pointers, "Chip8");
+    for (size_t i = 0; i < machines.size(); i++) {
+        // Every copy shares the ROM's pages, and loads the library once
+        if (!machines[i].load(options.romPath)) {
+            return 1;
+        }
+        if (!loadCompiledRom(machines[i], options)) {
+            return 1;
+        }
+        // Otherwise they would all play the same game
+        machines[i].seed((options.hasSeed ? options.seed : (uint32_t) time(NULL)) + i);
+    }
+    if (options.keymapPath != nullptr && !wall.loadKeymap(options.keymapPath)) {
+        return 1;
+    }
+    wall.run();
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        cout << "ROM Path required!" << endl;
-        cout << "Usage: ./chip8 <path/to/rom>" << endl;
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
         return 1;
     }
 
+    if (options.wallInstances > 0 && !options.headless) {
+        return runWall(options);
+    }
+
     Chip8 chip8 = Chip8();
-    Chip8Window chip8Window = Chip8Window(&chip8, "Chip8", WINDOW_WIDTH, WINDOW_HEIGHT);
-    if (!chip8.load(argv[1])) {
+    if (options.headless) {
+        if (!chip8.load(options.romPath)) {
+            return 1;
+        }
+        if (!loadCompiledRom(chip8, options)) {
+            return 1;
+        }
+        if (options.hasSeed) {
+            chip8.seed(options.seed);
+        }
+        Chip8Quota quota;
+        quota.maxInstructions = options.maxInstructions;
+        quota.maxFrames = options.maxFrames;
+        quota.deadlineMS = options.deadlineMS;
+        quota.stuckFrames = options.stuckFrames;
+        chip8.setQuota(quota);
+        // Attached first, so the debugger steps through it when armed
+        Profiler profiler(&chip8);
+        if (options.profilePrefix != nullptr) {
+            profiler.attach();
+        }
+        Debugger debugger(&chip8);
+        setUpDebugger(debugger, options);
+        Chip8Headless chip8Headless(&chip8);
+        chip8Headless.attachDebugger(&debugger);
+        if (options.inputScriptPath != nullptr && !chip8Headless.loadInputScript(options.inputScriptPath)) {
+            return 1;
+        }
+        if (options.terminalCells != nullptr && !chip8Headless.showInTerminal(options.terminalCells)) {
+            return 1;
+        }
+        if (options.wavPath != nullptr && !chip8Headless.recordAudio(options.wavPath)) {
+            return 1;
+        }
+        if (options.capturePath != nullptr && !chip8Headless.recordFrames(options.capturePath, options.captureScale)) {
+            return 1;
+        }
+        if (options.exportName != nullptr && !chip8Headless.exportState(options.exportName)) {
+            return 1;
+        }
+        chip8Headless.run(options.maxFrames > 0 ? options.maxFrames : options.frames);
+        if (options.profilePrefix != nullptr && !profiler.write(options.profilePrefix)) {
+            return 1;
+        }
+        // So a batch run can tell a ROM that finished from one that didn't
+        return chip8.isFinished() ? 2 : 0;
+    }
+
+    Chip8Window chip8Window(&chip8, "Chip8", WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (!chip8.load(options.romPath)) {
+        return 1;
+    }
+    if (!loadCompiledRom(chip8, options)) {
+        return 1;
+    }
+    if (options.hasSeed) {
+        chip8.seed(options.seed);
+    }
+    if (options.keymapPath != nullptr && !chip8Window.loadKeymap(options.keymapPath)) {
+        return 1;
+    }
+    if (options.capturePath != nullptr && !chip8Window.recordFrames(options.capturePath, options.captureScale)) {
         return 1;
     }
+    if (options.exportName != nullptr && !chip8Window.exportState(options.exportName)) {
+        return 1;
+    }
+    if (options.latencyProbe) {
+        chip8Window.enableLatencyProbe();
+    }
+    chip8Window.enableRunAhead(options.runAheadFrames);
+    chip8Window.setSpeed(options.speed);
+    if (options.metricsDestination != nullptr
+            && !chip8Window.publishMetrics(options.metricsDestination, options.metricsIntervalMS)) {
+        return 1;
+    }
+    Profiler profiler(&chip8);
+    if (options.profilePrefix != nullptr) {
+        profiler.attach();
+    }
+    Debugger debugger(&chip8);
+    setUpDebugger(debugger, options);
+    chip8Window.attachDebugger(&debugger);
     chip8Window.run();
+    if (options.profilePrefix != nullptr && !profiler.write(options.profilePrefix)) {
+        return 1;
+    }
 }
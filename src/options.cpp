@@ -0,0 +1,145 @@
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+#include "options.h"
+#include "constants.h"
+
+using namespace std;
+
+
+void printUsage() {
+    cout << "Usage: ./chip8 [options] <path/to/rom>" << endl;
+    cout << "  --aot <path/to/rom.so>   use a library built by chip8-aot" << endl;
+    cout << "  --aot-dir <dir>          use the library in dir built from this ROM, if any" << endl;
+    cout << "  --seed <n>               fixed random seed" << endl;
+    cout << "  --headless               run without a window" << endl;
+    cout << "  --frames <n>             frames to run in headless mode (default 600)" << endl;
+    cout << "  --max-frames <n>         like --frames, but running out is a limit like the" << endl;
+    cout << "                           ones below" << endl;
+    cout << "  --max-instructions <n>   headless mode: stop after n instructions" << endl;
+    cout << "  --deadline <ms>          headless mode: stop after this much host time" << endl;
+    cout << "  --stuck-frames <n>       headless mode: stop once n frames in a row end in" << endl;
+    cout << "                           the same state, or on a jump to self" << endl;
+    cout << "  --input <path>           headless mode: scripted input, lines of" << endl;
+    cout << "                           <frame> down|up <hex key>" << endl;
+    cout << "  --terminal <cells>       run headless in real time, drawing the display on" << endl;
+    cout << "                           the terminal in half or braille cells" << endl;
+    cout << "  --wav <path/to/out.wav>  headless mode: record the beeper" << endl;
+    cout << "  --capture <path>         record the display to a .gif or .y4m file" << endl;
+    cout << "  --capture-scale <n>      capture pixel scale (default 4)" << endl;
+    cout << "  --keymap <path>          keyboard/controller mapping file" << endl;
+    cout << "  --latency-probe          report input to present latency on exit" << endl;
+    cout << "  --run-ahead <n>          show the display n frames ahead of emulation (max 8)," << endl;
+    cout << "                           reports the cost on exit" << endl;
+    cout << "  --speed <x|max>          run at x times normal speed, or unthrottled; Tab" << endl;
+    cout << "                           toggles it (unthrottled by default)" << endl;
+    cout << "  --wall <n>               run n instances of the ROM in one tiled window," << endl;
+    cout << "                           click or Tab picks the one keys go to" << endl;
+    cout << "  --debug                  start in the debugger console (F12 breaks in the window);" << endl;
+    cout << "                           the window freezes while the console waits" << endl;
+    cout << "  --break <hex address>    debugger breakpoint, repeatable" << endl;
+    cout << "  --profile <prefix>       profile guest subroutines, writes <prefix>.folded" << endl;
+    cout << "                           and <prefix>.txt on exit" << endl;
+    cout << "  --export <name>          publish the display and registers every frame to" << endl;
+    cout << "                           POSIX shared memory, e.g. /chip8-state" << endl;
+    cout << "  --metrics <path>         publish runtime metrics in Prometheus text format to a" << endl;
+    cout << "                           file, or serve them on unix:<socket path>" << endl;
+    cout << "  --metrics-interval <ms>  metrics publishing interval (default 1000)" << endl;
+}
+
+bool parseOptions(int argc, char *argv[], Options &options) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (strcmp(arg, "--aot") == 0 && hasValue) {
+            options.aotPath = argv[++i];
+        } else if (strcmp(arg, "--aot-dir") == 0 && hasValue) {
+            options.aotDir = argv[++i];
+        } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+            options.hasSeed = true;
+            options.seed = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "--input") == 0 && hasValue) {
+            options.inputScriptPath = argv[++i];
+        } else if (strcmp(arg, "--headless") == 0) {
+            options.headless = true;
+        } else if (strcmp(arg, "--terminal") == 0 && hasValue) {
+            options.headless = true;
+            options.terminalCells = argv[++i];
+        } else if (strcmp(arg, "--frames") == 0 && hasValue) {
+            options.frames = atoi(argv[++i]);
+        } else if (strcmp(arg, "--max-instructions") == 0 && hasValue) {
+            options.maxInstructions = strtoull(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "--max-frames") == 0 && hasValue) {
+            options.maxFrames = atoi(argv[++i]);
+        } else if (strcmp(arg, "--deadline") == 0 && hasValue) {
+            options.deadlineMS = strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(arg, "--stuck-frames") == 0 && hasValue) {
+            options.stuckFrames = atoi(argv[++i]);
+        } else if (strcmp(arg, "--wav") == 0 && hasValue) {
+            options.wavPath = argv[++i];
+        } else if (strcmp(arg, "--capture") == 0 && hasValue) {
+            options.capturePath = argv[++i];
+        } else if (strcmp(arg, "--capture-scale") == 0 && hasValue) {
+            options.captureScale = atoi(argv[++i]);
+            if (options.captureScale < 1) {
+                cout << "Capture scale must be at least 1" << endl;
+                return false;
+            }
+        } else if (strcmp(arg, "--keymap") == 0 && hasValue) {
+            options.keymapPath = argv[++i];
+        } else if (strcmp(arg, "--latency-probe") == 0) {
+            options.latencyProbe = true;
+        } else if (strcmp(arg, "--run-ahead") == 0 && hasValue) {
+            options.runAheadFrames = atoi(argv[++i]);
+            if (options.runAheadFrames < 0 || options.runAheadFrames > MAX_RUN_AHEAD_FRAMES) {
+                cout << "Run-ahead must be 0 to " << MAX_RUN_AHEAD_FRAMES << " frames" << endl;
+                return false;
+            }
+        } else if (strcmp(arg, "--speed") == 0 && hasValue) {
+            const char *value = argv[++i];
+            char *end = nullptr;
+            options.speed = strcmp(value, "max") == 0 ? 0 : strtod(value, &end);
+            if (end != nullptr && (*end != '\0' || options.speed <= 0)) {
+                cout << "Speed must be a positive multiple or max" << endl;
+                return false;
+            }
+        } else if (strcmp(arg, "--wall") == 0 && hasValue) {
+            options.wallInstances = atoi(argv[++i]);
+            if (options.wallInstances < 1 || options.wallInstances > MAX_WALL_INSTANCES) {
+                cout << "Wall must be 1 to " << MAX_WALL_INSTANCES << " instances" << endl;
+                return false;
+            }
+        } else if (strcmp(arg, "--debug") == 0) {
+            options.debug = true;
+        } else if (strcmp(arg, "--break") == 0 && hasValue) {
+            char *end;
+            unsigned long address = strtoul(argv[++i], &end, 16);
+            if (*end != '\0' || address >= 4096) {
+                cout << "Bad breakpoint address: " << argv[i] << endl;
+                return false;
+            }
+            options.breakpoints.push_back(address);
+        } else if (strcmp(arg, "--profile") == 0 && hasValue) {
+            options.profilePrefix = argv[++i];
+        } else if (strcmp(arg, "--export") == 0 && hasValue) {
+            options.exportName = argv[++i];
+        } else if (strcmp(arg, "--metrics") == 0 && hasValue) {
+            options.metricsDestination = argv[++i];
+        } else if (strcmp(arg, "--metrics-interval") == 0 && hasValue) {
+            options.metricsIntervalMS = atoi(argv[++i]);
+        } else if (arg[0] == '-') {
+            cout << "Unknown option: " << arg << endl;
+            return false;
+        } else {
+            options.romPath = arg;
+        }
+    }
+
+    if (options.romPath == nullptr) {
+        cout << "ROM Path required!" << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <stdint.h>
+#include <vector>
+
+// Command line options for the `chip8` binary
+struct Options {
+    const char *romPath = nullptr;
+
+    // Library built by `chip8-aot` for this ROM
+    const char *aotPath = nullptr;
+    // Or a directory of them, named by ROM hash
+    const char *aotDir = nullptr;
+
+    // Fixed random seed, for repeatable runs
+    bool hasSeed = false;
+    uint32_t seed = 0;
+
+    // Run without a window for a fixed number of frames
+    bool headless = false;
+    int frames = 600;
+    const char *inputScriptPath = nullptr;
+    // Headless mode: stop early on running out of any of these, 0 for no
+    // limit (see Chip8Quota)
+    uint64_t maxInstructions = 0;
+    // Also how many frames the run lasts, replacing frames
+    int maxFrames = 0;
+    uint32_t deadlineMS = 0;
+    int stuckFrames = 0;
+    // Headless mode: live view on stdout, "half" or "braille" cells
+    const char *terminalCells = nullptr;
+
+    // Headless mode: write the beeper to a .wav file in emulated time
+    const char *wavPath = nullptr;
+
+    // Record the display to an animated .gif or a .y4m video
+    const char *capturePath = nullptr;
+    int captureScale = 4;
+
+    // Window mode input configuration
+    const char *keymapPath = nullptr;
+    bool latencyProbe = false;
+    int runAheadFrames = 0;
+    // Multiple of normal speed, 0 for unthrottled
+    double speed = 1;
+
+    // Run this many copies of the ROM side by side in one window, each
+    // seeded differently
+    int wallInstances = 0;
+
+    // Debugger: stop before the first instruction, and/or at these addresses
+    bool debug = false;
+    std::vector<uint16_t> breakpoints;
+
+    // Guest profiler output, written on exit as <prefix>.folded and .txt
+    const char *profilePrefix = nullptr;
+
+    // Publish the display and registers every frame to this POSIX shared
+    // memory object, e.g. "/chip8-state" (see stateExport.h)
+    const char *exportName = nullptr;
+
+    // Window mode: runtime metrics in Prometheus text format, to a file or
+    // "unix:<socket path>"
+    const char *metricsDestination = nullptr;
+    int metricsIntervalMS = 1000;
+};
+
+bool parseOptions(int argc, char *argv[], Options &options);
+void printUsage();
+
+#endif // OPTIONS_H
@@ -0,0 +1,146 @@
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_EXPANDER_X86
+#endif
+
+#include "pixelExpander.h"
+
+using namespace std;
+
+// A row of `width` output pixels, the first `half` of them from `high`.
+// `half` and `width` are multiples of 8, so no vector straddles the two words.
+typedef void (*RowKernel)(const uint32_t *masks, int width, int half, uint32_t high, uint32_t low,
+    uint32_t on, uint32_t off, uint32_t *out);
+
+static void expandRowScalar(const uint32_t *masks, int width, int half, uint32_t high, uint32_t low,
+        uint32_t on, uint32_t off, uint32_t *out) {
+    for (int x = 0; x < width; x++) {
+        uint32_t word = x < half ? high : low;
+        out[x] = (word & masks[x]) ? on : off;
+    }
+}
+
+#if defined(PIXEL_EXPANDER_X86) && defined(__SSE2__)
+static void expandRowSse2(const uint32_t *masks, int width, int half, uint32_t high, uint32_t low,
+        uint32_t on, uint32_t off, uint32_t *out) {
+    const __m128i offs = _mm_set1_epi32(off);
+    const __m128i toggle = _mm_set1_epi32(on ^ off);
+    __m128i word = _mm_set1_epi32(high);
+    for (int x = 0; x < width; x += 4) {
+        if (x == half) {
+            word = _mm_set1_epi32(low);
+        }
+        __m128i mask = _mm_loadu_si128((const __m128i*) (masks + x));
+        __m128i lit = _mm_cmpeq_epi32(_mm_and_si128(word, mask), mask);
+        _mm_storeu_si128((__m128i*) (out + x), _mm_xor_si128(offs, _mm_and_si128(lit, toggle)));
+    }
+}
+#endif
+
+#if defined(PIXEL_EXPANDER_X86) && defined(__GNUC__)
+// Built for AVX2 on its own, only called after checking the CPU has it
+__attribute__((target("avx2")))
+static void expandRowAvx2(const uint32_t *masks, int width, int half, uint32_t high, uint32_t low,
+        uint32_t on, uint32_t off, uint32_t *out) {
+    const __m256i offs = _mm256_set1_epi32(off);
+    const __m256i toggle = _mm256_set1_epi32(on ^ off);
+    __m256i word = _mm256_set1_epi32(high);
+    for (int x = 0; x < width; x += 8) {
+        if (x == half) {
+            word = _mm256_set1_epi32(low);
+        }
+        __m256i mask = _mm256_loadu_si256((const __m256i*) (masks + x));
+        __m256i lit = _mm256_cmpeq_epi32(_mm256_and_si256(word, mask), mask);
+        _mm256_storeu_si256((__m256i*) (out + x), _mm256_xor_si256(offs, _mm256_and_si256(lit, toggle)));
+    }
+}
+#endif
+
+static bool isSupported(PixelKernel kernel) {
+    switch (kernel) {
+        case PIXEL_KERNEL_SCALAR:
+            return true;
+#if defined(PIXEL_EXPANDER_X86) && defined(__SSE2__)
+        case PIXEL_KERNEL_SSE2:
+            return true;
+#endif
+#if defined(PIXEL_EXPANDER_X86) && defined(__GNUC__)
+        case PIXEL_KERNEL_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+static RowKernel rowKernel(PixelKernel kernel) {
+    switch (kernel) {
+#if defined(PIXEL_EXPANDER_X86) && defined(__SSE2__)
+        case PIXEL_KERNEL_SSE2:
+            return expandRowSse2;
+#endif
+#if defined(PIXEL_EXPANDER_X86) && defined(__GNUC__)
+        case PIXEL_KERNEL_AVX2:
+            return expandRowAvx2;
+#endif
+        default:
+            return expandRowScalar;
+    }
+}
+
+
+PixelExpander::PixelExpander(int _scale, uint32_t _onColor, uint32_t _offColor) {
+    scale = _scale < 1 ? 1 : (_scale > MAX_PIXEL_SCALE ? MAX_PIXEL_SCALE : _scale);
+    onColor = _onColor;
+    offColor = _offColor;
+    kernel = bestKernel();
+
+    for (int x = 0; x < this->width(); x++) {
+        int source = x / scale;
+        bitMasks[x] = 0x80000000u >> (source % 32);
+    }
+}
+
+PixelKernel PixelExpander::bestKernel() {
+    if (isSupported(PIXEL_KERNEL_AVX2)) {
+        return PIXEL_KERNEL_AVX2;
+    }
+    if (isSupported(PIXEL_KERNEL_SSE2)) {
+        return PIXEL_KERNEL_SSE2;
+    }
+    return PIXEL_KERNEL_SCALAR;
+}
+
+const char *PixelExpander::kernelName(PixelKernel kernel) {
+    switch (kernel) {
+        case PIXEL_KERNEL_SSE2:
+            return "sse2";
+        case PIXEL_KERNEL_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+void PixelExpander::setKernel(PixelKernel _kernel) {
+    kernel = isSupported(_kernel) ? _kernel : bestKernel();
+}
+
+void PixelExpander::expand(const uint8_t *packed, uint32_t *out, int pitch) const {
+    RowKernel expandRow = rowKernel(kernel);
+    const int rowBytes = DISPLAY_WIDTH / 8;
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        const uint8_t *row = packed + y * rowBytes;
+        uint32_t high = (uint32_t) row[0] << 24 | row[1] << 16 | row[2] << 8 | row[3];
+        uint32_t low = (uint32_t) row[4] << 24 | row[5] << 16 | row[6] << 8 | row[7];
+
+        uint32_t *first = out + (size_t) y * scale * pitch;
+        expandRow(bitMasks, this->width(), this->width() / 2, high, low, onColor, offColor, first);
+        // Vertical scaling repeats the finished row
+        for (int repeat = 1; repeat < scale; repeat++) {
+            memcpy(first + (size_t) repeat * pitch, first, this->width() * sizeof(uint32_t));
+        }
+    }
+}
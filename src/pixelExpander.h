@@ -0,0 +1,47 @@
+#ifndef PIXEL_EXPANDER_H
+#define PIXEL_EXPANDER_H
+
+#include <stdint.h>
+
+#include "constants.h"
+
+enum PixelKernel {
+    PIXEL_KERNEL_SCALAR,
+    PIXEL_KERNEL_SSE2,
+    PIXEL_KERNEL_AVX2,
+};
+
+// Expands the packed 1-bit display (Chip8::packDisplay) into 32-bit pixels,
+// nearest-neighbour scaled by an integer factor, into a caller's buffer. The
+// two colours are copied as they are, so any 32-bit pixel format works. The
+// widest kernel the CPU supports is picked at construction.
+class PixelExpander {
+private:
+    int scale;
+    uint32_t onColor;
+    uint32_t offColor;
+    PixelKernel kernel;
+
+    // For each output pixel in a row, the bit it shows within its half of the
+    // source row: pixels 0-31 come from the high word, 32-63 from the low one
+    uint32_t bitMasks[DISPLAY_WIDTH * MAX_PIXEL_SCALE];
+
+public:
+    // _scale is clamped to 1..MAX_PIXEL_SCALE
+    PixelExpander(int _scale, uint32_t _onColor, uint32_t _offColor);
+
+    static PixelKernel bestKernel();
+    static const char *kernelName(PixelKernel kernel);
+    // Falls back to the best supported kernel if this one isn't
+    void setKernel(PixelKernel _kernel);
+    PixelKernel getKernel() const { return kernel; }
+
+    int width() const { return DISPLAY_WIDTH * scale; }
+    int height() const { return DISPLAY_HEIGHT * scale; }
+
+    // packed is DISPLAY_WIDTH * DISPLAY_HEIGHT / 8 bytes. out holds height()
+    // rows of width() pixels, pitch pixels apart.
+    void expand(const uint8_t *packed, uint32_t *out, int pitch) const;
+};
+
+#endif // PIXEL_EXPANDER_H
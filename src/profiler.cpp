@@ -0,0 +1,169 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <set>
+
+#include "profiler.h"
+#include "disassembler.h"
+
+using namespace std;
+
+
+Profiler::Profiler(Chip8* _chip8) {
+    chip8 = _chip8;
+    memset(hits, 0, sizeof(hits));
+    totalInstructions = 0;
+
+    ProfileNode root;
+    root.function = INTERPRETER_SIZE;
+    root.parent = -1;
+    root.depth = 0;
+    root.selfInstructions = 0;
+    nodes.push_back(root);
+    current = 0;
+}
+
+Profiler::~Profiler() {
+    if (chip8->getInstrumentedDispatch() == this) {
+        chip8->setInstrumentedDispatch(nullptr);
+    }
+}
+
+const char *Profiler::name() {
+    return "profiler";
+}
+
+void Profiler::attach() {
+    this->resync(*chip8);
+    chip8->setInstrumentedDispatch(this);
+}
+
+int Profiler::run(Chip8 &machine, int count) {
+    for (int i = 0; i < count; i++) {
+        if (machine.isBlocked()) {
+            return i;
+        }
+        uint16_t pc = machine.getPc();
+        uint8_t sp = machine.getSp();
+        hits[pc & 0xFFF]++;
+        nodes[current].selfInstructions++;
+        totalInstructions++;
+
+        machine.step();
+
+        uint8_t newSp = machine.getSp();
+        if (newSp == sp) {
+            continue;
+        }
+        if (newSp == sp + 1 && nodes[current].depth == sp) {
+            // 2nnn, pc is the subroutine
+            current = this->child(current, machine.getPc());
+        } else if (newSp + 1 == sp && nodes[current].depth == sp) {
+            // 00EE
+            current = nodes[current].parent;
+        } else {
+            this->resync(machine);
+        }
+    }
+    return count;
+}
+
+int Profiler::child(int node, uint16_t function) {
+    auto found = nodes[node].children.find(function);
+    if (found != nodes[node].children.end()) {
+        return found->second;
+    }
+    ProfileNode added;
+    added.function = function;
+    added.parent = node;
+    added.depth = nodes[node].depth + 1;
+    added.selfInstructions = 0;
+    nodes.push_back(added);
+    nodes[node].children[function] = nodes.size() - 1;
+    return nodes.size() - 1;
+}
+
+// Rebuilds the call path from the return addresses on the guest stack; each
+// one points at the 2nnn that made the call.
+void Profiler::resync(Chip8 &machine) {
+    const uint16_t *stack = machine.getStack();
+    current = 0;
+    for (int i = 0; i < machine.getSp() && i < 16; i++) {
+        uint16_t call = stack[i] & 0xFFF;
+        uint16_t opcode = machine.readMemory(call) << 8 | machine.readMemory(call + 1);
+        current = this->child(current, (opcode & 0xF000) == 0x2000 ? opcode & 0x0FFF : call);
+    }
+}
+
+string Profiler::functionName(uint16_t function) {
+    char name[16];
+    snprintf(name, sizeof(name), "sub_%03X", function);
+    return name;
+}
+
+bool Profiler::write(const string &prefix) {
+    return this->writeCollapsed(prefix + ".folded") && this->writeAnnotated(prefix + ".txt");
+}
+
+bool Profiler::writeCollapsed(const string &path) {
+    ofstream out(path.c_str());
+    if (!out) {
+        cout << "Error writing " << path << endl;
+        return false;
+    }
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].selfInstructions == 0) {
+            continue;
+        }
+        string stack = "";
+        for (int node = i; node > 0; node = nodes[node].parent) {
+            stack = ";" + this->functionName(nodes[node].function) + stack;
+        }
+        out << "main" << stack << " " << nodes[i].selfInstructions << "\n";
+    }
+    return true;
+}
+
+bool Profiler::writeAnnotated(const string &path) {
+    ofstream out(path.c_str());
+    if (!out) {
+        cout << "Error writing " << path << endl;
+        return false;
+    }
+
+    // Self and inclusive totals per subroutine; recursion counts once
+    map<uint16_t, uint64_t> selfTotals;
+    map<uint16_t, uint64_t> inclusiveTotals;
+    for (size_t i = 1; i < nodes.size(); i++) {
+        selfTotals[nodes[i].function] += nodes[i].selfInstructions;
+        set<uint16_t> seen;
+        for (int node = i; node > 0; node = nodes[node].parent) {
+            if (seen.insert(nodes[node].function).second) {
+                inclusiveTotals[nodes[node].function] += nodes[i].selfInstructions;
+            }
+        }
+    }
+
+    double total = max<uint64_t>(totalInstructions, 1);
+    char line[128];
+    out << "Total " << totalInstructions << " instructions\n";
+    for (int address = 0; address + 1 < MEMORY_SIZE; address++) {
+        auto function = inclusiveTotals.find(address);
+        if (function != inclusiveTotals.end()) {
+            snprintf(line, sizeof(line), "\n%s:  %.2f%% inclusive, %.2f%% self\n",
+                this->functionName(address).c_str(), 100 * function->second / total,
+                100 * selfTotals[address] / total);
+            out << line;
+        }
+        if (hits[address] == 0) {
+            continue;
+        }
+        uint16_t opcode = chip8->readMemory(address) << 8 | chip8->readMemory(address + 1);
+        snprintf(line, sizeof(line), "  %03X: %04X  %-16s %6.2f%% %12llu\n", address, opcode,
+            disassemble(opcode).c_str(), 100 * hits[address] / total, (unsigned long long) hits[address]);
+        out << line;
+    }
+    return true;
+}
@@ -0,0 +1,57 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "constants.h"
+#include "executionBackend.h"
+
+using namespace std;
+
+// One distinct guest call stack; the root is the code outside any subroutine
+struct ProfileNode {
+    uint16_t function;
+    int parent;
+    int depth;
+    uint64_t selfInstructions;
+    map<uint16_t, int> children;
+};
+
+// Attributes every executed instruction to its address and to the guest call
+// stack it ran under. The stack is followed through changes in sp, so it also
+// copes with ROMs that never return, and is rebuilt from stack[] whenever the
+// two disagree. Each instruction is one emulated cycle here.
+class Profiler : public ExecutionBackend {
+private:
+    Chip8* chip8;
+
+    uint64_t hits[MEMORY_SIZE];
+    uint64_t totalInstructions;
+    vector<ProfileNode> nodes;
+    int current;
+
+    int child(int node, uint16_t function);
+    void resync(Chip8 &machine);
+    string functionName(uint16_t function);
+
+    bool writeCollapsed(const string &path);
+    bool writeAnnotated(const string &path);
+
+public:
+    Profiler(Chip8* _chip8);
+    ~Profiler();
+
+    const char *name() override;
+    int run(Chip8 &machine, int count) override;
+
+    void attach();
+    // Writes <prefix>.folded (collapsed stacks for flame graph tools) and
+    // <prefix>.txt (disassembly annotated with where the time went)
+    bool write(const string &prefix);
+};
+
+#endif // PROFILER_H
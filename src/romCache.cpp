@@ -0,0 +1,207 @@
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <sys/stat.h>
+
+#include "romCache.h"
+#include "chip8.h"
+#include "hash.h"
+
+using namespace std;
+
+
+shared_ptr<const void> LoadedRom::artifact(const string &name, const RomArtifactBuilder &build) const {
+    // Held while building, so each artifact is only ever built once
+    lock_guard<mutex> guard(artifactLock);
+    auto found = artifacts.find(name);
+    if (found != artifacts.end()) {
+        return found->second;
+    }
+    size_t bytes = 0;
+    shared_ptr<const void> built = build(*this, bytes);
+    artifacts[name] = built;
+    artifactBytes += bytes;
+    return built;
+}
+
+size_t LoadedRom::footprint() const {
+    return sizeof(LoadedRom) + bytes.size() + sizeof(Chip8MemoryImage) + artifactBytes;
+}
+
+
+RomCache::RomCache() {
+    total = 0;
+    capacity = DEFAULT_ROM_CACHE_CAPACITY;
+    hits = 0;
+    misses = 0;
+}
+
+// Never freed: machines in static storage may load ROMs during exit
+RomCache &RomCache::instance() {
+    static RomCache *cache = new RomCache();
+    return *cache;
+}
+
+void RomCache::setCapacity(size_t bytes) {
+    lock_guard<mutex> guard(lock);
+    capacity = bytes;
+    this->evictLocked();
+}
+
+size_t RomCache::getCapacity() {
+    lock_guard<mutex> guard(lock);
+    return capacity;
+}
+
+shared_ptr<const LoadedRom> RomCache::touchLocked(Entry &entry) {
+    recent.splice(recent.begin(), recent, entry.recent);
+    size_t bytes = entry.rom->footprint();
+    total += bytes - entry.bytes;
+    entry.bytes = bytes;
+    hits++;
+    // May evict the entry itself if it alone is over capacity
+    shared_ptr<const LoadedRom> rom = entry.rom;
+    this->evictLocked();
+    return rom;
+}
+
+shared_ptr<const LoadedRom> RomCache::findLocked(uint64_t hash, const uint8_t *rom, size_t size) {
+    auto found = entries.find(hash);
+    if (found == entries.end()) {
+        return nullptr;
+    }
+    const vector<uint8_t> &bytes = found->second.rom->bytes;
+    if (bytes.size() != size || memcmp(bytes.data(), rom, size) != 0) {
+        // Hash collision, the ROM already cached keeps the slot
+        return nullptr;
+    }
+    return this->touchLocked(found->second);
+}
+
+shared_ptr<const LoadedRom> RomCache::insertLocked(uint64_t hash, const uint8_t *rom, size_t size) {
+    misses++;
+    shared_ptr<LoadedRom> loaded = make_shared<LoadedRom>();
+    loaded->hash = hash;
+    loaded->bytes.assign(rom, rom + size);
+
+    Chip8MemoryImage image;
+    Chip8::buildImage(rom, size, image);
+    loaded->image = Chip8Memory::intern(image.bytes);
+
+    if (entries.count(hash) == 0) {
+        recent.push_front(hash);
+        Entry &entry = entries[hash];
+        entry.rom = loaded;
+        entry.recent = recent.begin();
+        entry.bytes = loaded->footprint();
+        total += entry.bytes;
+        this->evictLocked();
+    }
+    return loaded;
+}
+
+void RomCache::evictLocked() {
+    while (total > capacity && !recent.empty()) {
+        auto victim = entries.find(recent.back());
+        total -= victim->second.bytes;
+        for (const string &path : victim->second.paths) {
+            paths.erase(path);
+        }
+        entries.erase(victim);
+        recent.pop_back();
+    }
+}
+
+shared_ptr<const LoadedRom> RomCache::get(const uint8_t *rom, size_t size) {
+    if (size > (size_t) (MEMORY_SIZE - INTERPRETER_SIZE)) {
+        return nullptr;
+    }
+    uint64_t hash = fnv1a64(rom, size);
+    lock_guard<mutex> guard(lock);
+    shared_ptr<const LoadedRom> found = this->findLocked(hash, rom, size);
+    return found ? found : this->insertLocked(hash, rom, size);
+}
+
+shared_ptr<const LoadedRom> RomCache::load(const char *romPath) {
+    struct stat fileStat;
+    if (stat(romPath, &fileStat) != 0) {
+        cout << "Error running stat! (file probably doesn't exist)" << endl;
+        return nullptr;
+    }
+    int64_t modifiedNs = (int64_t) fileStat.st_mtim.tv_sec * 1000000000 + fileStat.st_mtim.tv_nsec;
+
+    {
+        lock_guard<mutex> guard(lock);
+        auto known = paths.find(romPath);
+        if (known != paths.end() && known->second.size == fileStat.st_size
+                && known->second.modifiedNs == modifiedNs) {
+            return this->touchLocked(entries[known->second.hash]);
+        }
+    }
+
+    if (fileStat.st_size > (MEMORY_SIZE - INTERPRETER_SIZE)) {
+        cout << "ROM too big!" << endl;
+        return nullptr;
+    }
+
+    // Read the file into a buffer, outside the lock
+    vector<char> romReadBuffer(fileStat.st_size);
+    ifstream romFile(romPath, ios::in | ios::binary);
+    romFile.read(romReadBuffer.data(), romReadBuffer.size());
+    if (!romFile) {
+        cout << "Error reading ROM" << endl;
+        return nullptr;
+    }
+    romFile.close();
+
+    const uint8_t *rom = (const uint8_t*) romReadBuffer.data();
+    size_t size = romReadBuffer.size();
+    uint64_t hash = fnv1a64(rom, size);
+    lock_guard<mutex> guard(lock);
+    shared_ptr<const LoadedRom> loaded = this->findLocked(hash, rom, size);
+    if (!loaded) {
+        loaded = this->insertLocked(hash, rom, size);
+    }
+    auto entry = entries.find(hash);
+    if (entry != entries.end() && entry->second.rom == loaded) {
+        // Only remembered while the ROM is cached, eviction forgets it
+        vector<string> &entryPaths = entry->second.paths;
+        if (find(entryPaths.begin(), entryPaths.end(), romPath) == entryPaths.end()) {
+            entryPaths.push_back(romPath);
+        }
+        PathEntry &known = paths[romPath];
+        known.size = fileStat.st_size;
+        known.modifiedNs = modifiedNs;
+        known.hash = hash;
+    }
+    return loaded;
+}
+
+size_t RomCache::size() {
+    lock_guard<mutex> guard(lock);
+    return entries.size();
+}
+
+size_t RomCache::footprint() {
+    lock_guard<mutex> guard(lock);
+    return total;
+}
+
+uint64_t RomCache::hitCount() {
+    lock_guard<mutex> guard(lock);
+    return hits;
+}
+
+uint64_t RomCache::missCount() {
+    lock_guard<mutex> guard(lock);
+    return misses;
+}
+
+void RomCache::clear() {
+    lock_guard<mutex> guard(lock);
+    entries.clear();
+    paths.clear();
+    recent.clear();
+    total = 0;
+}
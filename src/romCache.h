@@ -0,0 +1,102 @@
+#ifndef ROM_CACHE_H
+#define ROM_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "chip8Memory.h"
+
+struct LoadedRom;
+
+// Builds something from a ROM's bytes alone and reports how big it is
+typedef std::function<std::shared_ptr<const void>(const LoadedRom &rom, size_t &bytes)> RomArtifactBuilder;
+
+// A ROM as loaded, and everything worked out from it. Never changes once
+// built apart from gaining artifacts, so any number of machines on any
+// threads can share one.
+struct LoadedRom {
+    uint64_t hash;
+    std::vector<uint8_t> bytes;
+    // Font and ROM, what every machine running it starts from
+    std::shared_ptr<const Chip8MemoryImage> image;
+
+    // Built on first use by whichever machine asks, e.g. decoded blocks, and
+    // kept for as long as the ROM stays cached. Callers cast the result back.
+    std::shared_ptr<const void> artifact(const std::string &name, const RomArtifactBuilder &build) const;
+    size_t footprint() const;
+
+private:
+    mutable std::mutex artifactLock;
+    mutable std::map<std::string, std::shared_ptr<const void>> artifacts;
+    mutable std::atomic<size_t> artifactBytes{0};
+};
+
+const size_t DEFAULT_ROM_CACHE_CAPACITY = 16 << 20;
+
+// Process-wide, thread-safe cache of loaded ROMs keyed by content hash, so
+// loading a ROM any machine has loaded before shares it instead of reading
+// and decoding it again. Least recently loaded ROMs go first once the cache
+// holds more than its capacity; machines still running them keep them.
+class RomCache {
+private:
+    struct Entry {
+        std::shared_ptr<const LoadedRom> rom;
+        std::list<uint64_t>::iterator recent;
+        std::vector<std::string> paths;
+        // Footprint when last loaded, artifacts may have grown it since
+        size_t bytes;
+    };
+    // What a path held when it was last read
+    struct PathEntry {
+        int64_t size;
+        int64_t modifiedNs;
+        uint64_t hash;
+    };
+
+    std::mutex lock;
+    std::unordered_map<uint64_t, Entry> entries;
+    std::unordered_map<std::string, PathEntry> paths;
+    // Most recently loaded first
+    std::list<uint64_t> recent;
+    size_t total;
+    size_t capacity;
+    uint64_t hits;
+    uint64_t misses;
+
+    RomCache();
+    std::shared_ptr<const LoadedRom> touchLocked(Entry &entry);
+    std::shared_ptr<const LoadedRom> findLocked(uint64_t hash, const uint8_t *rom, size_t size);
+    std::shared_ptr<const LoadedRom> insertLocked(uint64_t hash, const uint8_t *rom, size_t size);
+    void evictLocked();
+
+public:
+    static RomCache &instance();
+
+    // Bytes; 0 keeps nothing that isn't in use
+    void setCapacity(size_t bytes);
+    size_t getCapacity();
+
+    // ROM bytes as loaded at 0x200, nullptr if they don't fit
+    std::shared_ptr<const LoadedRom> get(const uint8_t *rom, size_t size);
+    // Only reads the file again when its size or modification time changed
+    // since it was last loaded. nullptr on errors, which are printed.
+    std::shared_ptr<const LoadedRom> load(const char *romPath);
+
+    size_t size();
+    size_t footprint();
+    uint64_t hitCount();
+    uint64_t missCount();
+    // Drops every ROM, for tests
+    void clear();
+};
+
+#endif // ROM_CACHE_H
@@ -0,0 +1,281 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "runtimeMetrics.h"
+#include "constants.h"
+
+using namespace std;
+
+const char *METRICS_SOCKET_PREFIX = "unix:";
+// How long the publisher waits on the socket before looking for a new snapshot
+const int METRICS_POLL_MS = 100;
+
+
+void MetricsHistogram::observe(double seconds) {
+    int bucket = 0;
+    while (bucket < METRICS_BUCKETS && seconds > METRICS_BUCKET_BOUNDS[bucket]) {
+        bucket++;
+    }
+    counts[bucket]++;
+    count++;
+    sum += seconds;
+}
+
+static void formatValue(string &out, const char *name, const char *type, const char *help, double value) {
+    char line[256];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name, help, name, type, name, value);
+    out += line;
+}
+
+static void formatHistogram(string &out, const char *name, const char *help, const MetricsHistogram &histogram) {
+    char line[256];
+    snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+    out += line;
+    uint64_t cumulative = 0;
+    for (int bucket = 0; bucket <= METRICS_BUCKETS; bucket++) {
+        cumulative += histogram.counts[bucket];
+        if (bucket < METRICS_BUCKETS) {
+            snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", name, METRICS_BUCKET_BOUNDS[bucket],
+                (unsigned long long) cumulative);
+        } else {
+            snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long) cumulative);
+        }
+        out += line;
+    }
+    snprintf(line, sizeof(line), "%s_sum %.17g\n%s_count %llu\n", name, histogram.sum, name,
+        (unsigned long long) histogram.count);
+    out += line;
+}
+
+string formatMetrics(const MetricsSnapshot &snapshot) {
+    string out;
+    formatValue(out, "chip8_instructions_total", "counter", "Instructions executed.", snapshot.instructions);
+    formatValue(out, "chip8_emulated_frames_total", "counter", "60Hz frames emulated.", snapshot.emulatedFrames);
+    formatValue(out, "chip8_presented_frames_total", "counter", "Frames presented to the window.",
+        snapshot.presentedFrames);
+    formatValue(out, "chip8_dropped_frames_total", "counter",
+        "Emulated frames skipped after the host stalled.", snapshot.droppedFrames);
+    formatValue(out, "chip8_run_ahead_instructions_total", "counter",
+        "Instructions emulated ahead of the machine and thrown away.", snapshot.runAheadInstructions);
+    formatValue(out, "chip8_instructions_per_second", "gauge",
+        "Instructions per second over the last interval.", snapshot.instructionsPerSecond);
+    formatValue(out, "chip8_emulated_frames_per_second", "gauge",
+        "Emulated frames per second over the last interval, 60 when keeping up.",
+        snapshot.emulatedFramesPerSecond);
+    formatValue(out, "chip8_host_frames_per_second", "gauge",
+        "Presented frames per second over the last interval.", snapshot.hostFramesPerSecond);
+    formatHistogram(out, "chip8_frame_time_seconds", "Time between presents.", snapshot.frameTime);
+    formatHistogram(out, "chip8_present_time_seconds", "Time spent uploading and presenting a frame.",
+        snapshot.presentTime);
+    formatHistogram(out, "chip8_sleep_overshoot_seconds", "How late sleeps woke up.", snapshot.sleepOvershoot);
+    formatHistogram(out, "chip8_run_ahead_seconds", "Time spent running ahead per pass.", snapshot.runAheadTime);
+    return out;
+}
+
+
+RuntimeMetrics::RuntimeMetrics() {
+    memset(&current, 0, sizeof(current));
+    memset(&intervalStart, 0, sizeof(intervalStart));
+    memset(&published, 0, sizeof(published));
+    droppedInstructions = 0;
+    intervalNs = 0;
+    intervalStartNs = 0;
+    lastPresentNs = 0;
+    presentStartNs = 0;
+    publishedGeneration = 0;
+    listenFd = -1;
+    stopping = false;
+}
+
+RuntimeMetrics::~RuntimeMetrics() {
+    this->close();
+}
+
+uint64_t RuntimeMetrics::nowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool RuntimeMetrics::open(const char *destination, int intervalMS) {
+    if (intervalMS < 1) {
+        cout << "Metrics interval must be at least 1ms" << endl;
+        return false;
+    }
+    intervalNs = (uint64_t) intervalMS * 1000000;
+    intervalStartNs = nowNs();
+
+    size_t prefixLength = strlen(METRICS_SOCKET_PREFIX);
+    if (strncmp(destination, METRICS_SOCKET_PREFIX, prefixLength) != 0) {
+        filePath = destination;
+    } else {
+        socketPath = destination + prefixLength;
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            cout << "Metrics socket path too long: " << socketPath << endl;
+            return false;
+        }
+        strcpy(address.sun_path, socketPath.c_str());
+        unlink(socketPath.c_str());
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0
+                || bind(listenFd, (sockaddr*) &address, sizeof(address)) != 0
+                || listen(listenFd, 4) != 0) {
+            cout << "Error listening on " << socketPath << ": " << strerror(errno) << endl;
+            if (listenFd >= 0) {
+                ::close(listenFd);
+                listenFd = -1;
+            }
+            return false;
+        }
+    }
+
+    stopping = false;
+    publisherThread = thread(&RuntimeMetrics::publishLoop, this);
+    return true;
+}
+
+void RuntimeMetrics::close() {
+    if (publisherThread.joinable()) {
+        stopping = true;
+        publisherThread.join();
+    }
+    if (listenFd >= 0) {
+        ::close(listenFd);
+        unlink(socketPath.c_str());
+        listenFd = -1;
+    }
+}
+
+void RuntimeMetrics::instructionsDropped(uint64_t count) {
+    droppedInstructions += count;
+    current.droppedFrames = droppedInstructions / INSTRUCTIONS_PER_FRAME;
+}
+
+void RuntimeMetrics::presentStarted() {
+    presentStartNs = nowNs();
+}
+
+void RuntimeMetrics::presentFinished() {
+    uint64_t now = nowNs();
+    current.presentTime.observe((now - presentStartNs) * 1e-9);
+    if (lastPresentNs != 0) {
+        current.frameTime.observe((now - lastPresentNs) * 1e-9);
+    }
+    lastPresentNs = now;
+    current.presentedFrames++;
+}
+
+void RuntimeMetrics::slept(uint64_t requestedNs, uint64_t startNs) {
+    uint64_t elapsed = nowNs() - startNs;
+    current.sleepOvershoot.observe(elapsed > requestedNs ? (elapsed - requestedNs) * 1e-9 : 0);
+}
+
+void RuntimeMetrics::ranAhead(int instructions, uint64_t elapsedNs) {
+    current.runAheadInstructions += instructions;
+    current.runAheadTime.observe(elapsedNs * 1e-9);
+}
+
+void RuntimeMetrics::tick() {
+    if (intervalNs == 0) {
+        return;
+    }
+    uint64_t now = nowNs();
+    if (now - intervalStartNs < intervalNs) {
+        return;
+    }
+
+    double seconds = (now - intervalStartNs) * 1e-9;
+    current.instructionsPerSecond = (current.instructions - intervalStart.instructions) / seconds;
+    current.emulatedFramesPerSecond = (current.emulatedFrames - intervalStart.emulatedFrames) / seconds;
+    current.hostFramesPerSecond = (current.presentedFrames - intervalStart.presentedFrames) / seconds;
+    intervalStart = current;
+    intervalStartNs = now;
+
+    lock_guard<mutex> guard(lock);
+    published = current;
+    publishedGeneration++;
+}
+
+void RuntimeMetrics::publishLoop() {
+    uint64_t writtenGeneration = 0;
+    while (!stopping) {
+        if (listenFd >= 0) {
+            pollfd listening = { listenFd, POLLIN, 0 };
+            if (poll(&listening, 1, METRICS_POLL_MS) > 0) {
+                int fd = accept(listenFd, nullptr, nullptr);
+                if (fd >= 0) {
+                    this->serveClient(fd);
+                }
+            }
+            continue;
+        }
+
+        MetricsSnapshot snapshot;
+        uint64_t generation;
+        {
+            lock_guard<mutex> guard(lock);
+            snapshot = published;
+            generation = publishedGeneration;
+        }
+        if (generation != writtenGeneration) {
+            this->writeFile(snapshot);
+            writtenGeneration = generation;
+        }
+        this_thread::sleep_for(chrono::milliseconds(METRICS_POLL_MS));
+    }
+}
+
+// Answers anything with the latest snapshot as an HTTP response, so both
+// Prometheus-style scrapers and a plain socket read work
+void RuntimeMetrics::serveClient(int fd) {
+    // Whatever request there is, without waiting long for one
+    pollfd client = { fd, POLLIN, 0 };
+    if (poll(&client, 1, METRICS_POLL_MS) > 0) {
+        char request[1024];
+        ssize_t ignored = read(fd, request, sizeof(request));
+        (void) ignored;
+    }
+
+    MetricsSnapshot snapshot;
+    {
+        lock_guard<mutex> guard(lock);
+        snapshot = published;
+    }
+    string body = formatMetrics(snapshot);
+    string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+        + to_string(body.size()) + "\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t n = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            break;
+        }
+        sent += n;
+    }
+    ::close(fd);
+}
+
+// Written next to the target and renamed over it, so readers never see half
+void RuntimeMetrics::writeFile(const MetricsSnapshot &snapshot) {
+    string body = formatMetrics(snapshot);
+    string temporary = filePath + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "w");
+    if (file == nullptr) {
+        return;
+    }
+    bool written = fwrite(body.data(), 1, body.size(), file) == body.size();
+    written = fclose(file) == 0 && written;
+    if (written) {
+        rename(temporary.c_str(), filePath.c_str());
+    }
+}
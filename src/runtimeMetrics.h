@@ -0,0 +1,99 @@
+#ifndef RUNTIME_METRICS_H
+#define RUNTIME_METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+const int METRICS_BUCKETS = 13;
+// Upper bounds in seconds, around the 16.7ms frame
+const double METRICS_BUCKET_BOUNDS[METRICS_BUCKETS] = {
+    0.0005, 0.001, 0.002, 0.004, 0.008, 0.012, 0.016, 0.017, 0.020, 0.025, 0.033, 0.050, 0.100
+};
+
+struct MetricsHistogram {
+    // Per bucket, the last one is +Inf; made cumulative when formatted
+    uint64_t counts[METRICS_BUCKETS + 1];
+    uint64_t count;
+    double sum;
+
+    void observe(double seconds);
+};
+
+struct MetricsSnapshot {
+    uint64_t instructions;
+    uint64_t emulatedFrames;
+    uint64_t presentedFrames;
+    uint64_t droppedFrames;
+    // Extra instructions emulated for run-ahead
+    uint64_t runAheadInstructions;
+    // Over the last publishing interval
+    double instructionsPerSecond;
+    double emulatedFramesPerSecond;
+    double hostFramesPerSecond;
+    // Between presents, inside present, and past the requested wake-up
+    MetricsHistogram frameTime;
+    MetricsHistogram presentTime;
+    MetricsHistogram sleepOvershoot;
+    MetricsHistogram runAheadTime;
+};
+
+// Prometheus text exposition of a snapshot
+std::string formatMetrics(const MetricsSnapshot &snapshot);
+
+// Runtime counters for the window loop, published every interval in
+// Prometheus text format, either rewritten into a file (for a textfile
+// collector) or served to whoever connects to a Unix socket ("unix:<path>",
+// e.g. `curl --unix-socket <path> http://localhost/metrics`). Collection is
+// a few increments and clock reads per frame on the emulation thread; the
+// formatting and I/O happen on a background thread.
+class RuntimeMetrics {
+private:
+    // Emulation thread only
+    MetricsSnapshot current;
+    uint64_t droppedInstructions;
+    uint64_t intervalNs;
+    uint64_t intervalStartNs;
+    MetricsSnapshot intervalStart;
+    uint64_t lastPresentNs;
+    uint64_t presentStartNs;
+
+    // Handed to the publisher under the lock
+    std::mutex lock;
+    MetricsSnapshot published;
+    uint64_t publishedGeneration;
+
+    std::string filePath;
+    int listenFd;
+    std::string socketPath;
+    std::thread publisherThread;
+    std::atomic<bool> stopping;
+
+    void publishLoop();
+    void serveClient(int fd);
+    void writeFile(const MetricsSnapshot &snapshot);
+
+public:
+    RuntimeMetrics();
+    ~RuntimeMetrics();
+
+    // A file path, or "unix:" and a socket path
+    bool open(const char *destination, int intervalMS);
+    void close();
+
+    static uint64_t nowNs();
+
+    void instructionsRun(int count) { current.instructions += count; }
+    void emulatedFrame() { current.emulatedFrames++; }
+    void instructionsDropped(uint64_t count);
+    void presentStarted();
+    void presentFinished();
+    void slept(uint64_t requestedNs, uint64_t startNs);
+    void ranAhead(int instructions, uint64_t elapsedNs);
+    // Once per loop iteration, publishes when the interval is up
+    void tick();
+};
+
+#endif // RUNTIME_METRICS_H
@@ -0,0 +1,50 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stddef.h>
+
+// Fixed-size lock-free queue for exactly one producer thread and one consumer
+// thread. Neither side allocates or blocks, so the consumer side is safe to
+// use from an audio callback. `Capacity` must be a power of two.
+template <typename T, size_t Capacity>
+class SpscRing {
+private:
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+    T items[Capacity];
+    std::atomic<size_t> head; // next slot to read, owned by the consumer
+    std::atomic<size_t> tail; // next slot to write, owned by the producer
+
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // Producer side. Returns false if the ring is full.
+    bool push(const T &item) {
+        size_t currentTail = tail.load(std::memory_order_relaxed);
+        if (currentTail - head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        items[currentTail & (Capacity - 1)] = item;
+        tail.store(currentTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool empty() const {
+        return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+    }
+
+    // Consumer side. Returns false if the ring is empty.
+    bool pop(T &item) {
+        size_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = items[currentHead & (Capacity - 1)];
+        head.store(currentHead + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,235 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "constants.h"
+#include "stateExplorer.h"
+
+using namespace std;
+
+
+StateExplorer::StateExplorer(const ExplorerOptions &_options) : nextState(0) {
+    options = _options;
+    if (options.inputs.empty()) {
+        options.inputs.push_back(0);
+        for (int key = 0; key < 16; key++) {
+            options.inputs.push_back(1 << key);
+        }
+    }
+    options.framesPerStep = max(options.framesPerStep, 1);
+    options.maxFrontier = max(options.maxFrontier, (size_t) 1);
+    faulted = 0;
+    duplicates = 0;
+}
+
+string StateExplorer::inputPath(uint32_t id) const {
+    vector<uint16_t> inputs;
+    while (states[id].parent != id) {
+        inputs.push_back(states[id].input);
+        id = states[id].parent;
+    }
+    // Held keys by hex digit, '-' for none, one step per word
+    string path;
+    for (auto input = inputs.rbegin(); input != inputs.rend(); ++input) {
+        if (!path.empty()) {
+            path += ' ';
+        }
+        if (*input == 0) {
+            path += '-';
+        }
+        for (int key = 0; key < 16; key++) {
+            if ((*input >> key) & 1) {
+                path += "0123456789ABCDEF"[key];
+            }
+        }
+    }
+    return path;
+}
+
+void StateExplorer::writeScreen(FILE *file, uint32_t id, const Chip8 &machine) const {
+    fprintf(file, "# state %u depth %u: %s\n", id, states[id].depth, this->inputPath(id).c_str());
+    char line[DISPLAY_WIDTH + 2];
+    for (int y = 0; y < DISPLAY_HEIGHT; y++) {
+        for (int x = 0; x < DISPLAY_WIDTH; x++) {
+            line[x] = displayPixel(machine.displayBuffer, x, y) ? '#' : '.';
+        }
+        line[DISPLAY_WIDTH] = '\n';
+        line[DISPLAY_WIDTH + 1] = '\0';
+        fputs(line, file);
+    }
+    fputc('\n', file);
+}
+
+void StateExplorer::expand(size_t index) {
+    vector<Candidate> &children = expanded[index];
+    children.clear();
+    for (uint16_t input : options.inputs) {
+        Candidate child = { frontier[index], frontierIds[index], input, 0, 0 };
+        // Every step presses its keys afresh, so what the parent held doesn't
+        // matter and the keypad can stay out of the hash
+        child.machine.setKeys(0);
+        child.machine.setKeys(input);
+        for (int frame = 0; frame < options.framesPerStep && !child.machine.isFaulted(); frame++) {
+            child.machine.runFrame();
+        }
+        if (child.machine.isFaulted()) {
+            faulted++;
+            continue;
+        }
+        child.hash = child.machine.explorationHash();
+        // Nothing is added to seen while the workers run, and siblings are
+        // compared here; merge() catches the same state reached from two parents
+        bool known = seen.count(child.hash) > 0;
+        for (size_t i = 0; i < children.size() && !known; i++) {
+            known = children[i].hash == child.hash;
+        }
+        if (known) {
+            duplicates++;
+            continue;
+        }
+        child.screen = child.machine.displayContentHash();
+        children.push_back(move(child));
+    }
+}
+
+void StateExplorer::worker() {
+    while (true) {
+        size_t index = nextState++;
+        if (index >= frontier.size()) {
+            return;
+        }
+        this->expand(index);
+    }
+}
+
+bool StateExplorer::merge(int depth, FILE *screensFile) {
+    vector<Chip8> next;
+    vector<uint32_t> nextIds;
+    vector<bool> novel;
+    for (vector<Candidate> &children : expanded) {
+        for (Candidate &child : children) {
+            if (states.size() >= options.maxStates) {
+                break;
+            }
+            if (!seen.insert(child.hash).second) {
+                duplicates++;
+                continue;
+            }
+            uint32_t id = states.size();
+            ExploredState state = { child.parent, child.input, (uint32_t) depth };
+            states.push_back(state);
+            bool newScreen = screens.insert(child.screen).second;
+            if (newScreen && screensFile != nullptr) {
+                this->writeScreen(screensFile, id, child.machine);
+            }
+            next.push_back(move(child.machine));
+            nextIds.push_back(id);
+            novel.push_back(newScreen);
+        }
+        children.clear();
+    }
+
+    if (next.size() > options.maxFrontier && options.noveltyFirst) {
+        // Stable, so the order within each half stays breadth-first
+        vector<size_t> order(next.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        stable_partition(order.begin(), order.end(), [&](size_t i) { return novel[i]; });
+        order.resize(options.maxFrontier);
+        frontier.clear();
+        frontierIds.clear();
+        for (size_t i : order) {
+            frontier.push_back(move(next[i]));
+            frontierIds.push_back(nextIds[i]);
+        }
+    } else {
+        if (next.size() > options.maxFrontier) {
+            next.resize(options.maxFrontier);
+            nextIds.resize(options.maxFrontier);
+        }
+        frontier.swap(next);
+        frontierIds.swap(nextIds);
+    }
+    return !frontier.empty();
+}
+
+bool StateExplorer::run(const char *romPath) {
+    Chip8 start;
+    if (!start.load(romPath)) {
+        cout << "Could not load " << romPath << endl;
+        return false;
+    }
+    start.seed(options.seed);
+
+    FILE *screensFile = nullptr;
+    if (options.screensPath != nullptr) {
+        screensFile = fopen(options.screensPath, "w");
+        if (screensFile == nullptr) {
+            cout << "Could not write " << options.screensPath << endl;
+            return false;
+        }
+    }
+
+    auto startTime = chrono::steady_clock::now();
+    states.clear();
+    seen.clear();
+    screens.clear();
+    faulted = 0;
+    duplicates = 0;
+
+    // Asking once starts the incremental hashes, which every copy inherits
+    ExploredState root = { 0, 0, 0 };
+    states.push_back(root);
+    seen.insert(start.explorationHash());
+    screens.insert(start.displayContentHash());
+    if (screensFile != nullptr) {
+        this->writeScreen(screensFile, 0, start);
+    }
+    frontier.assign(1, start);
+    frontierIds.assign(1, 0);
+
+    int threadCount = options.threads > 0 ? options.threads : (int) thread::hardware_concurrency();
+    threadCount = max(threadCount, 1);
+    int depth = 0;
+    auto reportTime = startTime;
+    while (states.size() < options.maxStates && (options.maxDepth == 0 || depth < options.maxDepth)) {
+        depth++;
+        expanded.resize(frontier.size());
+        nextState = 0;
+        int workers = min(threadCount, (int) frontier.size());
+        vector<thread> threads;
+        for (int i = 1; i < workers; i++) {
+            threads.push_back(thread(&StateExplorer::worker, this));
+        }
+        this->worker();
+        for (thread &t : threads) {
+            t.join();
+        }
+
+        bool more = this->merge(depth, screensFile);
+        auto now = chrono::steady_clock::now();
+        if (now - reportTime >= chrono::seconds(1)) {
+            cout << "Depth " << depth << ": " << states.size() << " states, "
+                << screens.size() << " screens, " << frontier.size() << " to expand" << endl;
+            reportTime = now;
+        }
+        if (!more) {
+            break;
+        }
+    }
+
+    if (screensFile != nullptr) {
+        fclose(screensFile);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    // Every state expanded, kept or not, cost the same to produce
+    uint64_t produced = states.size() - 1 + duplicates + faulted;
+    cout << "Explored " << states.size() << " states (" << screens.size() << " distinct screens) to depth "
+        << this->depthReached() << " with " << threadCount << " threads; "
+        << duplicates << " duplicates and " << faulted << " faults dropped, "
+        << (uint64_t) (seconds > 0 ? produced / seconds * 60 : 0) << " states per minute" << endl;
+    return true;
+}
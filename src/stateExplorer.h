@@ -0,0 +1,91 @@
+#ifndef STATE_EXPLORER_H
+#define STATE_EXPLORER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "chip8.h"
+
+using namespace std;
+
+struct ExplorerOptions {
+    // Key masks tried from every state, default: no keys, then each key alone
+    vector<uint16_t> inputs;
+    int framesPerStep = 1;
+    uint32_t seed = 1;
+
+    // Stops at whichever comes first
+    uint64_t maxStates = 1000000;
+    int maxDepth = 0; // 0 = no limit
+    // States expanded per step, the rest are dropped
+    size_t maxFrontier = 20000;
+    // Keep states showing a screen nobody has seen yet ahead of the others
+    // when the frontier is cut down
+    bool noveltyFirst = true;
+    int threads = 0; // 0 = one per core
+
+    // Where each new screen is written with the inputs that reach it
+    const char *screensPath = nullptr;
+};
+
+// How a state was first reached
+struct ExploredState {
+    uint32_t parent; // Itself for the starting state
+    uint16_t input;
+    uint32_t depth;
+};
+
+// Breadth-first search over everything a ROM can do: every state in the
+// frontier is copied once per input, the copies run framesPerStep frames
+// with those keys held, and only states never seen before carry on. States
+// are told apart by Chip8::explorationHash(), which follows writes to
+// memory and the display instead of rehashing 4KB per state, and copies of
+// a machine share memory pages until they write them. Steps expand the
+// frontier in parallel, then merge the new states on one thread in frontier
+// order, so a run gives the same result with any number of threads.
+class StateExplorer {
+private:
+    struct Candidate {
+        Chip8 machine;
+        uint32_t parent;
+        uint16_t input;
+        uint64_t hash;
+        uint64_t screen;
+    };
+
+    ExplorerOptions options;
+    vector<ExploredState> states;
+    unordered_set<uint64_t> seen;
+    unordered_set<uint64_t> screens;
+    atomic<uint64_t> faulted;
+    atomic<uint64_t> duplicates;
+
+    // States to expand this step, with their ids
+    vector<Chip8> frontier;
+    vector<uint32_t> frontierIds;
+    // Filled by the workers, one list per frontier state
+    vector<vector<Candidate>> expanded;
+    atomic<size_t> nextState;
+
+    void worker();
+    void expand(size_t index);
+    // Takes the new states out of expanded, returns false once there are none
+    bool merge(int depth, FILE *screensFile);
+    string inputPath(uint32_t id) const;
+    void writeScreen(FILE *file, uint32_t id, const Chip8 &machine) const;
+
+public:
+    StateExplorer(const ExplorerOptions &_options);
+
+    // False if the ROM can't be loaded or the screens file can't be written
+    bool run(const char *romPath);
+
+    uint64_t stateCount() const { return states.size(); }
+    uint64_t screenCount() const { return screens.size(); }
+    int depthReached() const { return states.empty() ? 0 : states.back().depth; }
+};
+
+#endif // STATE_EXPLORER_H
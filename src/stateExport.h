@@ -0,0 +1,175 @@
+#ifndef STATE_EXPORT_H
+#define STATE_EXPORT_H
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Layout of the POSIX shared memory object `chip8 --export <name>` publishes
+// to, and a header-only reader for it in plain C, so any local process can
+// watch a running machine. Include this header and link with -lrt on older
+// glibc.
+//
+// The object is a Chip8ExportHeader followed by CHIP8_EXPORT_SLOTS slots.
+// Frame n goes into slot n % CHIP8_EXPORT_SLOTS under that slot's seqlock:
+// the sequence is odd while the writer fills it. Then published becomes
+// n + 1. The writer never waits for readers, and readers never make a
+// syscall after attaching.
+//
+//   chip8_export_reader reader;
+//   if (chip8_export_attach(&reader, "/chip8-state") == 0) {
+//       uint32_t ticket;
+//       const Chip8ExportFrame *frame = chip8_export_poll(&reader, &ticket);
+//       if (frame != NULL) {
+//           ... read frame->display in place ...
+//           if (!chip8_export_still_valid(&reader, frame, ticket)) {
+//               ... overwritten while reading, drop it ...
+//           }
+//       }
+//       chip8_export_detach(&reader);
+//   }
+//
+// A frame has to be read within CHIP8_EXPORT_SLOTS - 1 frames of being
+// published, about 50ms at normal speed. chip8_export_copy() is the simpler
+// choice when a copy of a few hundred bytes is fine.
+
+#define CHIP8_EXPORT_MAGIC 0x58453843 // "C8EX"
+#define CHIP8_EXPORT_VERSION 1
+#define CHIP8_EXPORT_SLOTS 4
+
+// Everything is naturally aligned, there is no padding
+typedef struct Chip8ExportFrame {
+    // Emulated frames since the run started, this one included
+    uint64_t frame;
+    // One bit per pixel, 8 bytes per row, most significant bit leftmost
+    uint8_t display[64 * 32 / 8];
+    uint8_t V[16];
+    uint16_t stack[16];
+    uint16_t I;
+    uint16_t pc;
+    uint8_t sp;
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    // Chip8Status, CHIP8_STATUS_* in libchip8.h
+    uint8_t status;
+} Chip8ExportFrame;
+
+typedef struct Chip8ExportSlot {
+    uint32_t sequence;
+    uint32_t reserved;
+    Chip8ExportFrame state;
+} Chip8ExportSlot;
+
+typedef struct Chip8ExportHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slotBytes;
+    // Frames published so far
+    uint64_t published;
+    // Set when the writer exits
+    uint32_t closed;
+    uint32_t reserved;
+} Chip8ExportHeader;
+
+typedef struct chip8_export_reader {
+    const Chip8ExportHeader *header;
+    const Chip8ExportSlot *slots;
+    size_t size;
+    // published as of the last frame handed out, and of the one being read
+    uint64_t seen;
+    uint64_t pending;
+} chip8_export_reader;
+
+// Maps the object read-only. Returns 0 on success.
+static inline int chip8_export_attach(chip8_export_reader *reader, const char *name) {
+    memset(reader, 0, sizeof(*reader));
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat info;
+    size_t size = sizeof(Chip8ExportHeader) + CHIP8_EXPORT_SLOTS * sizeof(Chip8ExportSlot);
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < size) {
+        close(fd);
+        return -1;
+    }
+    void *mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return -1;
+    }
+    const Chip8ExportHeader *header = (const Chip8ExportHeader *) mapped;
+    if (header->magic != CHIP8_EXPORT_MAGIC || header->version != CHIP8_EXPORT_VERSION
+            || header->slots != CHIP8_EXPORT_SLOTS || header->slotBytes != sizeof(Chip8ExportSlot)) {
+        munmap(mapped, size);
+        return -1;
+    }
+    reader->header = header;
+    reader->slots = (const Chip8ExportSlot *) (header + 1);
+    reader->size = size;
+    return 0;
+}
+
+static inline void chip8_export_detach(chip8_export_reader *reader) {
+    if (reader->header != NULL) {
+        munmap((void *) reader->header, reader->size);
+        reader->header = NULL;
+    }
+}
+
+// True once the writer has exited; the last frame stays readable
+static inline int chip8_export_closed(const chip8_export_reader *reader) {
+    return __atomic_load_n(&reader->header->closed, __ATOMIC_ACQUIRE) != 0;
+}
+
+// The newest frame, in place, if one was published since the last frame
+// chip8_export_still_valid() accepted; NULL otherwise.
+static inline const Chip8ExportFrame *chip8_export_poll(chip8_export_reader *reader, uint32_t *ticket) {
+    uint64_t published = __atomic_load_n(&reader->header->published, __ATOMIC_ACQUIRE);
+    if (published == reader->seen) {
+        return NULL;
+    }
+    const Chip8ExportSlot *slot = &reader->slots[(published - 1) % CHIP8_EXPORT_SLOTS];
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if (sequence & 1) {
+        // Already being written again; a newer one is coming
+        return NULL;
+    }
+    *ticket = sequence;
+    reader->pending = published;
+    return &slot->state;
+}
+
+// Whether everything read from frame since chip8_export_poll() is from one
+// frame. Only then does the next poll move on to a newer frame.
+static inline int chip8_export_still_valid(chip8_export_reader *reader, const Chip8ExportFrame *frame, uint32_t ticket) {
+    const Chip8ExportSlot *slot = (const Chip8ExportSlot *) ((const char *) frame - offsetof(Chip8ExportSlot, state));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != ticket) {
+        return 0;
+    }
+    reader->seen = reader->pending;
+    return 1;
+}
+
+// Copies the newest frame out if there is a new one. Returns 1 if it did.
+static inline int chip8_export_copy(chip8_export_reader *reader, Chip8ExportFrame *out) {
+    for (;;) {
+        uint32_t ticket;
+        const Chip8ExportFrame *frame = chip8_export_poll(reader, &ticket);
+        if (frame == NULL) {
+            return 0;
+        }
+        memcpy(out, frame, sizeof(*out));
+        if (chip8_export_still_valid(reader, frame, ticket)) {
+            return 1;
+        }
+    }
+}
+
+#endif // STATE_EXPORT_H
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+
+#include "stateExporter.h"
+
+using namespace std;
+
+
+StateExporter::StateExporter() {
+    name = nullptr;
+    fd = -1;
+    header = nullptr;
+    slots = nullptr;
+    size = 0;
+    published = 0;
+}
+
+StateExporter::~StateExporter() {
+    this->close();
+}
+
+bool StateExporter::open(const char *_name) {
+    name = _name;
+    size = sizeof(Chip8ExportHeader) + CHIP8_EXPORT_SLOTS * sizeof(Chip8ExportSlot);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) != 0) {
+        cout << "Error creating shared memory " << name << ": " << strerror(errno) << endl;
+        return false;
+    }
+    void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        cout << "Error mapping shared memory: " << strerror(errno) << endl;
+        return false;
+    }
+    header = (Chip8ExportHeader*) mapped;
+    slots = (Chip8ExportSlot*) (header + 1);
+    // Fresh from ftruncate, so all zero; the magic goes in last so a reader
+    // attaching now doesn't take a half-written header
+    header->version = CHIP8_EXPORT_VERSION;
+    header->slots = CHIP8_EXPORT_SLOTS;
+    header->slotBytes = sizeof(Chip8ExportSlot);
+    __atomic_store_n(&header->magic, CHIP8_EXPORT_MAGIC, __ATOMIC_RELEASE);
+    cout << "Exporting state to shared memory " << name << endl;
+    return true;
+}
+
+void StateExporter::publish(const Chip8 *chip8, uint64_t frame) {
+    Chip8ExportSlot *slot = &slots[published % CHIP8_EXPORT_SLOTS];
+    uint32_t sequence = slot->sequence;
+
+    // Odd while the slot is being written
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    Chip8ExportFrame &state = slot->state;
+    state.frame = frame;
+    chip8->packDisplay(state.display);
+    memcpy(state.V, chip8->getRegisters(), sizeof(state.V));
+    memcpy(state.stack, chip8->getStack(), sizeof(state.stack));
+    state.I = chip8->getI();
+    state.pc = chip8->getPc();
+    state.sp = chip8->getSp();
+    state.delayTimer = chip8->getDelayTimer();
+    state.soundTimer = chip8->getSoundTimer();
+    state.status = chip8->getStatus();
+    __atomic_store_n(&slot->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+    published++;
+    __atomic_store_n(&header->published, published, __ATOMIC_RELEASE);
+}
+
+void StateExporter::close() {
+    if (header != nullptr) {
+        __atomic_store_n(&header->closed, 1, __ATOMIC_RELEASE);
+        munmap(header, size);
+        header = nullptr;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        // Readers already attached keep their mapping
+        shm_unlink(name);
+        fd = -1;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef STATE_EXPORTER_H
+#define STATE_EXPORTER_H
+
+#include <stdint.h>
+
+#include "chip8.h"
+#include "stateExport.h"
+
+// Publishes a machine's display and registers to POSIX shared memory once
+// per emulated frame, for viewers and recorders in other processes (see
+// stateExport.h for the layout and the reader). Publishing is a seqlocked
+// copy of a few hundred bytes and never waits on readers.
+class StateExporter {
+private:
+    const char *name;
+    int fd;
+    Chip8ExportHeader *header;
+    Chip8ExportSlot *slots;
+    size_t size;
+    uint64_t published;
+
+public:
+    StateExporter();
+    ~StateExporter();
+
+    // Creates (or replaces) the object, e.g. "/chip8-state"
+    bool open(const char *_name);
+    void publish(const Chip8 *chip8, uint64_t frame);
+    // Tells readers nothing more is coming and removes the name
+    void close();
+
+    uint64_t publishedCount() const { return published; }
+};
+
+#endif // STATE_EXPORTER_H
@@ -0,0 +1,148 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#include "terminalRenderer.h"
+#include "constants.h"
+
+using namespace std;
+
+static const char *HALF_BLOCKS[] = { " ", "▀", "▄", "█" };
+
+// Braille dots by pixel within a cell, x then y; dots 7 and 8 came last
+static const uint8_t BRAILLE_DOTS[2][4] = {
+    { 0x01, 0x02, 0x04, 0x40 },
+    { 0x08, 0x10, 0x20, 0x80 },
+};
+
+// Unchanged cells between two changed ones on a row are sent again rather
+// than moved over when they are cheaper than the cursor move
+const int MAX_RESENT_CELLS = 2;
+
+
+TerminalRenderer::TerminalRenderer(int _fd, TerminalCells _cells) {
+    fd = _fd;
+    cells = _cells;
+    if (cells == TERMINAL_BRAILLE) {
+        columns = DISPLAY_WIDTH / 2;
+        rows = DISPLAY_HEIGHT / 4;
+    } else {
+        columns = DISPLAY_WIDTH;
+        rows = DISPLAY_HEIGHT / 2;
+    }
+    shown.assign(columns * rows, 0);
+    drawn = false;
+    frames = 0;
+    bytes = 0;
+}
+
+TerminalRenderer::~TerminalRenderer() {
+    this->close();
+}
+
+bool TerminalRenderer::parseCells(const char *name, TerminalCells &cells) {
+    if (strcmp(name, "half") == 0) {
+        cells = TERMINAL_HALF_BLOCKS;
+    } else if (strcmp(name, "braille") == 0) {
+        cells = TERMINAL_BRAILLE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+uint8_t TerminalRenderer::cellAt(const uint8_t *display, int column, int row) const {
+    if (cells == TERMINAL_HALF_BLOCKS) {
+        return displayPixel(display, column, row * 2) | displayPixel(display, column, row * 2 + 1) << 1;
+    }
+    uint8_t cell = 0;
+    for (int x = 0; x < 2; x++) {
+        for (int y = 0; y < 4; y++) {
+            if (displayPixel(display, column * 2 + x, row * 4 + y)) {
+                cell |= BRAILLE_DOTS[x][y];
+            }
+        }
+    }
+    return cell;
+}
+
+void TerminalRenderer::appendCell(uint8_t cell) {
+    if (cells == TERMINAL_HALF_BLOCKS) {
+        out += HALF_BLOCKS[cell];
+        return;
+    }
+    // U+2800 plus the dots, as UTF-8
+    out += (char) 0xE2;
+    out += (char) (0xA0 | cell >> 6);
+    out += (char) (0x80 | (cell & 0x3F));
+}
+
+void TerminalRenderer::appendMove(int column, int row) {
+    char move[32];
+    snprintf(move, sizeof(move), "\x1b[%d;%dH", row + 1, column + 1);
+    out += move;
+}
+
+const string &TerminalRenderer::render(const uint8_t *display) {
+    out.clear();
+    bool everything = !drawn;
+    if (everything) {
+        // Hide the cursor and start from a blank screen
+        out += "\x1b[?25l\x1b[2J";
+        drawn = true;
+    }
+
+    for (int row = 0; row < rows; row++) {
+        // Where the cursor is on this row, -1 if it's elsewhere
+        int cursor = -1;
+        for (int column = 0; column < columns; column++) {
+            uint8_t cell = this->cellAt(display, column, row);
+            uint8_t &was = shown[row * columns + column];
+            if (cell == was && !everything) {
+                continue;
+            }
+            if (cursor >= 0 && column - cursor <= MAX_RESENT_CELLS) {
+                for (int skipped = cursor; skipped < column; skipped++) {
+                    this->appendCell(shown[row * columns + skipped]);
+                }
+            } else if (cursor != column) {
+                this->appendMove(column, row);
+            }
+            this->appendCell(cell);
+            was = cell;
+            cursor = column + 1;
+        }
+    }
+    return out;
+}
+
+bool TerminalRenderer::draw(const uint8_t *display) {
+    const string &update = this->render(display);
+    frames++;
+    size_t written = 0;
+    while (written < update.size()) {
+        ssize_t n = write(fd, update.data() + written, update.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += n;
+    }
+    bytes += written;
+    return true;
+}
+
+void TerminalRenderer::close() {
+    if (!drawn) {
+        return;
+    }
+    out.clear();
+    this->appendMove(0, rows);
+    out += "\x1b[?25h";
+    ssize_t ignored = write(fd, out.data(), out.size());
+    (void) ignored;
+    drawn = false;
+}
@@ -0,0 +1,57 @@
+#ifndef TERMINAL_RENDERER_H
+#define TERMINAL_RENDERER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum TerminalCells {
+    // 64x16 cells, two pixels stacked in each: ▀ ▄ █
+    TERMINAL_HALF_BLOCKS,
+    // 32x8 cells, 2x4 pixels in each
+    TERMINAL_BRAILLE,
+};
+
+// Draws the packed display (Chip8::packDisplay) on an ANSI terminal with
+// Unicode cells. Each frame only sends the cells that changed since the
+// last one, with cursor moves between them, and goes out in a single
+// write(), so a live view over SSH costs a few bytes per changed cell.
+class TerminalRenderer {
+private:
+    int fd;
+    TerminalCells cells;
+    int columns;
+    int rows;
+    // What each cell showed after the last frame
+    std::vector<uint8_t> shown;
+    bool drawn;
+    // Reused from frame to frame
+    std::string out;
+
+    uint64_t frames;
+    uint64_t bytes;
+
+    uint8_t cellAt(const uint8_t *display, int column, int row) const;
+    void appendCell(uint8_t cell);
+    void appendMove(int column, int row);
+
+public:
+    TerminalRenderer(int _fd, TerminalCells _cells);
+    ~TerminalRenderer();
+
+    // "half" or "braille"
+    static bool parseCells(const char *name, TerminalCells &cells);
+
+    // What turns the terminal from the last frame into this one, empty if
+    // nothing changed. The first frame clears the screen and draws it all.
+    const std::string &render(const uint8_t *display);
+    // Renders and writes the result, false if the write failed
+    bool draw(const uint8_t *display);
+    // Shows the cursor again, below the picture
+    void close();
+
+    uint64_t frameCount() const { return frames; }
+    uint64_t byteCount() const { return bytes; }
+};
+
+#endif // TERMINAL_RENDERER_H
@@ -0,0 +1,74 @@
+#include <iostream>
+
+#include "wavWriter.h"
+
+using namespace std;
+
+
+namespace {
+
+void writeLE(ofstream &file, uint32_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) {
+        file.put((char) ((value >> (8 * i)) & 0xFF));
+    }
+}
+
+}
+
+
+WavWriter::WavWriter() {
+    samplesWritten = 0;
+    sampleRate = 0;
+}
+
+WavWriter::~WavWriter() {
+    this->close();
+}
+
+bool WavWriter::open(const char *path, int _sampleRate) {
+    sampleRate = _sampleRate;
+    samplesWritten = 0;
+    file.open(path, ios::out | ios::binary | ios::trunc);
+    if (!file) {
+        cout << "Error opening WAV file: " << path << endl;
+        return false;
+    }
+    this->writeHeader();
+    return true;
+}
+
+void WavWriter::writeHeader() {
+    uint32_t dataBytes = samplesWritten * 2;
+
+    file.write("RIFF", 4);
+    writeLE(file, 36 + dataBytes, 4);
+    file.write("WAVE", 4);
+
+    file.write("fmt ", 4);
+    writeLE(file, 16, 4);             // fmt chunk size
+    writeLE(file, 1, 2);              // PCM
+    writeLE(file, 1, 2);              // mono
+    writeLE(file, sampleRate, 4);
+    writeLE(file, sampleRate * 2, 4); // byte rate
+    writeLE(file, 2, 2);              // block align
+    writeLE(file, 16, 2);             // bits per sample
+
+    file.write("data", 4);
+    writeLE(file, dataBytes, 4);
+}
+
+void WavWriter::write(const int16_t *samples, int count) {
+    for (int i = 0; i < count; i++) {
+        writeLE(file, (uint16_t) samples[i], 2);
+    }
+    samplesWritten += count;
+}
+
+void WavWriter::close() {
+    if (!file.is_open()) {
+        return;
+    }
+    file.seekp(0);
+    this->writeHeader();
+    file.close();
+}
@@ -0,0 +1,28 @@
+#ifndef WAV_WRITER_H
+#define WAV_WRITER_H
+
+#include <stdint.h>
+#include <fstream>
+
+using namespace std;
+
+// Streams mono 16-bit PCM samples to a .wav file. The header sizes are
+// patched in by close().
+class WavWriter {
+private:
+    ofstream file;
+    uint32_t samplesWritten;
+    int sampleRate;
+
+    void writeHeader();
+
+public:
+    WavWriter();
+    ~WavWriter();
+
+    bool open(const char *path, int _sampleRate);
+    void write(const int16_t *samples, int count);
+    void close();
+};
+
+#endif // WAV_WRITER_H
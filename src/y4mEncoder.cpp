@@ -0,0 +1,81 @@
+#include <iostream>
+#include <algorithm>
+
+#include "constants.h"
+#include "y4mEncoder.h"
+
+using namespace std;
+
+
+namespace {
+
+// BT.601 full range colour for a pixel of the given RGBA8888 value
+void toYuv(uint32_t rgba, uint8_t &y, uint8_t &u, uint8_t &v) {
+    int r = (rgba >> 24) & 0xFF;
+    int g = (rgba >> 16) & 0xFF;
+    int b = (rgba >> 8) & 0xFF;
+    y = (uint8_t) ((299 * r + 587 * g + 114 * b) / 1000);
+    u = (uint8_t) max(0, min(255, 128 + (-169 * r - 331 * g + 500 * b) / 1000));
+    v = (uint8_t) max(0, min(255, 128 + (500 * r - 419 * g - 81 * b) / 1000));
+}
+
+}
+
+
+Y4mEncoder::Y4mEncoder() {
+    scale = 1;
+    width = DISPLAY_WIDTH;
+    height = DISPLAY_HEIGHT;
+}
+
+bool Y4mEncoder::open(const char *path, int _scale) {
+    // 64 and 32 times anything are even, as 4:2:0 chroma needs
+    scale = _scale;
+    width = DISPLAY_WIDTH * scale;
+    height = DISPLAY_HEIGHT * scale;
+    frame.resize(width * height * 3 / 2);
+
+    file.open(path, ios::out | ios::binary | ios::trunc);
+    if (!file) {
+        cout << "Error opening capture file: " << path << endl;
+        return false;
+    }
+    file << "YUV4MPEG2 W" << width << " H" << height << " F" << FRAMES_PER_SECOND << ":1 Ip A1:1 C420jpeg\n";
+    return true;
+}
+
+void Y4mEncoder::writeFrame(const uint8_t *display, int durationFrames) {
+    uint8_t onY, onU, onV;
+    uint8_t offY, offU, offV;
+    toYuv(PIXEL_COLOR | PIXEL_ALPHA, onY, onU, onV);
+    toYuv(PIXEL_ALPHA, offY, offU, offV);
+
+    uint8_t *luma = frame.data();
+    uint8_t *u = luma + width * height;
+    uint8_t *v = u + (width / 2) * (height / 2);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            luma[y * width + x] = displayPixel(display, x / scale, y / scale) ? onY : offY;
+        }
+    }
+    // Each 2x2 chroma block takes its top left pixel. With an odd scale a
+    // block can straddle two pixels, the edge is off by half a luma sample.
+    for (int y = 0; y < height / 2; y++) {
+        for (int x = 0; x < width / 2; x++) {
+            bool on = displayPixel(display, x * 2 / scale, y * 2 / scale);
+            u[y * (width / 2) + x] = on ? onU : offU;
+            v[y * (width / 2) + x] = on ? onV : offV;
+        }
+    }
+
+    for (int i = 0; i < durationFrames; i++) {
+        file.write("FRAME\n", 6);
+        file.write((const char *) frame.data(), frame.size());
+    }
+}
+
+void Y4mEncoder::close() {
+    if (file.is_open()) {
+        file.close();
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef Y4M_ENCODER_H
+#define Y4M_ENCODER_H
+
+#include <stdint.h>
+#include <fstream>
+#include <vector>
+
+#include "frameEncoder.h"
+
+using namespace std;
+
+// Raw YUV4MPEG2 video at a constant 60fps, for piping into other tools.
+// Frames that stay on screen for several emulated frames are repeated.
+class Y4mEncoder : public FrameEncoder {
+private:
+    ofstream file;
+    int scale;
+    int width;
+    int height;
+    vector<uint8_t> frame;
+
+public:
+    Y4mEncoder();
+
+    bool open(const char *path, int _scale) override;
+    void writeFrame(const uint8_t *display, int durationFrames) override;
+    void close() override;
+};
+
+#endif // Y4M_ENCODER_H
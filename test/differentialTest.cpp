@@ -0,0 +1,443 @@
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/constants.h"
+#include "../src/chip8.h"
+#include "../src/executionBackend.h"
+
+using namespace std;
+
+// Runs random instruction streams from random machine states through the
+// reference interpreter and every alternative execution backend, comparing
+// the whole machine after each chunk of instructions. The first divergence is
+// shrunk to a small reproducer.
+//
+// Chunks are 1 to 8 instructions rather than always 1 because backends only
+// fuse pairs and triples, or run a block, inside a single call; comparing
+// after every instruction would never exercise those paths. The reference
+// still runs one instruction at a time.
+//
+//   ./difftest_prog [cases] [threads] [seed]
+
+
+// Everything needed to rebuild a test case from scratch
+struct DiffCase {
+    uint8_t V[16];
+    uint16_t I;
+    uint8_t sp;
+    uint16_t stack[16];
+    uint8_t delayTimer;
+    uint8_t soundTimer;
+    uint8_t keypad[16];
+    bool legacyShift;
+    uint32_t rngSeed;
+    // Memory and display contents come from these, 0 means all zeroes
+    uint32_t memorySeed;
+    uint32_t displaySeed;
+    // Loaded at 0x200 and executed from there
+    vector<uint16_t> program;
+    // Instructions executed between state comparisons
+    vector<int> chunks;
+};
+
+struct Divergence {
+    string backend;
+    // Executed by the reference, up to and including the chunk that diverged
+    int instructions = 0;
+    string difference;
+};
+
+
+// What every machine of a case starts from, built once per case. The
+// machines share the memory image until they write to it.
+struct CaseContents {
+    shared_ptr<const Chip8MemoryImage> memory;
+    uint8_t display[DISPLAY_BYTES];
+};
+
+// All four bytes of each draw, the fill is most of the cost of a case
+void fillRandom(uint32_t seed, uint8_t *out, int length) {
+    mt19937 fill(seed);
+    for (int i = 0; i < length; i += 4) {
+        uint32_t word = fill();
+        for (int b = 0; b < 4 && i + b < length; b++) {
+            out[i + b] = word >> (8 * b);
+        }
+    }
+}
+
+CaseContents caseContents(const DiffCase &c) {
+    CaseContents contents;
+    shared_ptr<Chip8MemoryImage> image = make_shared<Chip8MemoryImage>();
+    memset(image->bytes, 0, sizeof(image->bytes));
+    if (c.memorySeed != 0) {
+        fillRandom(c.memorySeed, image->bytes + INTERPRETER_SIZE, MEMORY_SIZE - INTERPRETER_SIZE);
+    }
+    for (size_t i = 0; i < c.program.size(); i++) {
+        image->bytes[0x200 + 2 * i] = c.program[i] >> 8;
+        image->bytes[0x200 + 2 * i + 1] = c.program[i] & 0xFF;
+    }
+    // Every case is different, interning them would only take a lock
+    contents.memory = image;
+
+    memset(contents.display, 0, sizeof(contents.display));
+    if (c.displaySeed != 0) {
+        fillRandom(c.displaySeed, contents.display, DISPLAY_BYTES);
+    }
+    return contents;
+}
+
+
+class DiffChip8: public Chip8 {
+public:
+    void loadCase(const DiffCase &c, const CaseContents &contents) {
+        memory.share(contents.memory);
+
+        init();
+        memcpy(V, c.V, sizeof(V));
+        I = c.I;
+        sp = c.sp;
+        memcpy(stack, c.stack, sizeof(stack));
+        delayTimer = c.delayTimer;
+        soundTimer = c.soundTimer;
+        memcpy(keypad, c.keypad, sizeof(keypad));
+        legacyShift = c.legacyShift;
+        seed(c.rngSeed);
+        memcpy(displayBuffer, contents.display, sizeof(displayBuffer));
+        pc = 0x200;
+    }
+
+    // Memory, the stack, the keypad and the display all wrap, and anything
+    // else stops the machine with a status, so every instruction is defined.
+    // A case ends once the machine has stopped.
+    bool nextIsDefined() {
+        return status == CHIP8_OK;
+    }
+};
+
+
+// Random instructions from every defined family, with jump and call targets
+// mostly inside the program so control flow keeps executing generated code.
+uint16_t randomInstruction(mt19937 &rng, int programLength) {
+    int x = rng() % 16;
+    int y = rng() % 16;
+    int kk = rng() % 256;
+    uint16_t target = rng() % 8 != 0
+        ? 0x200 + 2 * (rng() % programLength)
+        : rng() % MEMORY_SIZE;
+
+    static const uint8_t aluOps[] = { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE };
+    static const uint8_t fOps[] = { 0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65 };
+
+    switch (rng() % 20) {
+        case 0: return 0x00E0;
+        case 1: return 0x00EE;
+        case 2: return 0x1000 | target;
+        case 3: return 0x2000 | target;
+        case 4: return 0x3000 | x << 8 | kk;
+        case 5: return 0x4000 | x << 8 | kk;
+        case 6: return 0x5000 | x << 8 | y << 4;
+        case 7: case 8: return 0x6000 | x << 8 | kk;
+        case 9: return 0x7000 | x << 8 | kk;
+        case 10: case 11: return 0x8000 | x << 8 | y << 4 | aluOps[rng() % sizeof(aluOps)];
+        case 12: return 0x9000 | x << 8 | y << 4;
+        case 13: return 0xA000 | (rng() % MEMORY_SIZE);
+        case 14: return 0xB000 | (target & 0xF00);
+        case 15: return 0xC000 | x << 8 | kk;
+        case 16: return 0xD000 | x << 8 | y << 4 | (rng() % 16);
+        case 17: return 0xE000 | x << 8 | (rng() % 2 ? 0x9E : 0xA1);
+        default: return 0xF000 | x << 8 | fOps[rng() % sizeof(fOps)];
+    }
+}
+
+// The pairs and triples the interpreter fuses into one dispatch, so the
+// fused paths and jumps or skips into the middle of them get exercised
+void appendIdiom(mt19937 &rng, int programLength, vector<uint16_t> &program) {
+    int x = rng() % 16;
+    int y = rng() % 16;
+    int kk = rng() % 256;
+    uint16_t draw = 0xD000 | x << 8 | y << 4 | (rng() % 16);
+    switch (rng() % 4) {
+        case 0:
+            program.push_back(0xA000 | (rng() % MEMORY_SIZE));
+            program.push_back(draw);
+            break;
+        case 1:
+            program.push_back(0xF029 | x << 8);
+            program.push_back(draw);
+            break;
+        case 2:
+            program.push_back(0x6000 | x << 8 | kk);
+            program.push_back(0x6000 | y << 8 | (rng() % 256));
+            break;
+        default:
+            program.push_back(0x7000 | x << 8 | (rng() % 2 ? 1 : kk));
+            program.push_back((rng() % 2 ? 0x3000 : 0x4000) | (rng() % 2 ? x : y) << 8 | (rng() % 16));
+            program.push_back(0x1000 | (0x200 + 2 * (rng() % programLength)));
+            break;
+    }
+}
+
+DiffCase randomCase(mt19937 &rng) {
+    DiffCase c;
+    for (int i = 0; i < 16; i++) {
+        // Small values keep key and sprite instructions in range more often
+        c.V[i] = rng() % 2 ? rng() % 16 : rng() % 256;
+        c.stack[i] = 0x200 + 2 * (rng() % 32);
+        c.keypad[i] = rng() % 2;
+    }
+    c.I = rng() % 2 ? rng() % 80 : rng() % MEMORY_SIZE;
+    c.sp = rng() % 17;
+    c.delayTimer = rng() % 4 ? 0 : rng() % 256;
+    c.soundTimer = rng() % 4 ? 0 : rng() % 256;
+    c.legacyShift = rng() % 2;
+    c.rngSeed = rng() | 1;
+    c.memorySeed = rng() | 1;
+    c.displaySeed = rng() % 2 ? rng() | 1 : 0;
+
+    int length = 1 + rng() % 64;
+    while ((int) c.program.size() < length) {
+        if (rng() % 4 == 0) {
+            appendIdiom(rng, length, c.program);
+        } else {
+            c.program.push_back(randomInstruction(rng, length));
+        }
+    }
+    int total = 0;
+    while (total < 4 * length) {
+        int chunk = 1 + rng() % INSTRUCTIONS_PER_FRAME;
+        c.chunks.push_back(chunk);
+        total += chunk;
+    }
+    return c;
+}
+
+// Runs the chunks of a case on machines that have already loaded it
+bool runChunks(const DiffCase &c, DiffChip8 &reference, vector<DiffChip8> &machines, Divergence &divergence) {
+    const vector<ExecutionBackend*> &backends = alternativeBackends();
+    int &executed = divergence.instructions;
+    executed = 0;
+    for (int chunk : c.chunks) {
+        // The reference goes first, one instruction at a time, so the chunk can
+        // be cut short where behaviour stops being defined.
+        int count = 0;
+        while (count < chunk && reference.nextIsDefined()) {
+            referenceBackend()->run(reference, 1);
+            count++;
+        }
+        if (count == 0) {
+            return false;
+        }
+        executed += count;
+
+        for (size_t b = 0; b < backends.size(); b++) {
+            backends[b]->run(machines[b], count);
+            if (!reference.sameState(machines[b])) {
+                divergence.backend = backends[b]->name();
+                divergence.difference = reference.stateDifference(machines[b]);
+                return true;
+            }
+        }
+        if (count < chunk) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// Returns true and fills in the divergence if any backend disagrees with the
+// reference on this case. Either way divergence.instructions says how many
+// instructions ran.
+bool diverges(const DiffCase &c, Divergence &divergence) {
+    CaseContents contents = caseContents(c);
+    DiffChip8 reference;
+    reference.loadCase(c, contents);
+    const vector<ExecutionBackend*> &backends = alternativeBackends();
+    vector<DiffChip8> machines(backends.size());
+    for (size_t b = 0; b < backends.size(); b++) {
+        machines[b].loadCase(c, contents);
+        backends[b]->attach(machines[b]);
+    }
+    bool diverged = runChunks(c, reference, machines, divergence);
+    for (size_t b = 0; b < backends.size(); b++) {
+        backends[b]->detach(machines[b]);
+    }
+    return diverged;
+}
+
+template<typename T> bool simplifyTo(T &field, T value) {
+    if (field == value) {
+        return false;
+    }
+    field = value;
+    return true;
+}
+
+// Greedily simplifies a failing case, keeping each change that still fails,
+// until nothing more can be removed.
+DiffCase shrink(DiffCase c, Divergence &divergence) {
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        auto attempt = [&](const DiffCase &candidate) {
+            Divergence d;
+            if (diverges(candidate, d)) {
+                c = candidate;
+                divergence = d;
+                progress = true;
+                return true;
+            }
+            return false;
+        };
+
+        for (size_t i = c.chunks.size(); i-- > 0;) {
+            DiffCase candidate = c;
+            candidate.chunks.erase(candidate.chunks.begin() + i);
+            if (candidate.chunks.empty() || !attempt(candidate)) {
+                if (i + 1 < c.chunks.size()) {
+                    candidate = c;
+                    candidate.chunks[i] += candidate.chunks[i + 1];
+                    candidate.chunks.erase(candidate.chunks.begin() + i + 1);
+                    attempt(candidate);
+                }
+            }
+        }
+        for (size_t i = c.program.size(); i-- > 0;) {
+            if (c.program.size() > 1) {
+                DiffCase candidate = c;
+                candidate.program.erase(candidate.program.begin() + i);
+                if (attempt(candidate)) {
+                    continue;
+                }
+            }
+            if (c.program[i] != 0x6000) {
+                // Nearly a no-op that keeps addresses where they are
+                DiffCase candidate = c;
+                candidate.program[i] = 0x6000;
+                attempt(candidate);
+            }
+        }
+
+        vector<function<bool(DiffCase&)>> simplifications = {
+            [](DiffCase &d) { return simplifyTo(d.memorySeed, 0u); },
+            [](DiffCase &d) { return simplifyTo(d.displaySeed, 0u); },
+            [](DiffCase &d) { return simplifyTo(d.I, (uint16_t) 0); },
+            [](DiffCase &d) { return simplifyTo(d.sp, (uint8_t) 0); },
+            [](DiffCase &d) { return simplifyTo(d.delayTimer, (uint8_t) 0); },
+            [](DiffCase &d) { return simplifyTo(d.soundTimer, (uint8_t) 0); },
+            [](DiffCase &d) { return simplifyTo(d.legacyShift, false); },
+            [](DiffCase &d) { return simplifyTo(d.rngSeed, 1u); },
+        };
+        for (int i = 0; i < 16; i++) {
+            simplifications.push_back([i](DiffCase &d) { return simplifyTo(d.V[i], (uint8_t) 0); });
+            simplifications.push_back([i](DiffCase &d) { return simplifyTo(d.stack[i], (uint16_t) 0); });
+            simplifications.push_back([i](DiffCase &d) { return simplifyTo(d.keypad[i], (uint8_t) 0); });
+        }
+        for (auto &simplify : simplifications) {
+            DiffCase candidate = c;
+            if (simplify(candidate)) {
+                attempt(candidate);
+            }
+        }
+    }
+    return c;
+}
+
+void printCase(const DiffCase &c) {
+    printf("  program at 0x200:");
+    for (uint16_t op : c.program) {
+        printf(" %04X", op);
+    }
+    printf("\n  chunks:");
+    for (int chunk : c.chunks) {
+        printf(" %d", chunk);
+    }
+    printf("\n  I=%03X sp=%d DT=%d ST=%d legacyShift=%d rngSeed=%u memorySeed=%u displaySeed=%u\n",
+        c.I, c.sp, c.delayTimer, c.soundTimer, c.legacyShift, c.rngSeed, c.memorySeed, c.displaySeed);
+    for (int i = 0; i < 16; i++) {
+        if (c.V[i] != 0) {
+            printf("  V[%X]=%02X\n", i, c.V[i]);
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        if (c.stack[i] != 0) {
+            printf("  stack[%d]=%03X\n", i, c.stack[i]);
+        }
+    }
+    for (int i = 0; i < 16; i++) {
+        if (c.keypad[i] != 0) {
+            printf("  keypad[%X]=%d\n", i, c.keypad[i]);
+        }
+    }
+}
+
+
+int main(int argc, char *argv[]) {
+    long cases = argc >= 2 ? atol(argv[1]) : 100000;
+    int threads = argc >= 3 ? atoi(argv[2]) : thread::hardware_concurrency();
+    uint32_t baseSeed = argc >= 4 ? strtoul(argv[3], nullptr, 10) : random_device()();
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    printf("Comparing %zu backend(s) against the reference, %ld cases on %d threads, seed %u\n",
+        alternativeBackends().size(), cases, threads, baseSeed);
+
+    atomic<long> nextCase(0);
+    atomic<long> instructions(0);
+    atomic<bool> failed(false);
+    mutex failureMutex;
+    DiffCase failure;
+
+    auto started = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread([&, t]() {
+            long index;
+            while (!failed && (index = nextCase++) < cases) {
+                // Each case has its own seed so any case can be replayed alone
+                mt19937 rng(baseSeed + (uint32_t) index * 2654435761u);
+                DiffCase c = randomCase(rng);
+                Divergence divergence;
+                if (diverges(c, divergence)) {
+                    lock_guard<mutex> lock(failureMutex);
+                    if (!failed) {
+                        failure = c;
+                        failed = true;
+                    }
+                }
+                instructions += divergence.instructions;
+            }
+        }));
+    }
+    for (thread &worker : workers) {
+        worker.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    if (failed) {
+        Divergence divergence;
+        DiffCase minimal = shrink(failure, divergence);
+        printf("FAIL: backend %s diverged from the reference after %d instruction(s)\n",
+            divergence.backend.c_str(), divergence.instructions);
+        printf("%s", divergence.difference.c_str());
+        printf("Minimal case:\n");
+        printCase(minimal);
+        return 1;
+    }
+
+    long ran = min(cases, (long) nextCase);
+    printf("PASS: %ld cases, %ld instructions in %.2fs (%.0f cases/s)\n",
+        ran, (long) instructions, seconds, ran / seconds);
+    return 0;
+}
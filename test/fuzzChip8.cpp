@@ -0,0 +1,118 @@
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <vector>
+
+#include "../src/constants.h"
+#include "../src/chip8.h"
+
+using namespace std;
+
+// libFuzzer entry point: each input is loaded as a ROM and run for a bounded
+// number of instructions. CHIP-8 pc and pc-to-pc edge hits are published as
+// extra coverage counters, so inputs that reach new emulated code are kept
+// even when they exercise no new host code.
+//
+//   make fuzz && ./fuzz_prog -max_len=3584 corpus/
+//
+// Built with -DCHIP8_FUZZ_STANDALONE the file has its own main() instead,
+// which replays the given files, or runs random inputs for a few seconds when
+// given none, and prints throughput and coverage.
+
+const int FUZZ_INSTRUCTION_BUDGET = 1024;
+const int FUZZ_EDGE_COUNTERS = 1 << 16;
+
+#ifdef CHIP8_FUZZ_STANDALONE
+#define FUZZ_COUNTERS
+#else
+#define FUZZ_COUNTERS __attribute__((section("__libfuzzer_extra_counters")))
+#endif
+
+FUZZ_COUNTERS static uint8_t pcCounters[MEMORY_SIZE];
+FUZZ_COUNTERS static uint8_t edgeCounters[FUZZ_EDGE_COUNTERS];
+
+
+class FuzzChip8: public Chip8 {
+public:
+    void run(int budget) {
+        uint16_t previous = pc;
+        for (int i = 0; i < budget; i++) {
+            if (isBlocked()) {
+                // Nothing will ever press a key, and a fault or a halt is the
+                // end of the program rather than a bug
+                return;
+            }
+            step();
+            pcCounters[pc & (MEMORY_SIZE - 1)]++;
+            edgeCounters[((previous << 4) ^ pc) & (FUZZ_EDGE_COUNTERS - 1)]++;
+            previous = pc;
+        }
+    }
+};
+
+// Reused across inputs, loadMemoryUncached() resets everything a ROM can
+// touch without filling the process-wide ROM cache with junk
+static FuzzChip8 chip8;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size > (size_t) (MEMORY_SIZE - INTERPRETER_SIZE)) {
+        size = MEMORY_SIZE - INTERPRETER_SIZE;
+    }
+    chip8.loadMemoryUncached(data, size);
+    chip8.seed(0);
+    chip8.run(FUZZ_INSTRUCTION_BUDGET);
+    return 0;
+}
+
+
+#ifdef CHIP8_FUZZ_STANDALONE
+
+int countCovered(const uint8_t *counters, int size) {
+    int covered = 0;
+    for (int i = 0; i < size; i++) {
+        covered += counters[i] != 0;
+    }
+    return covered;
+}
+
+int main(int argc, char *argv[]) {
+    long runs = 0;
+    auto started = chrono::steady_clock::now();
+
+    if (argc > 1) {
+        for (int i = 1; i < argc; i++) {
+            ifstream file(argv[i], ios::in | ios::binary);
+            vector<uint8_t> input((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+            LLVMFuzzerTestOneInput(input.data(), input.size());
+            runs++;
+        }
+    } else {
+        // Random inputs, mostly short like a fresh fuzzing corpus
+        mt19937 rng(1);
+        vector<uint8_t> input;
+        double seconds = 0;
+        while (seconds < 3) {
+            for (int batch = 0; batch < 1000; batch++) {
+                input.resize(2 + rng() % 256);
+                for (uint8_t &byte : input) {
+                    byte = rng();
+                }
+                LLVMFuzzerTestOneInput(input.data(), input.size());
+                runs++;
+            }
+            seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        }
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    cout << dec << runs << " runs, " << (long) (runs / seconds) << " execs/s, "
+        << countCovered(pcCounters, MEMORY_SIZE) << " pcs, "
+        << countCovered(edgeCounters, FUZZ_EDGE_COUNTERS) << " edges covered" << endl;
+    return 0;
+}
+
+#endif
@@ -1,7 +1,14 @@
 #include <iostream>
+#include <cstring>
+#include <vector>
 
 #include "../src/constants.h"
 #include "../src/chip8.h"
+#include "../src/pixelExpander.h"
+#include "../src/romCache.h"
+#include "../src/runtimeMetrics.h"
+#include "../src/stateExporter.h"
+#include "../src/terminalRenderer.h"
 
 using namespace std;
 
@@ -17,14 +24,14 @@ private:
     void test00E0() {
         printf("\n..Testing 00E0\n");
         init();
-        for (int i = 0; i < (DISPLAY_WIDTH * DISPLAY_HEIGHT); i++) {
-            displayBuffer[i] = 3;
+        for (int i = 0; i < DISPLAY_BYTES; i++) {
+            displayBuffer[i] = 0xFF;
         }
 
         opcode = 0x00E0;
         handleOpcode();
 
-        for (int i = 0; i < (DISPLAY_WIDTH * DISPLAY_HEIGHT); i++) {
+        for (int i = 0; i < DISPLAY_BYTES; i++) {
             if (displayBuffer[i] != 0) {
                 printf("displayBuffer not cleared at index %u\n", i);
                 throw;
@@ -418,6 +425,357 @@ private:
         assertTrue(pc == 0x0819, "bad pc: " + to_string(pc));
     }
 
+    void testResetToCheckpoint() {
+        printf("\n..Testing resetToCheckpoint\n");
+        const uint8_t rom[] = {
+            0x60, 0x7B, // V0 = 123
+            0xA3, 0x00, // I = 0x300
+            0xF0, 0x33, // BCD of V0 at 0x300
+            0xD0, 0x15, // draw 5 rows at (V0, V1)
+        };
+        loadMemory(rom, sizeof(rom));
+        seed(1);
+        V[1] = 20;
+        checkpoint();
+        uint64_t expected = stateHash();
+
+        runInstructions(4);
+        assertTrue(memory.read(0x300) == 1 && V[0] == 123, "program did not run");
+        assertTrue(stateHash() != expected, "program changed nothing");
+
+        resetToCheckpoint();
+        assertTrue(stateHash() == expected, "state differs after reset");
+        assertTrue(dirtyPages == 0 && dirtyRows == 0, "dirty masks not cleared");
+    }
+
+    void testSharedMemory() {
+        printf("\n..Testing shared memory pages\n");
+        const uint8_t rom[] = {0xA3, 0x00, 0x60, 0x2A, 0xF0, 0x55};
+        loadMemory(rom, sizeof(rom));
+        Chip8 other;
+        other.loadMemory(rom, sizeof(rom));
+        assertTrue(privateMemoryBytes() == 0 && other.privateMemoryBytes() == 0, "loaded pages not shared");
+
+        checkpoint();
+        runInstructions(3);
+        assertTrue(memory.read(0x300) == 0x2A, "store not visible");
+        assertTrue(other.readMemory(0x300) == 0, "store leaked into the other machine");
+        assertTrue(privateMemoryBytes() == MEMORY_PAGE_SIZE, "store did not copy exactly one page");
+
+        Chip8 copy(*this);
+        assertTrue(copy.readMemory(0x300) == 0x2A, "copy lost the private page");
+        resetToCheckpoint();
+        assertTrue(memory.read(0x300) == 0 && privateMemoryBytes() == 0, "reset did not go back to the shared page");
+        assertTrue(copy.readMemory(0x300) == 0x2A, "reset changed the copy");
+    }
+
+    void testFaults() {
+        printf("\n..Testing faults\n");
+        // 0x200: CALL 0x200 forever, overflows on the seventeenth
+        const uint8_t recursion[] = {0x22, 0x00};
+        loadMemory(recursion, sizeof(recursion));
+        assertTrue(runInstructions(100) == 17, "ran past the overflow");
+        assertTrue(status == CHIP8_STACK_OVERFLOW && sp == 16 && pc == 0x200, "no overflow: " + statusToString());
+        assertTrue(runInstructions(1) == 0, "faulted machine kept running");
+
+        const uint8_t underflow[] = {0x00, 0xEE};
+        loadMemory(underflow, sizeof(underflow));
+        runInstructions(1);
+        assertTrue(status == CHIP8_STACK_UNDERFLOW && pc == 0x200, "no underflow: " + statusToString());
+
+        const uint8_t invalid[] = {0x60, 0x01, 0xE0, 0xFF};
+        loadMemory(invalid, sizeof(invalid));
+        runInstructions(2);
+        assertTrue(isFaulted() && statusToString() == "invalid opcode 0xE0FF at 0x202", statusToString());
+
+        const uint8_t halt[] = {0x12, 0x00};
+        loadMemory(halt, sizeof(halt));
+        runFrame();
+        assertTrue(status == CHIP8_HALTED && !isFaulted(), "jump to self did not halt");
+
+        init();
+        assertTrue(status == CHIP8_OK, "init kept the status");
+        pc = MEMORY_SIZE - 1;
+        step();
+        assertTrue(status == CHIP8_OUT_OF_BOUNDS, "fetched past the end of memory");
+
+        // Out of range key and store wrap rather than fault
+        init();
+        V[0] = 0x13;
+        handleKeyDown(3);
+        opcode = 0xE09E;
+        pc = 0x200;
+        handleOpcode();
+        assertTrue(pc == 0x204 && status == CHIP8_OK, "key index not masked");
+        I = 0xFFFF;
+        opcode = 0xF055;
+        handleOpcode();
+        assertTrue(memory.read(0xFFF) == 0x13, "store did not wrap");
+    }
+
+    void testFusion() {
+        printf("\n..Testing fused dispatch\n");
+        const uint8_t rom[] = {
+            0x30, 0x00, // 0x200: skips into the middle of the pair below
+            0x63, 0x11, 0x64, 0x22,
+            0x70, 0x01, 0x30, 0x05, 0x12, 0x06, // loop counter
+            0xA2, 0x1C, 0xD1, 0x21, // sprite
+            0xF0, 0x29, 0xD3, 0x45, // digit
+            0xA2, 0x04, 0x60, 0x61, 0xF0, 0x55, // stores 0x61 over the 0x64 at 0x204
+            0x12, 0x00,
+            0xFF,
+        };
+        loadMemory(rom, sizeof(rom));
+        Chip8 unfused;
+        unfused.loadMemory(rom, sizeof(rom));
+        unfused.setFusion(false);
+        seed(1);
+        unfused.seed(1);
+        for (int chunk = 0; chunk < 400; chunk++) {
+            int count = 1 + chunk % INSTRUCTIONS_PER_FRAME;
+            assertTrue(runInstructions(count) == unfused.runInstructions(count), "fused run count differs");
+            string difference = stateDifference(unfused);
+            assertTrue(difference.empty(), "fused dispatch diverged after " + to_string(chunk) + " chunks: " + difference);
+        }
+        assertTrue(memory.read(0x204) == 0x61 && V[1] == 0x22, "store into fused code not seen");
+    }
+
+    void testExplorationHash() {
+        printf("\n..Testing incremental exploration hash\n");
+        const uint8_t rom[] = {
+            0xA2, 0x20, 0xD0, 0x15, // sprite from 0x220
+            0x70, 0x03, 0xF0, 0x33, 0xF2, 0x55, // written over by Fx33 and Fx55
+            0x30, 0x1E, 0x12, 0x00,
+            0x00, 0xE0, 0xA2, 0x20, 0xD1, 0x15,
+            0x60, 0x00, 0x12, 0x00,
+        };
+        loadMemory(rom, sizeof(rom));
+        seed(1);
+        // Kept up from here on
+        uint64_t previous = explorationHash();
+        for (int chunk = 0; chunk < 100; chunk++) {
+            runInstructions(1 + chunk % 5);
+            Chip8 fresh = *this;
+            fresh.invalidateContentHash();
+            assertTrue(explorationHash() == fresh.explorationHash(), "hash drifted after " + to_string(chunk) + " chunks");
+            assertTrue(displayContentHash() == fresh.displayContentHash(), "display hash drifted after " + to_string(chunk) + " chunks");
+            assertTrue(explorationHash() != previous, "hash missed a change");
+            previous = explorationHash();
+        }
+    }
+
+    void testQuota() {
+        printf("\n..Testing quotas\n");
+        Chip8Quota quota;
+        const uint8_t counting[] = {0x70, 0x01, 0x12, 0x00};
+        loadMemory(counting, sizeof(counting));
+        quota.maxInstructions = 25;
+        setQuota(quota);
+        for (int frame = 0; frame < 10; frame++) {
+            runFrame();
+        }
+        assertTrue(status == CHIP8_INSTRUCTION_LIMIT && getInstructionCount() == 25 && V[0] == 13,
+            "instruction limit: " + statusToString());
+
+        quota = Chip8Quota();
+        quota.maxFrames = 3;
+        setQuota(quota);
+        loadMemory(counting, sizeof(counting));
+        for (int frame = 0; frame < 10; frame++) {
+            runFrame();
+        }
+        assertTrue(status == CHIP8_FRAME_LIMIT && V[0] == 12, "frame limit: " + statusToString());
+
+        // Three instructions round the loop against eight a frame, so no
+        // two frames in a row end in the same state
+        quota = Chip8Quota();
+        quota.stuckFrames = 4;
+        setQuota(quota);
+        const uint8_t looping[] = {0x60, 0x00, 0x60, 0x00, 0x12, 0x00};
+        loadMemory(looping, sizeof(looping));
+        int frames = 0;
+        while (!isFinished() && frames < 100) {
+            runFrame();
+            frames++;
+        }
+        assertTrue(status == CHIP8_STUCK && frames < 10, "loop not caught: " + statusToString());
+
+        // Nothing but the delay timer changes until it runs out
+        const uint8_t waiting[] = {0x60, 0x05, 0xF0, 0x15, 0xF1, 0x0A, 0x72, 0x01, 0x12, 0x06};
+        loadMemory(waiting, sizeof(waiting));
+        frames = 0;
+        while (!isFinished() && frames < 100) {
+            runFrame();
+            frames++;
+        }
+        assertTrue(status == CHIP8_STUCK_WAITING_FOR_KEY && frames > 5 && frames < 15,
+            "key wait not caught: " + statusToString());
+
+        const uint8_t halting[] = {0x12, 0x00};
+        loadMemory(halting, sizeof(halting));
+        runFrame();
+        assertTrue(status == CHIP8_HALTED && isFinished(), "halt under a quota not finished");
+
+        // Still counting frames, the timer keeps changing the state
+        setKeys(0);
+        loadMemory(waiting, sizeof(waiting));
+        runFrame();
+        handleKeyDown(3);
+        runFrame();
+        assertTrue(status == CHIP8_OK && V[1] == 3, "key press after a wait: " + statusToString());
+        setQuota(Chip8Quota());
+        assertTrue(!isFinished(), "quota not cleared");
+    }
+
+    void testStateExport() {
+        printf("\n..Testing shared memory state export\n");
+        const char *name = "/chip8-test-export";
+        StateExporter exporter;
+        assertTrue(exporter.open(name), "could not create the object");
+        chip8_export_reader reader;
+        assertTrue(chip8_export_attach(&reader, name) == 0, "could not attach");
+        uint32_t ticket = 0;
+        assertTrue(chip8_export_poll(&reader, &ticket) == nullptr, "frame before any was published");
+
+        const uint8_t rom[] = {0x60, 0x2A, 0xA2, 0x0A, 0xD0, 0x01, 0x12, 0x06, 0x00, 0x00, 0x80};
+        loadMemory(rom, sizeof(rom));
+        for (int frame = 1; frame <= 6; frame++) {
+            runFrame();
+            exporter.publish(this, frame);
+        }
+        // Only the newest is handed out, and from the mapping itself
+        const Chip8ExportFrame *frame = chip8_export_poll(&reader, &ticket);
+        assertTrue(frame != nullptr && frame->frame == 6 && frame->V[0] == 0x2A && frame->I == 0x20A
+            && frame->pc == 0x206 && frame->status == CHIP8_HALTED, "bad frame");
+        assertTrue(memcmp(frame->display, displayBuffer, DISPLAY_BYTES) == 0, "bad display");
+        assertTrue(chip8_export_still_valid(&reader, frame, ticket), "untouched frame invalid");
+        assertTrue(chip8_export_poll(&reader, &ticket) == nullptr, "same frame handed out twice");
+
+        // Overwritten while being read
+        exporter.publish(this, 7);
+        frame = chip8_export_poll(&reader, &ticket);
+        for (int i = 0; i < CHIP8_EXPORT_SLOTS; i++) {
+            exporter.publish(this, 8 + i);
+        }
+        assertTrue(!chip8_export_still_valid(&reader, frame, ticket), "torn read not caught");
+        Chip8ExportFrame copy;
+        assertTrue(chip8_export_copy(&reader, &copy) && copy.frame == 7 + CHIP8_EXPORT_SLOTS, "copy not the newest");
+
+        exporter.close();
+        assertTrue(chip8_export_closed(&reader), "close not seen");
+        chip8_export_detach(&reader);
+        assertTrue(chip8_export_attach(&reader, name) != 0, "name left behind");
+    }
+
+    void testRomCache() {
+        printf("\n..Testing ROM cache\n");
+        RomCache &cache = RomCache::instance();
+        cache.clear();
+        const uint8_t rom[] = {0x60, 0x2A, 0x12, 0x02};
+        loadMemory(rom, sizeof(rom));
+        Chip8 other;
+        other.loadMemory(rom, sizeof(rom));
+        assertTrue(getLoadedRom() == other.getLoadedRom() && cache.size() == 1, "same bytes loaded twice");
+        assertTrue(readMemory(0x200) == 0x60 && readMemory(0) == 0xF0, "bad image");
+
+        int builds = 0;
+        auto build = [&builds](const LoadedRom &loaded, size_t &bytes) -> shared_ptr<const void> {
+            builds++;
+            bytes = 100;
+            return make_shared<int>(loaded.bytes.size());
+        };
+        getLoadedRom()->artifact("size", build);
+        shared_ptr<const void> size = other.getLoadedRom()->artifact("size", build);
+        assertTrue(builds == 1 && *static_pointer_cast<const int>(size) == 4, "artifact built twice");
+
+        const char *path = "test_rom_cache.ch8";
+        FILE *file = fopen(path, "wb");
+        fwrite(rom, 1, sizeof(rom), file);
+        fclose(file);
+        uint64_t misses = cache.missCount();
+        load(path);
+        assertTrue(cache.missCount() == misses && getLoadedRom() == other.getLoadedRom(), "file not matched by content");
+
+        // Only what's in use survives
+        cache.setCapacity(0);
+        assertTrue(cache.size() == 0 && other.readMemory(0x201) == 0x2A, "eviction broke a running machine");
+        cache.setCapacity(DEFAULT_ROM_CACHE_CAPACITY);
+        load(path);
+        assertTrue(cache.missCount() == misses + 1 && getLoadedRom() != other.getLoadedRom(), "evicted ROM still cached");
+        remove(path);
+    }
+
+    void testMetricsFormat() {
+        printf("\n..Testing metrics format\n");
+        MetricsSnapshot snapshot;
+        memset(&snapshot, 0, sizeof(snapshot));
+        snapshot.instructions = 480;
+        snapshot.frameTime.observe(0.0166);
+        snapshot.frameTime.observe(0.0167);
+        snapshot.frameTime.observe(0.5);
+        string text = formatMetrics(snapshot);
+        assertTrue(text.find("chip8_instructions_total 480\n") != string::npos, "missing counter");
+        assertTrue(text.find("chip8_frame_time_seconds_bucket{le=\"0.016\"} 0\n") != string::npos
+            && text.find("chip8_frame_time_seconds_bucket{le=\"0.017\"} 2\n") != string::npos
+            && text.find("chip8_frame_time_seconds_bucket{le=\"+Inf\"} 3\n") != string::npos
+            && text.find("chip8_frame_time_seconds_count 3\n") != string::npos, "bad histogram:\n" + text);
+    }
+
+    void testTerminalRenderer() {
+        printf("\n..Testing terminal renderer\n");
+        init();
+        // Never written to, render() only builds the output
+        TerminalRenderer half(-1, TERMINAL_HALF_BLOCKS);
+        assertTrue(half.render(displayBuffer).find("\x1b[2J") != string::npos, "first frame did not clear");
+        assertTrue(half.render(displayBuffer).empty(), "unchanged frame sent");
+        // Pixels 0 and 2 of the top row, the blank cell between is resent
+        displayBuffer[0] = 0xA0;
+        assertTrue(half.render(displayBuffer) == "\x1b[1;1H\u2580 \u2580", "bad half block update");
+        displayBuffer[DISPLAY_BYTES - 1] = 0x01;
+        assertTrue(half.render(displayBuffer) == "\x1b[16;64H\u2584", "bad move to the last cell");
+
+        TerminalRenderer braille(-1, TERMINAL_BRAILLE);
+        braille.render(displayBuffer);
+        for (int y = 0; y < 4; y++) {
+            displayBuffer[y * DISPLAY_ROW_BYTES + 4] = 0x0C;
+        }
+        // Pixels 36-37 of rows 0-3 fill cell 18 of the top row
+        assertTrue(braille.render(displayBuffer) == "\x1b[1;19H\u28FF", "bad braille update");
+    }
+
+    void testPixelExpander() {
+        printf("\n..Testing PixelExpander\n");
+        init();
+        for (int i = 0; i < DISPLAY_BYTES; i++) {
+            displayBuffer[i] = i * 37 + 11;
+        }
+        uint8_t packed[DISPLAY_BYTES];
+        packDisplay(packed);
+
+        const PixelKernel kernels[] = {PIXEL_KERNEL_SCALAR, PIXEL_KERNEL_SSE2, PIXEL_KERNEL_AVX2};
+        for (PixelKernel kernel : kernels) {
+            for (int scale = 1; scale <= MAX_PIXEL_SCALE; scale++) {
+                PixelExpander expander(scale, 0xAABBCCDD, 0x11223344);
+                expander.setKernel(kernel);
+                // Wider than the image, so writes past a row would show
+                int pitch = expander.width() + 3;
+                vector<uint32_t> out(pitch * expander.height(), 0);
+                expander.expand(packed, out.data(), pitch);
+
+                for (int y = 0; y < expander.height(); y++) {
+                    for (int x = 0; x < pitch; x++) {
+                        uint32_t expected = 0;
+                        if (x < expander.width()) {
+                            expected = displayPixel(displayBuffer, x / scale, y / scale) ? 0xAABBCCDD : 0x11223344;
+                        }
+                        assertTrue(out[y * pitch + x] == expected, string("wrong pixel with ")
+                            + PixelExpander::kernelName(expander.getKernel()) + " at scale " + to_string(scale));
+                    }
+                }
+            }
+        }
+    }
+
 public:
     void run() {
         test00E0();
@@ -441,6 +799,17 @@ public:
         test9xy0();
         testAnnn();
         testBnnn();
+        testResetToCheckpoint();
+        testSharedMemory();
+        testFaults();
+        testFusion();
+        testExplorationHash();
+        testQuota();
+        testStateExport();
+        testRomCache();
+        testMetricsFormat();
+        testTerminalRenderer();
+        testPixelExpander();
     }
 };
 
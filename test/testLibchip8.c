@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/libchip8.h"
+
+/* Goes through libchip8.so as a C program would, so it only compiles if the
+   header is valid C99 and only links if the functions are exported. */
+
+static void assertTrue(int assertion, const char *err) {
+    if (!assertion) {
+        printf("\nAssertionFailed: %s\n", err);
+        exit(1);
+    }
+}
+
+int main(void) {
+    /* Draws the font's 0 glyph at 0,0, then jumps to itself */
+    static const uint8_t rom[] = {
+        0xA2, 0x0A, 0x60, 0x00, 0x61, 0x00, 0xD0, 0x15, 0x12, 0x08,
+        0xF0, 0x90, 0x90, 0x90, 0xF0
+    };
+    static uint32_t pixels[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT];
+
+    printf("\n..Testing create and load\n");
+    chip8_vm *vm = chip8_create();
+    assertTrue(vm != NULL, "chip8_create failed");
+    assertTrue(chip8_load_memory(vm, rom, sizeof(rom)) == 0, "chip8_load_memory failed");
+    chip8_seed(vm, 1);
+
+    printf("\n..Testing run\n");
+    assertTrue(chip8_run_frames(vm, 2) == 2, "chip8_run_frames != 2");
+    assertTrue(chip8_status(vm) == CHIP8_STATUS_HALTED, "status != halted");
+    const uint8_t *framebuffer = chip8_framebuffer_ptr(vm);
+    assertTrue(framebuffer[0] == 0xF0 && framebuffer[CHIP8_DISPLAY_ROW_BYTES] == 0x90, "sprite not drawn");
+    assertTrue(chip8_registers_ptr(vm)[0xF] == 0, "VF != 0");
+
+    printf("\n..Testing render\n");
+    assertTrue(chip8_render(vm, pixels, CHIP8_DISPLAY_WIDTH, 1, 0xFFFFFFFF, 0x000000FF) == 0, "chip8_render failed");
+    assertTrue(pixels[0] == 0xFFFFFFFF && pixels[4] == 0x000000FF, "rendered pixels wrong");
+    assertTrue(chip8_render(vm, pixels, CHIP8_DISPLAY_WIDTH, 2, 0, 0) != 0, "pitch too small accepted");
+
+    printf("\n..Testing save and load state\n");
+    size_t size = chip8_state_size();
+    uint8_t *state = malloc(size);
+    assertTrue(state != NULL, "out of memory");
+    assertTrue(chip8_save_state(vm, state, size - 1) != 0, "short buffer accepted");
+    assertTrue(chip8_save_state(vm, state, size) == 0, "chip8_save_state failed");
+    chip8_vm *copy = chip8_create();
+    assertTrue(copy != NULL, "chip8_create failed");
+    assertTrue(chip8_load_state(copy, state, size) == 0, "chip8_load_state failed");
+    assertTrue(memcmp(chip8_framebuffer_ptr(copy), framebuffer, CHIP8_DISPLAY_ROW_BYTES * CHIP8_DISPLAY_HEIGHT) == 0,
+        "framebuffer not restored");
+    assertTrue(chip8_status(copy) == CHIP8_STATUS_HALTED, "status not restored");
+    uint8_t glyph[5];
+    chip8_read_memory(copy, 0x20A, glyph, sizeof(glyph));
+    assertTrue(memcmp(glyph, rom + 10, sizeof(glyph)) == 0, "memory not restored");
+    state[0] ^= 0xFF;
+    assertTrue(chip8_load_state(copy, state, size) != 0, "bad magic accepted");
+
+    free(state);
+    chip8_destroy(copy);
+    chip8_destroy(vm);
+    return 0;
+}